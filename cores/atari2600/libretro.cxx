@@ -36,6 +36,9 @@ static OSystem osystem;
 static StateManager stateManager(&osystem);
 
 static int videoWidth, videoHeight;
+// Random generator state right after the console was created. It isn't part
+// of a savestate, so reset rewinds to it to behave like a fresh load
+static uInt32 initialRandom;
 
 static retro_log_printf_t log_cb;
 static retro_video_refresh_t video_cb;
@@ -227,6 +230,7 @@ bool retro_load_game(const struct retro_game_info *info)
    // Create the console
    console = new Console(&osystem, cartridge, props);
    osystem.myConsole = console;
+   initialRandom = console->system().randGenerator().value();
 
    // Init sound and video
    console->initializeVideo();
@@ -315,6 +319,7 @@ void retro_deinit(void)
 
 void retro_reset(void)
 {
+   console->system().randGenerator().setValue(initialRandom);
    console->system().reset();
 }
 
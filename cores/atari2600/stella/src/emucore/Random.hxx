@@ -54,6 +54,21 @@ class Random
     */
     uInt32 next();
 
+    /**
+      Answer the current state of the generator, so that it can later be
+      rewound with setValue()
+
+      @return The internal generator state
+    */
+    uInt32 value() const { return myValue; }
+
+    /**
+      Restore a state previously obtained from value()
+
+      @param value  The internal generator state
+    */
+    void setValue(uInt32 value) { myValue = value; }
+
     /**
       Class method which sets the OSystem in use; the constructor will
       use this to reseed the random number generator every time a new
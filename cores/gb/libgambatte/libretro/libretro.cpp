@@ -24,6 +24,10 @@
 #include <string>
 #include <cstring>
 
+#ifndef RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE
+#define RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (47 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+#endif
+
 #ifdef _3DS
 extern "C" void* linearMemAlign(size_t size, size_t alignment);
 extern "C" void linearFree(void* mem);
@@ -854,7 +858,14 @@ void retro_run()
    } static sound_buf;
    unsigned samples = 2064;
 
-   while (gb.runFor(video_buf, video_pitch, sound_buf.u32, samples) == -1)
+   // Without a frame buffer the PPU draws each line into a scratch line, so
+   // skipped frames emulate exactly the same
+   int av_enable = 3;
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+      av_enable = 3;
+   gambatte::video_pixel_t* frame_buf = (av_enable & 1) ? video_buf : NULL;
+
+   while (gb.runFor(frame_buf, video_pitch, sound_buf.u32, samples) == -1)
    {
 #ifdef CC_RESAMPLER
       CC_renderaudio((audio_frame_t*)sound_buf.u32, samples);
@@ -874,7 +885,7 @@ void retro_run()
       samples = 2064;
    }
 #ifdef DUAL_MODE
-   while (gb2.runFor(video_buf+160, video_pitch, sound_buf.u32, samples) == -1) {}
+   while (gb2.runFor(frame_buf ? frame_buf+160 : NULL, video_pitch, sound_buf.u32, samples) == -1) {}
 #endif
 
    samples_count += samples;
@@ -886,9 +897,9 @@ void retro_run()
 #endif
 
 #ifdef VIDEO_RGB565
-   video_cb(video_buf, 160*NUM_GAMEBOYS, 144, 512*NUM_GAMEBOYS);
+   video_cb(frame_buf, 160*NUM_GAMEBOYS, 144, 512*NUM_GAMEBOYS);
 #else
-   video_cb(video_buf, 160*NUM_GAMEBOYS, 144, 1024*NUM_GAMEBOYS);
+   video_cb(frame_buf, 160*NUM_GAMEBOYS, 144, 1024*NUM_GAMEBOYS);
 #endif
 
 
@@ -592,6 +592,9 @@ static uint8 object_count[2];
 /* Sprite Collision Info */
 uint16 spr_col;
 
+/* Framebuffer output (lines are still rendered internally when disabled) */
+uint8 remap_enabled = 1;
+
 /* Function pointers */
 void (*render_bg)(int line);
 void (*render_obj)(int line);
@@ -4164,6 +4167,9 @@ void remap_line(int line)
   /* Line width */
   int width = bitmap.viewport.w + 2*bitmap.viewport.x;
 
+  /* Pixel output disabled by frontend */
+  if (!remap_enabled) return;
+
   /* Pixel line buffer */
   uint8 *src = &linebuf[0][0x20 - bitmap.viewport.x];
 
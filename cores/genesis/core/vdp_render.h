@@ -100,6 +100,7 @@
 
 /* Global variables */
 extern uint16 spr_col;
+extern uint8 remap_enabled;
 
 /* Function prototypes */
 extern void render_init(void);
@@ -76,6 +76,10 @@
 #include "sms_ntsc.h"
 #include <streams/file_stream.h>
 
+#ifndef RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE
+#define RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (47 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+#endif
+
 sms_ntsc_t *sms_ntsc;
 md_ntsc_t  *md_ntsc;
 
@@ -2283,8 +2287,15 @@ void retro_reset(void)
 void retro_run(void)
 {
    bool updated = false;
+   int av_enable = 3;
    is_running = true;
 
+   /* Sprite parsing and collision detection depend on rendered lines, so only
+    * the conversion to the output framebuffer is skipped */
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+      av_enable = 3;
+   remap_enabled = av_enable & 1;
+
    if (system_hw == SYSTEM_MCD)
       system_frame_scd(0);
    else if ((system_hw & SYSTEM_PBC) == SYSTEM_MD)
@@ -2332,7 +2343,10 @@ void retro_run(void)
       }
    }
 
-   video_cb(bitmap.data, vwidth, vheight, 720 * 2);
+   if (remap_enabled)
+      video_cb(bitmap.data, vwidth, vheight, 720 * 2);
+   else
+      video_cb(NULL, vwidth, vheight, 720 * 2);
    audio_cb(soundbuffer, audio_update(soundbuffer));
 
    environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated);
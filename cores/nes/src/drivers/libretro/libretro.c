@@ -26,6 +26,10 @@
 
 #include "libretro-common/include/streams/memory_stream.h"
 
+#ifndef RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE
+#define RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (47 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+#endif
+
 #define NES_8_7_PAR (width * (8.0 / 7.0)) / height
 #define NES_4_3 4.0 / 3.0
 
@@ -1300,19 +1304,33 @@ void retro_run(void)
    uint8_t *gfx;
    int32_t ssize = 0;
    bool updated = false;
+   int av_enable = 3;
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
       check_variables(false);
 
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+      av_enable = 3;
+
    FCEUD_UpdateInput();
    FCEUI_Emulate(&gfx, &sound, &ssize, 0);
 
-   for (i = 0; i < ssize; i++)
-      sound[i] = (sound[i] << 16) | (sound[i] & 0xffff);
+   /* The PPU still draws into XBuf since sprite 0 hits depend on it; only
+    * the conversion to the output format is skipped */
+   if (av_enable & 2)
+   {
+      for (i = 0; i < ssize; i++)
+         sound[i] = (sound[i] << 16) | (sound[i] & 0xffff);
 
-   audio_batch_cb((const int16_t*)sound, ssize);
+      audio_batch_cb((const int16_t*)sound, ssize);
+   }
 
-   retro_run_blit(gfx);
+   if (av_enable & 1)
+      retro_run_blit(gfx);
+   else if (use_overscan)
+      video_cb(NULL, 256, 240, 512);
+   else
+      video_cb(NULL, 240, 224, 480);
 }
 
 static unsigned serialize_size = 0;
@@ -39,6 +39,10 @@
 #define RETRO_GAME_TYPE_SUFAMI_TURBO    0x103
 #define RETRO_GAME_TYPE_SUPER_GAME_BOY  0x104
 
+#ifndef RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE
+#define RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (47 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+#endif
+
 #define SNES_4_3 4.0f / 3.0f
 
 char g_rom_dir[1024];
@@ -977,7 +981,18 @@ void retro_run()
    }
    poll_cb();
    report_buttons();
+
+   // Skipped frames still update the sprite range/time over flags, so
+   // emulation doesn't depend on whether a frame is rendered
+   int av_enable = 3;
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+      av_enable = 3;
+   IPPU.RenderThisFrame = (av_enable & 1) ? TRUE : FALSE;
+
    S9xMainLoop();
+
+   if (!IPPU.RenderThisFrame)
+      video_cb(NULL, IPPU.RenderedScreenWidth, IPPU.RenderedScreenHeight, GFX.Pitch);
 }
 
 void retro_deinit()
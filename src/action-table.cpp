@@ -0,0 +1,145 @@
+#include "action-table.h"
+
+#include "data.h"
+#include "emulator.h"
+
+using namespace std;
+using namespace Retro;
+
+// Keeps the per-player DISCRETE table within a few megabytes
+static const size_t MAX_DISCRETE_TABLE = 1 << 20;
+
+bool ActionTable::compile(const Scenario& scenario, Mode mode, size_t numButtons, unsigned players) {
+	if (!players || players > MAX_PLAYERS || numButtons > N_BUTTONS) {
+		return false;
+	}
+
+	vector<vector<uint16_t>> combos;
+	for (const auto& combo : scenario.validActions()) {
+		if (combo.second.empty()) {
+			return false;
+		}
+		combos.emplace_back(combo.second.begin(), combo.second.end());
+	}
+
+	vector<uint16_t> discrete;
+	if (mode == Mode::DISCRETE) {
+		size_t perPlayer = 1;
+		for (const auto& combo : combos) {
+			if (perPlayer * combo.size() > MAX_DISCRETE_TABLE) {
+				return false;
+			}
+			perPlayer *= combo.size();
+		}
+		// The first combo varies fastest, as in RetroEnv.action_to_array
+		discrete.resize(perPlayer);
+		for (size_t index = 0; index < perPlayer; ++index) {
+			size_t remaining = index;
+			uint16_t mask = 0;
+			for (const auto& combo : combos) {
+				mask |= combo[remaining % combo.size()];
+				remaining /= combo.size();
+			}
+			discrete[index] = mask;
+		}
+		uint64_t total = 1;
+		for (unsigned player = 0; player < players; ++player) {
+			if (total > UINT64_MAX / perPlayer) {
+				return false;
+			}
+			total *= perPlayer;
+		}
+	}
+
+	vector<uint16_t> filter;
+	if (mode == Mode::FILTERED) {
+		filter.resize(size_t(1) << numButtons);
+		for (size_t action = 0; action < filter.size(); ++action) {
+			filter[action] = scenario.filterAction(action);
+		}
+	}
+
+	m_mode = mode;
+	m_players = players;
+	m_buttons = numButtons;
+	m_combos = move(combos);
+	m_discrete = move(discrete);
+	m_filter = move(filter);
+	return true;
+}
+
+size_t ActionTable::width() const {
+	switch (m_mode) {
+	case Mode::DISCRETE:
+		return 1;
+	case Mode::MULTI_DISCRETE:
+		return m_combos.size() * m_players;
+	default:
+		return m_buttons * m_players;
+	}
+}
+
+uint64_t ActionTable::size() const {
+	if (m_mode != Mode::DISCRETE) {
+		return 0;
+	}
+	uint64_t total = 1;
+	for (unsigned player = 0; player < m_players; ++player) {
+		total *= m_discrete.size();
+	}
+	return total;
+}
+
+vector<size_t> ActionTable::choices() const {
+	vector<size_t> choices;
+	if (m_mode != Mode::MULTI_DISCRETE) {
+		return choices;
+	}
+	for (unsigned player = 0; player < m_players; ++player) {
+		for (const auto& combo : m_combos) {
+			choices.emplace_back(combo.size());
+		}
+	}
+	return choices;
+}
+
+bool ActionTable::decode(int64_t action, uint16_t* masks) const {
+	if (m_mode != Mode::DISCRETE || action < 0) {
+		return false;
+	}
+	uint64_t remaining = action;
+	for (unsigned player = 0; player < m_players; ++player) {
+		masks[player] = m_discrete[remaining % m_discrete.size()];
+		remaining /= m_discrete.size();
+	}
+	return remaining == 0;
+}
+
+bool ActionTable::decode(const int64_t* action, uint16_t* masks) const {
+	switch (m_mode) {
+	case Mode::DISCRETE:
+		return decode(*action, masks);
+	case Mode::MULTI_DISCRETE:
+		for (unsigned player = 0; player < m_players; ++player) {
+			uint16_t mask = 0;
+			for (size_t i = 0; i < m_combos.size(); ++i) {
+				int64_t choice = *action++;
+				if (choice < 0 || static_cast<uint64_t>(choice) >= m_combos[i].size()) {
+					return false;
+				}
+				mask |= m_combos[i][choice];
+			}
+			masks[player] = mask;
+		}
+		return true;
+	default:
+		for (unsigned player = 0; player < m_players; ++player) {
+			uint16_t mask = 0;
+			for (size_t key = 0; key < m_buttons; ++key) {
+				mask |= (*action++ ? 1u : 0u) << key;
+			}
+			masks[player] = m_mode == Mode::FILTERED ? m_filter[mask] : mask;
+		}
+		return true;
+	}
+}
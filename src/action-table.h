@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Retro {
+
+class Scenario;
+
+// An action space compiled down to button masks, so applying an action is a
+// table lookup instead of a walk over the scenario's valid action sets. The
+// modes match stable_retro.Actions
+class ActionTable {
+public:
+	enum class Mode {
+		ALL = 0,
+		FILTERED = 1,
+		DISCRETE = 2,
+		MULTI_DISCRETE = 3,
+	};
+
+	// Fails if there are more players or buttons than fit in a mask, or if a
+	// DISCRETE space would be too large to index
+	bool compile(const Scenario&, Mode, size_t numButtons, unsigned players);
+
+	Mode mode() const { return m_mode; }
+	unsigned players() const { return m_players; }
+
+	// Number of values in one action: one for DISCRETE, one per combo per
+	// player for MULTI_DISCRETE and one per button per player otherwise
+	size_t width() const;
+	// Number of actions in a DISCRETE space
+	uint64_t size() const;
+	// Number of choices for each value of a MULTI_DISCRETE action
+	std::vector<size_t> choices() const;
+
+	// Write players() button masks for a DISCRETE action index
+	bool decode(int64_t action, uint16_t* masks) const;
+	// Write players() button masks for an action of width() values
+	bool decode(const int64_t* action, uint16_t* masks) const;
+
+private:
+	Mode m_mode = Mode::ALL;
+	unsigned m_players = 0;
+	size_t m_buttons = 0;
+
+	// Button masks for each choice of each combo, in validActions() order
+	std::vector<std::vector<uint16_t>> m_combos;
+	// DISCRETE: masks for every per-player index, combos in mixed radix
+	std::vector<uint16_t> m_discrete;
+	// FILTERED: filtered mask for every raw button mask
+	std::vector<uint16_t> m_filter;
+};
+}
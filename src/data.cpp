@@ -9,6 +9,7 @@
 
 #include "json.hpp"
 
+#include <algorithm>
 #include <fstream>
 
 using namespace Retro;
@@ -91,6 +92,7 @@ bool GameData::load(istream* file) {
 
 	unordered_map<std::string, Variable> oldVars;
 	oldVars.swap(m_vars);
+	invalidateVariables();
 	for (auto var = info->cbegin(); var != info->cend(); ++var) {
 		if (var->find("address") == var->cend() || var->find("type") == var->cend()) {
 			oldVars.swap(m_vars);
@@ -158,6 +160,8 @@ void GameData::reset() {
 	m_lastMem.reset();
 	m_cloneMem.reset();
 	m_vars.clear();
+	invalidateVariables();
+	m_snapshotsMatch = false;
 	m_searches.clear();
 	m_searchOldMem.clear();
 }
@@ -166,9 +170,201 @@ void GameData::restart() {
 	m_customVars.clear();
 }
 
+// The two snapshots swap roles every frame instead of being reallocated, and
+// once their layout matches the live memory only variable bytes are copied
 void GameData::updateRam() {
-	m_lastMem = move(m_cloneMem);
-	m_cloneMem.clone(m_mem);
+	m_lastMem.swap(m_cloneMem);
+	if (m_snapshotRangesDirty) {
+		updateSnapshotRanges();
+	}
+	if (m_fullSnapshots || !m_cloneMem.copyRanges(m_mem, m_snapshotRanges)) {
+		m_cloneMem.clone(m_mem);
+		if (m_fullSnapshots) {
+			--m_fullSnapshots;
+		}
+	}
+
+	// Compiled slots index blocks by position, which only carries over to
+	// snapshots with the same layout as the live memory
+	m_cloneBases.clear();
+	m_lastBases.clear();
+	m_snapshotsMatch = true;
+	auto live = m_mem.blocks().cbegin();
+	for (const auto& block : m_cloneMem.blocks()) {
+		m_cloneBases.push_back(static_cast<const uint8_t*>(block.second.offset(0)));
+	}
+	for (const auto& block : m_lastMem.blocks()) {
+		if (live == m_mem.blocks().cend() || live->first != block.first || live->second.size() != block.second.size()) {
+			m_snapshotsMatch = false;
+			break;
+		}
+		m_lastBases.push_back(static_cast<const uint8_t*>(block.second.offset(0)));
+		++live;
+	}
+	if (m_lastMem.ok() && live != m_mem.blocks().cend()) {
+		m_snapshotsMatch = false;
+	}
+	m_snapshotGeneration = m_mem.generation();
+}
+
+void GameData::invalidateVariables() {
+	m_snapshotRangesDirty = true;
+	m_slots.clear();
+	m_slotNames.clear();
+	++m_generation;
+}
+
+size_t GameData::compileVariable(const string& name) {
+	if (m_customVars.find(name) != m_customVars.end()) {
+		return SIZE_MAX;
+	}
+	auto slot = m_slotNames.find(name);
+	if (slot != m_slotNames.end()) {
+		return slot->second;
+	}
+	auto var = m_vars.find(name);
+	if (var == m_vars.end()) {
+		return SIZE_MAX;
+	}
+	m_slots.push_back({ var->second, SIZE_MAX, 0 });
+	m_slotNames.emplace(name, m_slots.size() - 1);
+	m_layoutGeneration = UINT64_MAX;
+	return m_slots.size() - 1;
+}
+
+// Mirrors the block search in AddressSpace::operator[]
+void GameData::resolveSlots() {
+	m_liveBases.clear();
+	for (const auto& block : m_mem.blocks()) {
+		m_liveBases.push_back(static_cast<const uint8_t*>(block.second.offset(0)));
+	}
+	for (auto& slot : m_slots) {
+		slot.block = SIZE_MAX;
+		size_t index = 0;
+		for (const auto& block : m_mem.blocks()) {
+			if (slot.var.address < block.first) {
+				break;
+			}
+			if (slot.var.address - block.first < block.second.size()) {
+				slot.block = index;
+				slot.offset = slot.var.address - block.first;
+				break;
+			}
+			++index;
+		}
+	}
+	m_layoutGeneration = m_mem.generation();
+}
+
+static int64_t decodeVariable(const uint8_t* base, size_t offset, const Variable& var, const MemoryOverlay& overlay) {
+	int64_t value;
+	if (overlay.width > 1) {
+		uint8_t fakeBase[16];
+		value = var.type.decode(overlay.parse(base, offset, reinterpret_cast<void*>(fakeBase), var.type.width));
+	} else {
+		value = var.type.decode(base + offset);
+	}
+	return value & var.mask;
+}
+
+bool GameData::lookupCompiled(size_t index, int64_t* value, int64_t* delta) {
+	if (m_layoutGeneration != m_mem.generation()) {
+		resolveSlots();
+	}
+	const VariableSlot& slot = m_slots[index];
+	if (slot.block == SIZE_MAX || !m_snapshotsMatch || m_snapshotGeneration != m_layoutGeneration) {
+		return false;
+	}
+	const MemoryOverlay& overlay = m_mem.overlay();
+	*value = decodeVariable(m_liveBases[slot.block], slot.offset, slot.var, overlay);
+	if (m_lastBases.empty()) {
+		*delta = 0;
+	} else {
+		*delta = decodeVariable(m_cloneBases[slot.block], slot.offset, slot.var, overlay) - decodeVariable(m_lastBases[slot.block], slot.offset, slot.var, overlay);
+	}
+	return true;
+}
+
+bool GameData::lookupCompiled(size_t index, int64_t* value) {
+	if (m_layoutGeneration != m_mem.generation()) {
+		resolveSlots();
+	}
+	const VariableSlot& slot = m_slots[index];
+	if (slot.block == SIZE_MAX) {
+		return false;
+	}
+	*value = decodeVariable(m_liveBases[slot.block], slot.offset, slot.var, m_mem.overlay());
+	return true;
+}
+
+void GameData::setInfoSchema(const vector<string>& names) {
+	m_infoNames = names;
+	m_infoFixed = true;
+	m_infoGeneration = UINT64_MAX;
+}
+
+const vector<string>& GameData::infoSchema() {
+	if (m_infoGeneration != m_generation) {
+		compileInfo();
+	}
+	return m_infoNames;
+}
+
+void GameData::compileInfo() {
+	if (!m_infoFixed) {
+		m_infoNames.clear();
+		for (const auto& var : m_vars) {
+			m_infoNames.push_back(var.first);
+		}
+		sort(m_infoNames.begin(), m_infoNames.end());
+	}
+	m_infoSlots.clear();
+	for (const auto& name : m_infoNames) {
+		m_infoSlots.push_back(compileVariable(name));
+	}
+	m_infoGeneration = m_generation;
+}
+
+void GameData::lookupInfo(int64_t* out) {
+	if (m_infoGeneration != m_generation) {
+		compileInfo();
+	}
+	const GameData* self = this;
+	for (size_t i = 0; i < m_infoNames.size(); ++i) {
+		if (m_infoSlots[i] != SIZE_MAX && lookupCompiled(m_infoSlots[i], &out[i])) {
+			continue;
+		}
+		try {
+			out[i] = self->lookupValue(m_infoNames[i]);
+		} catch (...) {
+			out[i] = 0;
+		}
+	}
+}
+
+void GameData::updateSnapshotRanges() {
+	size_t unit = max<size_t>(m_mem.overlay().width, 1);
+	m_snapshotRanges.clear();
+	for (const auto& var : m_vars) {
+		size_t start = var.second.address / unit * unit;
+		size_t end = (var.second.address + var.second.type.width + unit - 1) / unit * unit;
+		m_snapshotRanges.emplace_back(start, end - start);
+	}
+	sort(m_snapshotRanges.begin(), m_snapshotRanges.end());
+	vector<pair<size_t, size_t>> merged;
+	for (const auto& range : m_snapshotRanges) {
+		if (!merged.empty() && merged.back().first + merged.back().second >= range.first) {
+			size_t end = max(merged.back().first + merged.back().second, range.first + range.second);
+			merged.back().second = end - merged.back().first;
+		} else {
+			merged.push_back(range);
+		}
+	}
+	m_snapshotRanges.swap(merged);
+	m_snapshotRangesDirty = false;
+	// Bytes of new variables are stale in both snapshots until each has been
+	// fully refreshed once
+	m_fullSnapshots = 2;
 }
 
 void GameData::setTypes(const vector<DataType> types) {
@@ -309,12 +505,14 @@ Variable GameData::getVariable(const string& name) const {
 void GameData::setVariable(const string& name, const Variable& var) {
 	removeVariable(name);
 	m_vars.emplace(name, var);
+	invalidateVariables();
 }
 
 void GameData::removeVariable(const string& name) {
 	auto iter = m_vars.find(name);
 	if (iter != m_vars.end()) {
 		m_vars.erase(iter);
+		invalidateVariables();
 	}
 }
 
@@ -781,6 +979,7 @@ void Scenario::reset() {
 	}
 	m_doneVars.clear();
 	m_doneCondition = DoneCondition::ANY;
+	m_compiled = false;
 }
 
 bool Scenario::loadScript(const string& filename, const string& scope) {
@@ -813,13 +1012,35 @@ bool Scenario::loadScript(const string& filename, const string& scope) {
 	}
 	if (context->load(m_base + "/" + path)) {
 		m_scripts.emplace_back(make_pair(path, scope));
+		m_scriptContexts[scope] = context;
 		return true;
 	}
 	return false;
 }
 
 void Scenario::reloadScripts() {
+	bool resident = true;
+	for (const auto& script : m_scripts) {
+		const auto& found = m_scriptContexts.find(script.second);
+		shared_ptr<ScriptContext> context;
+		if (found != m_scriptContexts.end()) {
+			context = found->second.lock();
+		}
+		if (!context || !context->isBoundTo(this) || ScriptContext::get(script.second) != context) {
+			resident = false;
+			break;
+		}
+	}
+	if (resident) {
+		// The contexts still hold exactly these scripts, so rewind them in place
+		for (const auto& context : m_scriptContexts) {
+			context.second.lock()->restart();
+		}
+		return;
+	}
+
 	ScriptContext::reset();
+	m_scriptContexts.clear();
 
 	for (const auto& script : m_scripts) {
 		auto context = ScriptContext::get(script.second);
@@ -828,7 +1049,9 @@ void Scenario::reloadScripts() {
 		}
 		context->setData(&m_data);
 		context->setScenario(this);
-		context->load(m_base + "/" + script.first);
+		if (context->load(m_base + "/" + script.first)) {
+			m_scriptContexts[script.second] = context;
+		}
 	}
 }
 
@@ -847,6 +1070,9 @@ void Scenario::restart() {
 }
 
 void Scenario::update() {
+	if (!m_compiled || m_compiledGeneration != m_data.generation() || m_compiledScriptGeneration != ScriptContext::generation()) {
+		compile();
+	}
 	m_done = calculateDone();
 	for (unsigned i = 0; i < MAX_PLAYERS; ++i) {
 		m_reward[i] = calculateReward(i);
@@ -855,6 +1081,66 @@ void Scenario::update() {
 	++m_frame;
 }
 
+void Scenario::compile() {
+	for (unsigned i = 0; i < MAX_PLAYERS; ++i) {
+		m_compiledRewards[i].clear();
+		for (const auto& var : m_rewardVars[i]) {
+			m_compiledRewards[i].push_back({ var.first, var.second, m_data.compileVariable(var.first) });
+		}
+	}
+	DoneNode root;
+	root.vars = m_doneVars;
+	root.nodes = m_doneNodes;
+	root.condition = m_doneCondition;
+	m_compiledDone = {};
+	compileDoneNode(root, &m_compiledDone);
+	for (unsigned i = 0; i < MAX_PLAYERS; ++i) {
+		m_compiledRewardFunc[i] = compileScript(m_rewardFunc[i]);
+	}
+	m_compiledDoneFunc = compileScript(m_doneFunc);
+	m_compiledGeneration = m_data.generation();
+	m_compiledScriptGeneration = ScriptContext::generation();
+	m_compiled = true;
+}
+
+Scenario::CompiledScript Scenario::compileScript(const pair<string, string>& func) {
+	CompiledScript compiled;
+	if (func.first.empty()) {
+		return compiled;
+	}
+	compiled.context = ScriptContext::get(func.second);
+	if (compiled.context) {
+		compiled.function = compiled.context->bindFunction(func.first);
+	}
+	return compiled;
+}
+
+Variant Scenario::callScript(const CompiledScript& script) const {
+	if (!script.context) {
+		throw runtime_error("Script context is not available");
+	}
+	return script.context->callBound(script.function);
+}
+
+void Scenario::compileDoneNode(const DoneNode& node, CompiledDoneNode* compiled) {
+	compiled->condition = node.condition;
+	for (const auto& var : node.vars) {
+		compiled->vars.push_back({ var.first, var.second, m_data.compileVariable(var.first) });
+	}
+	for (const auto& subnode : node.nodes) {
+		compiled->nodes.emplace_back();
+		compileDoneNode(*subnode.second, &compiled->nodes.back());
+	}
+}
+
+void Scenario::lookup(const string& name, size_t slot, int64_t* value, int64_t* delta) const {
+	if (slot != SIZE_MAX && m_data.lookupCompiled(slot, value, delta)) {
+		return;
+	}
+	*value = m_data.lookupValue(name);
+	*delta = m_data.lookupDelta(name);
+}
+
 float Scenario::currentReward(unsigned player) const {
 	if (player >= MAX_PLAYERS) {
 		throw range_error("requested player is out of bounds");
@@ -900,61 +1186,49 @@ void Scenario::getCrop(size_t* x, size_t* y, size_t* width, size_t* height, unsi
 
 float Scenario::calculateReward(unsigned player) const {
 	if (m_rewardFunc[player].first.size()) {
-		return ScriptContext::get(m_rewardFunc[player].second)->callFunction(m_rewardFunc[player].first);
+		return callScript(m_compiledRewardFunc[player]);
 	}
 
 	float reward = m_rewardTime[player].calculate(1, 1);
-	for (auto var = m_rewardVars[player].cbegin(); var != m_rewardVars[player].cend(); ++var) {
-		reward += var->second.calculate(m_data.lookupValue(var->first), m_data.lookupDelta(var->first));
+	for (const auto& var : m_compiledRewards[player]) {
+		int64_t value;
+		int64_t delta;
+		lookup(var.name, var.slot, &value, &delta);
+		reward += var.spec.calculate(value, delta);
 	}
 	return reward;
 }
 
 bool Scenario::calculateDone() const {
 	if (m_doneFunc.first.size()) {
-		return ScriptContext::get(m_doneFunc.second)->callFunction(m_doneFunc.first);
+		return callScript(m_compiledDoneFunc);
 	}
-	for (auto var = m_doneVars.cbegin(); var != m_doneVars.cend(); ++var) {
-		int done = var->second.test(m_data.lookupValue(var->first), m_data.lookupDelta(var->first));
-		if (done > 0 && m_doneCondition == DoneCondition::ANY) {
-			return true;
-		}
-		if (done <= 0 && m_doneCondition == DoneCondition::ALL) {
-			return false;
-		}
-	}
-	for (auto node = m_doneNodes.cbegin(); node != m_doneNodes.cend(); ++node) {
-		int done = isDone(*node->second);
-		if (done > 0 && m_doneCondition == DoneCondition::ANY) {
-			return true;
-		}
-		if (done <= 0 && m_doneCondition == DoneCondition::ALL) {
-			return false;
-		}
-	}
-	return m_doneCondition == DoneCondition::ALL;
+	return isDone(m_compiledDone);
 }
 
-bool Scenario::isDone(const DoneNode& subnode) const {
-	for (auto var = subnode.vars.cbegin(); var != subnode.vars.cend(); ++var) {
-		int done = var->second.test(m_data.lookupValue(var->first), m_data.lookupDelta(var->first));
-		if (done > 0 && subnode.condition == DoneCondition::ANY) {
+bool Scenario::isDone(const CompiledDoneNode& node) const {
+	for (const auto& var : node.vars) {
+		int64_t value;
+		int64_t delta;
+		lookup(var.name, var.slot, &value, &delta);
+		int done = var.spec.test(value, delta);
+		if (done > 0 && node.condition == DoneCondition::ANY) {
 			return true;
 		}
-		if (done <= 0 && subnode.condition == DoneCondition::ALL) {
+		if (done <= 0 && node.condition == DoneCondition::ALL) {
 			return false;
 		}
 	}
-	for (auto node = subnode.nodes.cbegin(); node != subnode.nodes.cend(); ++node) {
-		int done = isDone(*node->second);
-		if (done > 0 && subnode.condition == DoneCondition::ANY) {
+	for (const auto& subnode : node.nodes) {
+		int done = isDone(subnode);
+		if (done > 0 && node.condition == DoneCondition::ANY) {
 			return true;
 		}
-		if (done <= 0 && subnode.condition == DoneCondition::ALL) {
+		if (done <= 0 && node.condition == DoneCondition::ALL) {
 			return false;
 		}
 	}
-	return subnode.condition == DoneCondition::ALL;
+	return node.condition == DoneCondition::ALL;
 }
 
 void Scenario::setActions(const vector<vector<vector<string>>>& actions) {
@@ -1043,10 +1317,12 @@ string Scenario::name(Operation op) {
 
 void Scenario::setRewardVariable(const string& name, const RewardSpec& var, unsigned player) {
 	m_rewardVars[player].emplace(name, var);
+	m_compiled = false;
 }
 
 void Scenario::setRewardFunction(const string& name, const string& scope, unsigned player) {
 	m_rewardFunc[player] = make_pair(name, scope);
+	m_compiled = false;
 }
 
 void Scenario::setRewardTime(const RewardSpec& spec, unsigned player) {
@@ -1055,18 +1331,22 @@ void Scenario::setRewardTime(const RewardSpec& spec, unsigned player) {
 
 void Scenario::setDoneVariable(const string& name, const DoneSpec& var) {
 	m_doneVars.emplace(name, var);
+	m_compiled = false;
 }
 
 void Scenario::setDoneNode(const string& name, shared_ptr<DoneNode> node) {
 	m_doneNodes.emplace(name, move(node));
+	m_compiled = false;
 }
 
 void Scenario::setDoneCondition(Scenario::DoneCondition condition) {
 	m_doneCondition = condition;
+	m_compiled = false;
 }
 
 void Scenario::setDoneFunction(const string& name, const string& scope) {
 	m_doneFunc = make_pair(name, scope);
+	m_compiled = false;
 }
 
 unordered_map<string, Scenario::RewardSpec> Scenario::listRewardVariables(unsigned player) const {
@@ -53,6 +53,23 @@ public:
 
 	int64_t lookupDelta(const std::string& name) const;
 
+	// Resolves a variable to a slot that can be read every frame without
+	// hashing its name or searching the address space. Returns SIZE_MAX for
+	// names that aren't memory variables. Slots are invalidated whenever
+	// generation() changes
+	size_t compileVariable(const std::string& name);
+	// Returns false if the slot has to be looked up by name this frame
+	bool lookupCompiled(size_t slot, int64_t* value, int64_t* delta);
+	bool lookupCompiled(size_t slot, int64_t* value);
+
+	// Fixes the columns written by lookupInfo. Until a schema is set it lists
+	// every variable, sorted by name
+	void setInfoSchema(const std::vector<std::string>& names);
+	const std::vector<std::string>& infoSchema();
+	// Writes one value per schema column; unknown and unmapped names read as 0
+	void lookupInfo(int64_t* out);
+	uint64_t generation() const { return m_generation; }
+
 	Variable getVariable(const std::string& name) const;
 	void setVariable(const std::string& name, const Variable&);
 	void removeVariable(const std::string& name);
@@ -74,9 +91,38 @@ public:
 #endif
 
 private:
+	struct VariableSlot {
+		Variable var;
+		size_t block;
+		size_t offset;
+	};
+
+	void updateSnapshotRanges();
+	void invalidateVariables();
+	void resolveSlots();
+	void compileInfo();
+
 	AddressSpace m_mem;
 	AddressSpace m_cloneMem;
 	AddressSpace m_lastMem;
+	// Address ranges read by variables; only these are copied into snapshots
+	std::vector<std::pair<size_t, size_t>> m_snapshotRanges;
+	bool m_snapshotRangesDirty = true;
+	unsigned m_fullSnapshots = 0;
+
+	uint64_t m_generation = 0;
+	std::vector<VariableSlot> m_slots;
+	std::unordered_map<std::string, size_t> m_slotNames;
+	uint64_t m_layoutGeneration = UINT64_MAX;
+	std::vector<const uint8_t*> m_liveBases;
+	std::vector<const uint8_t*> m_cloneBases;
+	std::vector<const uint8_t*> m_lastBases;
+	bool m_snapshotsMatch = false;
+	uint64_t m_snapshotGeneration = 0;
+	std::vector<std::string> m_infoNames;
+	std::vector<size_t> m_infoSlots;
+	bool m_infoFixed = false;
+	uint64_t m_infoGeneration = UINT64_MAX;
 	std::vector<DataType> m_types;
 
 	std::map<int, std::set<int>> m_actions;
@@ -88,6 +134,7 @@ private:
 	std::unordered_map<std::string, std::unique_ptr<Variant>> m_customVars;
 };
 
+class ScriptContext;
 class Scenario {
 public:
 	Scenario(GameData& data);
@@ -196,7 +243,38 @@ public:
 	DoneCondition doneCondition() const { return m_doneCondition; }
 
 private:
-	bool isDone(const DoneNode&) const;
+	// Reward and done variables flattened into vectors with their GameData
+	// slots resolved, rebuilt whenever the specs or the game data change
+	struct CompiledReward {
+		std::string name;
+		RewardSpec spec;
+		size_t slot;
+	};
+
+	struct CompiledDone {
+		std::string name;
+		DoneSpec spec;
+		size_t slot;
+	};
+
+	struct CompiledDoneNode {
+		std::vector<CompiledDone> vars;
+		std::vector<CompiledDoneNode> nodes;
+		DoneCondition condition = DoneCondition::ANY;
+	};
+
+	// A reward or done function bound in its script context
+	struct CompiledScript {
+		std::shared_ptr<ScriptContext> context;
+		size_t function = 0;
+	};
+
+	void compile();
+	void compileDoneNode(const DoneNode&, CompiledDoneNode*);
+	CompiledScript compileScript(const std::pair<std::string, std::string>& func);
+	Variant callScript(const CompiledScript&) const;
+	void lookup(const std::string& name, size_t slot, int64_t* value, int64_t* delta) const;
+	bool isDone(const CompiledDoneNode&) const;
 
 	float calculateReward(unsigned player) const;
 	bool calculateDone() const;
@@ -205,6 +283,8 @@ private:
 	std::string m_base;
 
 	std::vector<std::pair<std::string, std::string>> m_scripts;
+	// Contexts this scenario's scripts were last loaded into, by scope
+	std::unordered_map<std::string, std::weak_ptr<ScriptContext>> m_scriptContexts;
 
 	std::unordered_map<std::string, RewardSpec> m_rewardVars[MAX_PLAYERS];
 	RewardSpec m_rewardTime[MAX_PLAYERS];
@@ -217,6 +297,14 @@ private:
 
 	std::map<int, std::set<int>> m_actions;
 
+	std::vector<CompiledReward> m_compiledRewards[MAX_PLAYERS];
+	CompiledDoneNode m_compiledDone;
+	CompiledScript m_compiledRewardFunc[MAX_PLAYERS];
+	CompiledScript m_compiledDoneFunc;
+	bool m_compiled = false;
+	uint64_t m_compiledGeneration = 0;
+	uint64_t m_compiledScriptGeneration = 0;
+
 	float m_reward[MAX_PLAYERS] = { 0 };
 	float m_totalReward[MAX_PLAYERS] = { 0 };
 	bool m_done = false;
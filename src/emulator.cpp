@@ -1,11 +1,19 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
 #ifndef _WIN32
 #include <dlfcn.h>
+#include <unistd.h>
 #endif
 #include <fstream>
 #include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "coreinfo.h"
@@ -23,8 +31,6 @@ using namespace std;
 
 namespace Retro {
 
-static Emulator* s_loadedEmulator = nullptr;
-
 static map<string, const char*> s_envVariables = {
 	{ "genesis_plus_gx_bram", "per game" },
 	{ "genesis_plus_gx_render", "single field" },
@@ -63,30 +69,155 @@ static map<string, const char*> s_envVariables = {
 	{ "melonds_screen_layout", "Bottom Only" },
 };
 
-static void (*retro_init)(void);
-static void (*retro_deinit)(void);
-static unsigned (*retro_api_version)(void);
-static void (*retro_get_system_info)(struct retro_system_info* info);
-static void (*retro_get_system_av_info)(struct retro_system_av_info* info);
-static void (*retro_reset)(void);
-static void (*retro_run)(void);
-static size_t (*retro_serialize_size)(void);
-static bool (*retro_serialize)(void* data, size_t size);
-static bool (*retro_unserialize)(const void* data, size_t size);
-static bool (*retro_load_game)(const struct retro_game_info* game);
-static void (*retro_unload_game)(void);
-static void* (*retro_get_memory_data)(unsigned id);
-static size_t (*retro_get_memory_size)(unsigned id);
-static void (*retro_cheat_reset)(void);
-static void (*retro_cheat_set)(unsigned index, bool enabled, const char* code);
-static void (*retro_set_environment)(retro_environment_t);
-static void (*retro_set_video_refresh)(retro_video_refresh_t);
-static void (*retro_set_audio_sample)(retro_audio_sample_t);
-static void (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
-static void (*retro_set_input_poll)(retro_input_poll_t);
-static void (*retro_set_input_state)(retro_input_state_t);
-
-Emulator::Emulator() {
+struct Emulator::CoreSymbols {
+	void (*retro_init)(void);
+	void (*retro_deinit)(void);
+	unsigned (*retro_api_version)(void);
+	void (*retro_get_system_info)(struct retro_system_info* info);
+	void (*retro_get_system_av_info)(struct retro_system_av_info* info);
+	void (*retro_reset)(void);
+	void (*retro_run)(void);
+	size_t (*retro_serialize_size)(void);
+	bool (*retro_serialize)(void* data, size_t size);
+	bool (*retro_unserialize)(const void* data, size_t size);
+	bool (*retro_load_game)(const struct retro_game_info* game);
+	void (*retro_unload_game)(void);
+	void* (*retro_get_memory_data)(unsigned id);
+	size_t (*retro_get_memory_size)(unsigned id);
+	void (*retro_cheat_reset)(void);
+	void (*retro_cheat_set)(unsigned index, bool enabled, const char* code);
+	void (*retro_set_environment)(retro_environment_t);
+	void (*retro_set_video_refresh)(retro_video_refresh_t);
+	void (*retro_set_audio_sample)(retro_audio_sample_t);
+	void (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
+	void (*retro_set_input_poll)(retro_input_poll_t);
+	void (*retro_set_input_state)(retro_input_state_t);
+};
+
+// libretro callbacks carry no user pointer, so every live emulator is given a
+// slot with its own set of trampolines that forward to the owning instance
+static mutex s_slotsMutex;
+static Emulator* s_emulators[MAX_EMULATORS] = {};
+
+// Core libraries currently mapped directly from the core path. Further
+// instances of the same core get a private copy so that globals aren't shared
+static set<string> s_sharedCores;
+
+template<size_t N>
+struct CoreCallbacks {
+	static bool environment(unsigned cmd, void* data) {
+		return s_emulators[N]->cbEnvironment(cmd, data);
+	}
+	static void videoRefresh(const void* data, unsigned width, unsigned height, size_t pitch) {
+		s_emulators[N]->cbVideoRefresh(data, width, height, pitch);
+	}
+	static void audioSample(int16_t left, int16_t right) {
+		s_emulators[N]->cbAudioSample(left, right);
+	}
+	static size_t audioSampleBatch(const int16_t* data, size_t frames) {
+		return s_emulators[N]->cbAudioSampleBatch(data, frames);
+	}
+	static void inputPoll() {
+		s_emulators[N]->cbInputPoll();
+	}
+	static int16_t inputState(unsigned port, unsigned device, unsigned index, unsigned id) {
+		return s_emulators[N]->cbInputState(port, device, index, id);
+	}
+#ifdef ENABLE_HW_RENDER
+	static uintptr_t getCurrentFramebuffer() {
+		return s_emulators[N]->cbGetCurrentFramebuffer();
+	}
+	static retro_proc_address_t getProcAddress(const char* sym) {
+		return s_emulators[N]->cbGetProcAddress(sym);
+	}
+#endif
+};
+
+struct CallbackTable {
+	retro_environment_t environment;
+	retro_video_refresh_t videoRefresh;
+	retro_audio_sample_t audioSample;
+	retro_audio_sample_batch_t audioSampleBatch;
+	retro_input_poll_t inputPoll;
+	retro_input_state_t inputState;
+#ifdef ENABLE_HW_RENDER
+	retro_hw_get_current_framebuffer_t getCurrentFramebuffer;
+	retro_hw_get_proc_address_t getProcAddress;
+#endif
+};
+
+template<size_t... N>
+static array<CallbackTable, sizeof...(N)> makeCallbackTables(index_sequence<N...>) {
+	return { {
+		{
+			CoreCallbacks<N>::environment,
+			CoreCallbacks<N>::videoRefresh,
+			CoreCallbacks<N>::audioSample,
+			CoreCallbacks<N>::audioSampleBatch,
+			CoreCallbacks<N>::inputPoll,
+			CoreCallbacks<N>::inputState,
+#ifdef ENABLE_HW_RENDER
+			CoreCallbacks<N>::getCurrentFramebuffer,
+			CoreCallbacks<N>::getProcAddress,
+#endif
+		}...
+	} };
+}
+
+static const array<CallbackTable, MAX_EMULATORS> s_callbacks = makeCallbackTables(make_index_sequence<MAX_EMULATORS>());
+
+static int acquireSlot(Emulator* emulator) {
+	lock_guard<mutex> lock(s_slotsMutex);
+	for (int i = 0; i < MAX_EMULATORS; ++i) {
+		if (!s_emulators[i]) {
+			s_emulators[i] = emulator;
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void releaseSlot(int slot) {
+	lock_guard<mutex> lock(s_slotsMutex);
+	s_emulators[slot] = nullptr;
+}
+
+// The dynamic loader hands back the already mapped library when the same file
+// is opened twice, so a second instance needs a file of its own
+static string copyCore(const string& corePath) {
+#ifdef _WIN32
+	char dir[MAX_PATH];
+	char path[MAX_PATH];
+	if (!GetTempPathA(MAX_PATH, dir) || !GetTempFileNameA(dir, "ret", 0, path)) {
+		return {};
+	}
+	if (!CopyFileA(corePath.c_str(), path, FALSE)) {
+		DeleteFileA(path);
+		return {};
+	}
+	return path;
+#else
+	const char* tmpdir = getenv("TMPDIR");
+	string path = string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/stable-retro-core-XXXXXX";
+	int fd = mkstemp(&path[0]);
+	if (fd < 0) {
+		return {};
+	}
+	close(fd);
+	ifstream in(corePath, ios::binary);
+	ofstream out(path, ios::binary | ios::trunc);
+	out << in.rdbuf();
+	out.close();
+	if (in.fail() || out.fail()) {
+		remove(path.c_str());
+		return {};
+	}
+	return path;
+#endif
+}
+
+Emulator::Emulator()
+	: m_symbols(new CoreSymbols{}) {
 }
 
 Emulator::~Emulator() {
@@ -107,7 +238,13 @@ Emulator::~Emulator() {
 }
 
 bool Emulator::isLoaded() {
-	return s_loadedEmulator;
+	lock_guard<mutex> lock(s_slotsMutex);
+	for (const Emulator* emulator : s_emulators) {
+		if (emulator) {
+			return true;
+		}
+	}
+	return false;
 }
 
 bool Emulator::loadRom(const string& romPath) {
@@ -161,7 +298,7 @@ bool Emulator::loadRom(const string& romPath) {
 	in.close();
 
 	m_rotation = 0;
-	auto res = retro_load_game(&m_gameInfo);
+	auto res = m_symbols->retro_load_game(&m_gameInfo);
 	if (!res) {
 		m_romData.clear();
 		return false;
@@ -178,20 +315,24 @@ bool Emulator::loadRom(const string& romPath) {
 	}
 #endif
 
-	retro_get_system_av_info(&m_avInfo);
+	m_symbols->retro_get_system_av_info(&m_avInfo);
 	fixScreenSize(romPath);
+	m_audioWritten = 0;
+	m_audioFrameStart = 0;
+	resizeAudio();
 
 	// For some cores (notably some N64 cores), the initial AV info can be wrong.
 	// Prefer the per-frame dimensions passed to cbVideoRefresh.
 	{
 		retro_system_info systemInfo;
-		retro_get_system_info(&systemInfo);
+		m_symbols->retro_get_system_info(&systemInfo);
 		m_updateGeometryFromVideoRefresh =
 			!strcmp(systemInfo.library_name, "ParaLLEl N64") ||
 			!strcmp(systemInfo.library_name, "Mupen64Plus") ||
 			!strcmp(systemInfo.library_name, "Mupen64Plus-Next") ||
 			!strcmp(systemInfo.library_name, "Beetle Saturn") ||
 			!strcmp(systemInfo.library_name, "Mednafen Saturn");
+		m_resetBeforeUnserialize = !strcmp(systemInfo.library_name, "Stella");
 	}
 
 	if (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE) {
@@ -204,41 +345,20 @@ bool Emulator::loadRom(const string& romPath) {
 }
 
 void Emulator::run() {
-	assert(s_loadedEmulator == this);
-	m_audioData.clear();
-	retro_run();
+	assert(m_coreHandle);
+	m_audioFrameStart = m_audioWritten;
+	m_symbols->retro_run();
 	if (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE) {
 		m_needsInitFrame = false;
 	}
 }
 
 void Emulator::reset() {
-	assert(s_loadedEmulator == this);
+	assert(m_coreHandle);
 
 	memset(m_buttonMask, 0, sizeof(m_buttonMask));
 
-	retro_system_info systemInfo;
-	retro_get_system_info(&systemInfo);
-	if (!strcmp(systemInfo.library_name, "Stella")) {
-		// Stella does not properly clear everything when reseting or loading a savestate
-		string romPath = m_romPath;
-
-#ifdef _WIN32
-		FreeLibrary(m_coreHandle);
-#else
-		dlclose(m_coreHandle);
-#endif
-		m_coreHandle = nullptr;
-		s_loadedEmulator = nullptr;
-		m_romLoaded = false;
-		loadRom(m_romPath);
-		if (m_addressSpace) {
-			m_addressSpace->reset();
-			m_addressSpace->addBlock(Retro::ramBase(m_core), retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM), retro_get_memory_data(RETRO_MEMORY_SYSTEM_RAM));
-		}
-	}
-
-	retro_reset();
+	m_symbols->retro_reset();
 
 	if (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE) {
 		m_needsInitFrame = true;
@@ -252,21 +372,15 @@ void Emulator::unloadCore() {
 	if (m_romLoaded) {
 		unloadRom();
 	}
-	retro_deinit();
-#ifdef _WIN32
-	FreeLibrary(m_coreHandle);
-#else
-	dlclose(m_coreHandle);
-#endif
-	m_coreHandle = nullptr;
-	s_loadedEmulator = nullptr;
+	m_symbols->retro_deinit();
+	closeCore();
 }
 
 void Emulator::unloadRom() {
 	if (!m_romLoaded) {
 		return;
 	}
-	retro_unload_game();
+	m_symbols->retro_unload_game();
 	m_romLoaded = false;
 	m_romPath.clear();
 	m_romData.clear();
@@ -276,35 +390,33 @@ void Emulator::unloadRom() {
 }
 
 bool Emulator::serialize(void* data, size_t size) {
-	assert(s_loadedEmulator == this);
+	assert(m_coreHandle);
 	ensureInitializedForSerialization();
-	return retro_serialize(data, size);
+	return m_symbols->retro_serialize(data, size);
 }
 
 bool Emulator::unserialize(const void* data, size_t size) {
-	assert(s_loadedEmulator == this);
+	assert(m_coreHandle);
 	try {
-		retro_system_info systemInfo;
-		retro_get_system_info(&systemInfo);
-		if (!strcmp(systemInfo.library_name, "Stella")) {
+		if (m_resetBeforeUnserialize) {
+			// Stella's savestates leave out state that a reset reinitializes
 			reset();
 		}
 
-
-			ensureInitializedForSerialization();
-			bool ok = retro_unserialize(data, size);
-			if (ok && (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE)) {
-				m_needsInitFrame = false;
-			}
-			return ok;
+		ensureInitializedForSerialization();
+		bool ok = m_symbols->retro_unserialize(data, size);
+		if (ok && (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE)) {
+			m_needsInitFrame = false;
+		}
+		return ok;
 	} catch (...) {
 		return false;
 	}
 }
 
 size_t Emulator::serializeSize() {
-	assert(s_loadedEmulator == this);
-	return retro_serialize_size();
+	assert(m_coreHandle);
+	return m_symbols->retro_serialize_size();
 }
 
 void Emulator::ensureInitializedForSerialization() {
@@ -315,63 +427,89 @@ void Emulator::ensureInitializedForSerialization() {
 }
 
 void Emulator::clearCheats() {
-	assert(s_loadedEmulator == this);
-	retro_cheat_reset();
+	assert(m_coreHandle);
+	m_symbols->retro_cheat_reset();
 }
 
 void Emulator::setCheat(unsigned index, bool enabled, const char* code) {
-	assert(s_loadedEmulator == this);
-	retro_cheat_set(index, enabled, code);
+	assert(m_coreHandle);
+	m_symbols->retro_cheat_set(index, enabled, code);
 }
 
 bool Emulator::loadCore(const string& corePath) {
-	if (s_loadedEmulator) {
+	m_slot = acquireSlot(this);
+	if (m_slot < 0) {
 		return false;
 	}
 
+	string libPath = corePath;
+	{
+		lock_guard<mutex> lock(s_slotsMutex);
+		if (s_sharedCores.insert(corePath).second) {
+			m_sharedCorePath = corePath;
+		}
+	}
+	if (m_sharedCorePath.empty()) {
+		libPath = copyCore(corePath);
+		if (libPath.empty()) {
+			closeCore();
+			return false;
+		}
+	}
+
 #ifdef _WIN32
-	m_coreHandle = LoadLibrary(corePath.c_str());
+	m_coreHandle = LoadLibrary(libPath.c_str());
+	if (libPath != corePath) {
+		m_coreCopyPath = libPath;
+	}
 #else
-	m_coreHandle = dlopen(corePath.c_str(), RTLD_LAZY);
+	m_coreHandle = dlopen(libPath.c_str(), RTLD_LAZY);
+	if (libPath != corePath) {
+		// The mapping stays valid after the file is gone
+		remove(libPath.c_str());
+	}
 #endif
 	if (!m_coreHandle) {
+		closeCore();
 		return false;
 	}
 
-	retro_init = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_init"));
-	retro_deinit = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_deinit"));
-	retro_api_version = reinterpret_cast<unsigned int (*)()>(GETSYM(m_coreHandle, "retro_api_version"));
-	retro_get_system_info = reinterpret_cast<void (*)(struct retro_system_info*)>(GETSYM(m_coreHandle, "retro_get_system_info"));
-	retro_get_system_av_info = reinterpret_cast<void (*)(struct retro_system_av_info*)>(GETSYM(m_coreHandle, "retro_get_system_av_info"));
-	retro_reset = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_reset"));
-	retro_run = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_run"));
-	retro_serialize_size = reinterpret_cast<size_t (*)()>(GETSYM(m_coreHandle, "retro_serialize_size"));
-	retro_serialize = reinterpret_cast<bool (*)(void*, size_t)>(GETSYM(m_coreHandle, "retro_serialize"));
-	retro_unserialize = reinterpret_cast<bool (*)(const void*, size_t)>(GETSYM(m_coreHandle, "retro_unserialize"));
-	retro_load_game = reinterpret_cast<bool (*)(const struct retro_game_info*)>(GETSYM(m_coreHandle, "retro_load_game"));
-	retro_unload_game = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_unload_game"));
-	retro_get_memory_data = reinterpret_cast<void* (*) (unsigned int)>(GETSYM(m_coreHandle, "retro_get_memory_data"));
-	retro_get_memory_size = reinterpret_cast<size_t (*)(unsigned int)>(GETSYM(m_coreHandle, "retro_get_memory_size"));
-	retro_cheat_reset = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_cheat_reset"));
-	retro_cheat_set = reinterpret_cast<void (*)(unsigned int, bool, const char*)>(GETSYM(m_coreHandle, "retro_cheat_set"));
-	retro_set_environment = reinterpret_cast<void (*)(retro_environment_t)>(GETSYM(m_coreHandle, "retro_set_environment"));
-	retro_set_video_refresh = reinterpret_cast<void (*)(retro_video_refresh_t)>(GETSYM(m_coreHandle, "retro_set_video_refresh"));
-	retro_set_audio_sample = reinterpret_cast<void (*)(retro_audio_sample_t)>(GETSYM(m_coreHandle, "retro_set_audio_sample"));
-	retro_set_audio_sample_batch = reinterpret_cast<void (*)(retro_audio_sample_batch_t)>(GETSYM(m_coreHandle, "retro_set_audio_sample_batch"));
-	retro_set_input_poll = reinterpret_cast<void (*)(retro_input_poll_t)>(GETSYM(m_coreHandle, "retro_set_input_poll"));
-	retro_set_input_state = reinterpret_cast<void (*)(short (*)(unsigned int, unsigned int, unsigned int, unsigned int))>(GETSYM(m_coreHandle, "retro_set_input_state"));
+	m_symbols->retro_init = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_init"));
+	m_symbols->retro_deinit = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_deinit"));
+	m_symbols->retro_api_version = reinterpret_cast<unsigned int (*)()>(GETSYM(m_coreHandle, "retro_api_version"));
+	m_symbols->retro_get_system_info = reinterpret_cast<void (*)(struct retro_system_info*)>(GETSYM(m_coreHandle, "retro_get_system_info"));
+	m_symbols->retro_get_system_av_info = reinterpret_cast<void (*)(struct retro_system_av_info*)>(GETSYM(m_coreHandle, "retro_get_system_av_info"));
+	m_symbols->retro_reset = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_reset"));
+	m_symbols->retro_run = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_run"));
+	m_symbols->retro_serialize_size = reinterpret_cast<size_t (*)()>(GETSYM(m_coreHandle, "retro_serialize_size"));
+	m_symbols->retro_serialize = reinterpret_cast<bool (*)(void*, size_t)>(GETSYM(m_coreHandle, "retro_serialize"));
+	m_symbols->retro_unserialize = reinterpret_cast<bool (*)(const void*, size_t)>(GETSYM(m_coreHandle, "retro_unserialize"));
+	m_symbols->retro_load_game = reinterpret_cast<bool (*)(const struct retro_game_info*)>(GETSYM(m_coreHandle, "retro_load_game"));
+	m_symbols->retro_unload_game = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_unload_game"));
+	m_symbols->retro_get_memory_data = reinterpret_cast<void* (*) (unsigned int)>(GETSYM(m_coreHandle, "retro_get_memory_data"));
+	m_symbols->retro_get_memory_size = reinterpret_cast<size_t (*)(unsigned int)>(GETSYM(m_coreHandle, "retro_get_memory_size"));
+	m_symbols->retro_cheat_reset = reinterpret_cast<void (*)()>(GETSYM(m_coreHandle, "retro_cheat_reset"));
+	m_symbols->retro_cheat_set = reinterpret_cast<void (*)(unsigned int, bool, const char*)>(GETSYM(m_coreHandle, "retro_cheat_set"));
+	m_symbols->retro_set_environment = reinterpret_cast<void (*)(retro_environment_t)>(GETSYM(m_coreHandle, "retro_set_environment"));
+	m_symbols->retro_set_video_refresh = reinterpret_cast<void (*)(retro_video_refresh_t)>(GETSYM(m_coreHandle, "retro_set_video_refresh"));
+	m_symbols->retro_set_audio_sample = reinterpret_cast<void (*)(retro_audio_sample_t)>(GETSYM(m_coreHandle, "retro_set_audio_sample"));
+	m_symbols->retro_set_audio_sample_batch = reinterpret_cast<void (*)(retro_audio_sample_batch_t)>(GETSYM(m_coreHandle, "retro_set_audio_sample_batch"));
+	m_symbols->retro_set_input_poll = reinterpret_cast<void (*)(retro_input_poll_t)>(GETSYM(m_coreHandle, "retro_set_input_poll"));
+	m_symbols->retro_set_input_state = reinterpret_cast<void (*)(short (*)(unsigned int, unsigned int, unsigned int, unsigned int))>(GETSYM(m_coreHandle, "retro_set_input_state"));
 
 	// The default according to the docs
 	m_imgDepth = 15;
-	s_loadedEmulator = this;
-
-	retro_set_environment(cbEnvironment);
-	retro_set_video_refresh(cbVideoRefresh);
-	retro_set_audio_sample(cbAudioSample);
-	retro_set_audio_sample_batch(cbAudioSampleBatch);
-	retro_set_input_poll(cbInputPoll);
-	retro_set_input_state(cbInputState);
-	retro_init();
+	m_imgWidth = 0;
+	m_imgHeight = 0;
+
+	const CallbackTable& callbacks = s_callbacks[m_slot];
+	m_symbols->retro_set_environment(callbacks.environment);
+	m_symbols->retro_set_video_refresh(callbacks.videoRefresh);
+	m_symbols->retro_set_audio_sample(callbacks.audioSample);
+	m_symbols->retro_set_audio_sample_batch(callbacks.audioSampleBatch);
+	m_symbols->retro_set_input_poll(callbacks.inputPoll);
+	m_symbols->retro_set_input_state(callbacks.inputState);
+	m_symbols->retro_init();
 
 		if (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE) {
 			m_needsInitFrame = true;
@@ -380,9 +518,36 @@ bool Emulator::loadCore(const string& corePath) {
 	return true;
 }
 
+void Emulator::closeCore() {
+	if (m_coreHandle) {
+#ifdef _WIN32
+		FreeLibrary(m_coreHandle);
+#else
+		dlclose(m_coreHandle);
+#endif
+		m_coreHandle = nullptr;
+	}
+#ifdef _WIN32
+	if (!m_coreCopyPath.empty()) {
+		DeleteFileA(m_coreCopyPath.c_str());
+		m_coreCopyPath.clear();
+	}
+#endif
+	*m_symbols = {};
+	if (m_slot >= 0) {
+		releaseSlot(m_slot);
+		m_slot = -1;
+	}
+	if (!m_sharedCorePath.empty()) {
+		lock_guard<mutex> lock(s_slotsMutex);
+		s_sharedCores.erase(m_sharedCorePath);
+		m_sharedCorePath.clear();
+	}
+}
+
 void Emulator::fixScreenSize(const string& romName) {
 	retro_system_info systemInfo;
-	retro_get_system_info(&systemInfo);
+	m_symbols->retro_get_system_info(&systemInfo);
 	if (!strcmp(systemInfo.library_name, "Genesis Plus GX")) {
 		switch (romName.back()) {
 		case 'd': // Mega Drive
@@ -466,57 +631,62 @@ static void cbLog(enum retro_log_level level, const char *fmt, ...) {
 }
 
 bool Emulator::cbEnvironment(unsigned cmd, void* data) {
-	assert(s_loadedEmulator);
 
 	switch (cmd) {
 	case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
 		switch (*reinterpret_cast<retro_pixel_format*>(data)) {
 		case RETRO_PIXEL_FORMAT_XRGB8888:
-			s_loadedEmulator->m_imgDepth = 32;
+			m_imgDepth = 32;
 			break;
 		case RETRO_PIXEL_FORMAT_RGB565:
-			s_loadedEmulator->m_imgDepth = 16;
+			m_imgDepth = 16;
 			break;
 		case RETRO_PIXEL_FORMAT_0RGB1555:
-			s_loadedEmulator->m_imgDepth = 15;
+			m_imgDepth = 15;
 			break;
 		default:
-			s_loadedEmulator->m_imgDepth = 0;
+			m_imgDepth = 0;
 			break;
 		}
 		return true;
 	case RETRO_ENVIRONMENT_GET_VARIABLE: {
 		struct retro_variable* var = reinterpret_cast<struct retro_variable*>(data);
-		if (s_envVariables.count(string(var->key))) {
-			var->value = s_envVariables[string(var->key)];
+		auto value = s_envVariables.find(string(var->key));
+		if (value != s_envVariables.end()) {
+			var->value = value->second;
 			return true;
 		}
 		return false;
 	}
 	case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
-		if (!s_loadedEmulator->m_corePath) {
-			s_loadedEmulator->m_corePath = strdup(corePath().c_str());
+		if (!m_corePath) {
+			m_corePath = strdup(corePath().c_str());
+		}
+		*reinterpret_cast<const char**>(data) = m_corePath;
+		return true;
+	case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+		if (data) {
+			*reinterpret_cast<int*>(data) = (m_videoEnabled ? 1 : 0) | (m_audioEnabled ? 2 : 0);
 		}
-		*reinterpret_cast<const char**>(data) = s_loadedEmulator->m_corePath;
 		return true;
 	case RETRO_ENVIRONMENT_GET_CAN_DUPE:
 		*reinterpret_cast<bool*>(data) = true;
 		return true;
 	case RETRO_ENVIRONMENT_SET_MEMORY_MAPS:
-		s_loadedEmulator->m_map.clear();
+		m_map.clear();
 		for (size_t i = 0; i < static_cast<const retro_memory_map*>(data)->num_descriptors; ++i) {
-			s_loadedEmulator->m_map.emplace_back(static_cast<const retro_memory_map*>(data)->descriptors[i]);
+			m_map.emplace_back(static_cast<const retro_memory_map*>(data)->descriptors[i]);
 		}
-		s_loadedEmulator->reconfigureAddressSpace();
+		reconfigureAddressSpace();
 		return true;
 	case RETRO_ENVIRONMENT_SET_ROTATION: {
 		const unsigned* rotation = reinterpret_cast<const unsigned*>(data);
 		if (rotation) {
 			unsigned raw = *rotation % 4;
-			if (s_loadedEmulator->m_core == "FBNeo") {
+			if (m_core == "FBNeo") {
 				raw = (4 - raw) % 4;
 			}
-			s_loadedEmulator->m_rotation = static_cast<int>(raw);
+			m_rotation = static_cast<int>(raw);
 		}
 		return true;
 	}
@@ -528,21 +698,21 @@ bool Emulator::cbEnvironment(unsigned cmd, void* data) {
 		return true;
 	}
 	case RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS: {
-		s_loadedEmulator->m_serializationQuirks = *reinterpret_cast<const uint64_t*>(data);
-		if (s_loadedEmulator->m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE) {
-			s_loadedEmulator->m_needsInitFrame = true;
+		m_serializationQuirks = *reinterpret_cast<const uint64_t*>(data);
+		if (m_serializationQuirks & RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE) {
+			m_needsInitFrame = true;
 		}
 		return true;
 	}
 #ifdef ENABLE_HW_RENDER
 	case RETRO_ENVIRONMENT_SET_HW_RENDER: {
 		auto* cb = static_cast<retro_hw_render_callback*>(data);
-		if (!s_loadedEmulator->m_hwRender.init(*cb)) {
+		if (!m_hwRender.init(*cb)) {
 			return false;
 		}
 		// Provide frontend callbacks to the core
-		cb->get_current_framebuffer = cbGetCurrentFramebuffer;
-		cb->get_proc_address = cbGetProcAddress;
+		cb->get_current_framebuffer = s_callbacks[m_slot].getCurrentFramebuffer;
+		cb->get_proc_address = s_callbacks[m_slot].getProcAddress;
 		return true;
 	}
 #endif
@@ -553,67 +723,151 @@ bool Emulator::cbEnvironment(unsigned cmd, void* data) {
 }
 
 void Emulator::cbVideoRefresh(const void* data, unsigned width, unsigned height, size_t pitch) {
-	assert(s_loadedEmulator);
-	if (s_loadedEmulator->m_updateGeometryFromVideoRefresh && width && height) {
-		s_loadedEmulator->m_avInfo.geometry.base_width = width;
-		s_loadedEmulator->m_avInfo.geometry.base_height = height;
+	if (m_updateGeometryFromVideoRefresh && width && height) {
+		m_avInfo.geometry.base_width = width;
+		m_avInfo.geometry.base_height = height;
 
-		s_loadedEmulator->m_avInfo.geometry.aspect_ratio =
+		m_avInfo.geometry.aspect_ratio =
 			static_cast<float>(width) / static_cast<float>(height);
 
-		if (s_loadedEmulator->m_avInfo.geometry.max_width < width) {
-			s_loadedEmulator->m_avInfo.geometry.max_width = width;
+		if (m_avInfo.geometry.max_width < width) {
+			m_avInfo.geometry.max_width = width;
 		}
-		if (s_loadedEmulator->m_avInfo.geometry.max_height < height) {
-			s_loadedEmulator->m_avInfo.geometry.max_height = height;
+		if (m_avInfo.geometry.max_height < height) {
+			m_avInfo.geometry.max_height = height;
 		}
 	}
 	// Hardware rendering: the core is signaling that the framebuffer lives on the GPU.
 	if (data == RETRO_HW_FRAME_BUFFER_VALID) {
 #ifdef ENABLE_HW_RENDER
-		if (s_loadedEmulator->m_hwRender.isEnabled()) {
+		if (m_hwRender.isEnabled() && !m_videoEnabled) {
+			// Nobody looks at this frame, so leave it on the GPU
+			m_hwRender.skipReadback();
+			return;
+		}
+		if (m_hwRender.isEnabled()) {
 			// Read pixels from GPU framebuffer to CPU
-			const void* pixels = s_loadedEmulator->m_hwRender.readbackFramebuffer(width, height);
+			const void* pixels = m_hwRender.readbackFramebuffer(width, height);
 			if (pixels) {
-				s_loadedEmulator->m_imgData = pixels;
-				s_loadedEmulator->m_imgPitch = s_loadedEmulator->m_hwRender.getReadbackPitch();
-				s_loadedEmulator->m_imgDepth = 32;  // RGBA8888
+				m_imgData = pixels;
+				m_imgPitch = m_hwRender.getReadbackPitch();
+				m_imgDepth = m_hwRender.isReadbackGray() ? 8 : 32;  // RGBA8888
+				bool scaled = m_hwRender.getReadbackWidth() != width || m_hwRender.getReadbackHeight() != height;
+				m_imgWidth = scaled ? m_hwRender.getReadbackWidth() : 0;
+				m_imgHeight = scaled ? m_hwRender.getReadbackHeight() : 0;
 				return;
 			}
 		}
 #endif
 		// HW render not enabled or failed - keep m_imgData null
-		s_loadedEmulator->m_imgData = nullptr;
-		s_loadedEmulator->m_imgPitch = 0;
+		m_imgData = nullptr;
+		m_imgPitch = 0;
 		return;
 	}
 	if (data) {
-		s_loadedEmulator->m_imgData = data;
+		m_imgData = data;
 	}
 	if (pitch) {
-		s_loadedEmulator->m_imgPitch = pitch;
+		m_imgPitch = pitch;
 	}
 }
 
 void Emulator::cbAudioSample(int16_t left, int16_t right) {
-	assert(s_loadedEmulator);
-	s_loadedEmulator->m_audioData.push_back(left);
-	s_loadedEmulator->m_audioData.push_back(right);
+	int16_t sample[2] = { left, right };
+	pushAudio(sample, 1);
 }
 
 size_t Emulator::cbAudioSampleBatch(const int16_t* data, size_t frames) {
-	assert(s_loadedEmulator);
-	s_loadedEmulator->m_audioData.insert(s_loadedEmulator->m_audioData.end(), data, &data[frames * 2]);
+	pushAudio(data, frames);
 	return frames;
 }
 
+int Emulator::getAudioSamples() const {
+	return min<uint64_t>(m_audioWritten - m_audioFrameStart, m_audioCapacity);
+}
+
+size_t Emulator::getAudioHistorySamples() const {
+	return min<uint64_t>(m_audioWritten, m_audioCapacity);
+}
+
+const int16_t* Emulator::getAudioHistory(size_t samples) const {
+	if (!m_audioCapacity) {
+		return nullptr;
+	}
+	samples = min(samples, getAudioHistorySamples());
+	return &m_audioRing[(m_audioWritten - samples) % m_audioCapacity * 2];
+}
+
+void Emulator::setAudioHistory(size_t frames) {
+	m_audioHistory = max<size_t>(frames, 1);
+	if (m_romLoaded) {
+		resizeAudio();
+	}
+}
+
+void Emulator::setAudioEnabled(bool enabled) {
+	m_audioEnabled = enabled;
+	if (m_romLoaded) {
+		resizeAudio();
+	}
+}
+
+void Emulator::resizeAudio() {
+	if (!m_audioEnabled) {
+		m_audioRing = {};
+		m_audioCapacity = 0;
+		m_audioWritten = 0;
+		m_audioFrameStart = 0;
+		return;
+	}
+	// Cores don't produce the same number of samples every frame, so leave
+	// twice the nominal amount of room
+	size_t perFrame = 1024;
+	if (m_avInfo.timing.fps > 0 && m_avInfo.timing.sample_rate > 0) {
+		perFrame = max<size_t>(ceil(m_avInfo.timing.sample_rate / m_avInfo.timing.fps) * 2, perFrame);
+	}
+	size_t capacity = perFrame * m_audioHistory;
+
+	// Carry over as much history as fits
+	size_t kept = min<size_t>(getAudioHistorySamples(), capacity);
+	vector<int16_t> ring(capacity * 4);
+	if (kept) {
+		memcpy(ring.data(), getAudioHistory(kept), kept * 4);
+		memcpy(&ring[capacity * 2], ring.data(), kept * 4);
+	}
+	size_t pending = min<uint64_t>(m_audioWritten - m_audioFrameStart, kept);
+	m_audioRing = move(ring);
+	m_audioCapacity = capacity;
+	m_audioWritten = kept;
+	m_audioFrameStart = kept - pending;
+}
+
+void Emulator::pushAudio(const int16_t* data, size_t frames) {
+	if (!m_audioEnabled) {
+		return;
+	}
+	// The ring keeps its size once allocated so that pointers into it stay
+	// valid; a batch larger than the whole ring only keeps its newest samples
+	if (frames > m_audioCapacity) {
+		data += (frames - m_audioCapacity) * 2;
+		frames = m_audioCapacity;
+	}
+	while (frames) {
+		size_t pos = m_audioWritten % m_audioCapacity;
+		size_t chunk = min(frames, m_audioCapacity - pos);
+		memcpy(&m_audioRing[pos * 2], data, chunk * 4);
+		memcpy(&m_audioRing[(pos + m_audioCapacity) * 2], data, chunk * 4);
+		m_audioWritten += chunk;
+		data += chunk * 2;
+		frames -= chunk;
+	}
+}
+
 void Emulator::cbInputPoll() {
-	assert(s_loadedEmulator);
 }
 
 int16_t Emulator::cbInputState(unsigned port, unsigned, unsigned, unsigned id) {
-	assert(s_loadedEmulator);
-	return s_loadedEmulator->m_buttonMask[port][id];
+	return m_buttonMask[port][id];
 }
 
 void Emulator::configureData(GameData* data) {
@@ -621,8 +875,8 @@ void Emulator::configureData(GameData* data) {
 	m_addressSpace->reset();
 	Retro::configureData(data, m_core);
 	reconfigureAddressSpace();
-	if (m_addressSpace->blocks().empty() && retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM)) {
-		m_addressSpace->addBlock(Retro::ramBase(m_core), retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM), retro_get_memory_data(RETRO_MEMORY_SYSTEM_RAM));
+	if (m_addressSpace->blocks().empty() && m_symbols->retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM)) {
+		m_addressSpace->addBlock(Retro::ramBase(m_core), m_symbols->retro_get_memory_size(RETRO_MEMORY_SYSTEM_RAM), m_symbols->retro_get_memory_data(RETRO_MEMORY_SYSTEM_RAM));
 	}
 }
 
@@ -642,15 +896,29 @@ bool Emulator::isHWRenderEnabled() const {
 #endif
 }
 
+#ifdef ENABLE_HW_RENDER
+void Emulator::setAsyncReadback(bool async) {
+	m_hwRender.setAsyncReadback(async);
+}
+
+void Emulator::setReadbackScale(unsigned width, unsigned height, bool gray) {
+	m_hwRender.setReadbackScale(width, height, gray);
+}
+#else
+void Emulator::setAsyncReadback(bool) {
+}
+
+void Emulator::setReadbackScale(unsigned, unsigned, bool) {
+}
+#endif
+
 #ifdef ENABLE_HW_RENDER
 uintptr_t Emulator::cbGetCurrentFramebuffer() {
-	assert(s_loadedEmulator);
-	return s_loadedEmulator->m_hwRender.getCurrentFramebuffer();
+	return m_hwRender.getCurrentFramebuffer();
 }
 
 retro_proc_address_t Emulator::cbGetProcAddress(const char* sym) {
-	assert(s_loadedEmulator);
-	return s_loadedEmulator->m_hwRender.getProcAddress(sym);
+	return m_hwRender.getProcAddress(sym);
 }
 #endif
 }
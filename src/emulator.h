@@ -4,6 +4,7 @@
 #include "memory.h"
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstring>
@@ -23,11 +24,15 @@
 #ifndef RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE
 #define RETRO_SERIALIZATION_QUIRK_MUST_INITIALIZE (1 << 1)
 #endif
+#ifndef RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE
+#define RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (47 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+#endif
 
 namespace Retro {
 
 const int N_BUTTONS = 16;
 const int MAX_PLAYERS = 2;
+const int MAX_EMULATORS = 64;
 
 class GameData;
 class Emulator {
@@ -44,16 +49,35 @@ public:
 	void reset();
 	AddressSpace* getAddressSpace();
 	const void* getImageData() { return m_imgData; }
-	int getImageHeight() { return m_avInfo.geometry.base_height; }
-	int getImageWidth() { return m_avInfo.geometry.base_width; }
+	int getImageHeight() { return m_imgHeight ? m_imgHeight : m_avInfo.geometry.base_height; }
+	int getImageWidth() { return m_imgWidth ? m_imgWidth : m_avInfo.geometry.base_width; }
 	int getImagePitch() { return m_imgPitch; }
 	int getImageDepth() { return m_imgDepth; }
 	int getRotation() const { return m_rotation; }
 	bool isHWRenderEnabled() const;
+	// Hardware-rendered frames are then read back one frame late, without
+	// waiting for the GPU
+	void setAsyncReadback(bool async);
+	// Hardware-rendered frames are then downscaled to width x height on the
+	// GPU before readback, as 8-bit gray (depth 8) if gray is set. A zero
+	// width reads back full frames
+	void setReadbackScale(unsigned width, unsigned height, bool gray);
 	double getFrameRate() { return m_avInfo.timing.fps; }
-	int getAudioSamples() { return m_audioData.size() / 2; }
+	int getAudioSamples() const;
 	double getAudioRate() { return m_avInfo.timing.sample_rate; }
-	const int16_t* getAudioData() { return m_audioData.data(); }
+	const int16_t* getAudioData() const { return getAudioHistory(getAudioSamples()); }
+	// The ring keeps roughly the last setAudioHistory() frames of stereo
+	// samples; getAudioHistory(n) points at the most recent n of them. Only
+	// loadRom, setAudioHistory and setAudioEnabled reallocate the ring
+	size_t getAudioHistorySamples() const;
+	const int16_t* getAudioHistory(size_t samples) const;
+	void setAudioHistory(size_t frames);
+	void setAudioEnabled(bool enabled);
+	bool isAudioEnabled() const { return m_audioEnabled; }
+	// While disabled, cores that support it skip producing frames and the
+	// image data keeps pointing at the last rendered frame
+	void setVideoEnabled(bool enabled) { m_videoEnabled = enabled; }
+	bool isVideoEnabled() const { return m_videoEnabled; }
 	void unloadCore();
 	void unloadRom();
 
@@ -63,6 +87,12 @@ public:
 
 	void setKey(int port, int key, bool active) { m_buttonMask[port][key] = active; }
 	bool getKey(int port, int key) { return m_buttonMask[port][key]; }
+	// Bit n of the mask is button n
+	void setButtonMask(int port, uint16_t mask) {
+		for (int key = 0; key < N_BUTTONS; ++key) {
+			m_buttonMask[port][key] = (mask >> key) & 1;
+		}
+	}
 
 	void clearCheats();
 	void setCheat(unsigned index, bool enabled, const char* code);
@@ -76,16 +106,23 @@ public:
 	void ensureInitializedForSerialization();
 
 private:
+	template<size_t>
+	friend struct CoreCallbacks;
+	struct CoreSymbols;
+
 	bool loadCore(const std::string& corePath);
+	void closeCore();
 	void fixScreenSize(const std::string& romName);
 	void reconfigureAddressSpace();
+	void resizeAudio();
+	void pushAudio(const int16_t* data, size_t frames);
 
-	static bool cbEnvironment(unsigned cmd, void* data);
-	static void cbVideoRefresh(const void* data, unsigned width, unsigned height, size_t pitch);
-	static void cbAudioSample(int16_t left, int16_t right);
-	static size_t cbAudioSampleBatch(const int16_t* data, size_t frames);
-	static void cbInputPoll();
-	static int16_t cbInputState(unsigned port, unsigned device, unsigned index, unsigned id);
+	bool cbEnvironment(unsigned cmd, void* data);
+	void cbVideoRefresh(const void* data, unsigned width, unsigned height, size_t pitch);
+	void cbAudioSample(int16_t left, int16_t right);
+	size_t cbAudioSampleBatch(const int16_t* data, size_t frames);
+	void cbInputPoll();
+	int16_t cbInputState(unsigned port, unsigned device, unsigned index, unsigned id);
 
 	bool m_buttonMask[MAX_PLAYERS][N_BUTTONS]{};
 
@@ -93,9 +130,19 @@ private:
 	const void* m_imgData = nullptr;
 	size_t m_imgPitch = 0;
 	int m_imgDepth = 0;
-
-	// Audio buffer; accumulated during run()
-	std::vector<int16_t> m_audioData;
+	// Size of frames downscaled before readback; zero uses the core's geometry
+	unsigned m_imgWidth = 0;
+	unsigned m_imgHeight = 0;
+
+	// Audio ring of m_audioCapacity stereo samples, stored twice back to back
+	// so that any window of recent samples is contiguous
+	std::vector<int16_t> m_audioRing;
+	size_t m_audioCapacity = 0;
+	size_t m_audioHistory = 1;
+	uint64_t m_audioWritten = 0;
+	uint64_t m_audioFrameStart = 0;
+	bool m_audioEnabled = true;
+	bool m_videoEnabled = true;
 	AddressSpace* m_addressSpace = nullptr;
 
 	retro_system_av_info m_avInfo = {};
@@ -104,6 +151,12 @@ private:
 
 	char* m_corePath = nullptr;
 
+	// Each instance owns its entry points and callback slot; a second instance
+	// of an already loaded core runs from a private copy of the library
+	std::unique_ptr<CoreSymbols> m_symbols;
+	int m_slot = -1;
+	std::string m_sharedCorePath;
+	std::string m_coreCopyPath;
 #ifdef _WIN32
 	HMODULE m_coreHandle = nullptr;
 #else
@@ -118,11 +171,13 @@ private:
 	uint64_t m_serializationQuirks = 0;
 	bool m_needsInitFrame = false;
 	bool m_updateGeometryFromVideoRefresh = false;
+	// Stella's savestates don't cover everything, so reset before loading one
+	bool m_resetBeforeUnserialize = false;
 
 #ifdef ENABLE_HW_RENDER
 	HWRenderContext m_hwRender;
-	static uintptr_t cbGetCurrentFramebuffer();
-	static retro_proc_address_t cbGetProcAddress(const char* sym);
+	uintptr_t cbGetCurrentFramebuffer();
+	retro_proc_address_t cbGetProcAddress(const char* sym);
 #endif
 };
 }
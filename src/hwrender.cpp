@@ -37,6 +37,27 @@ static PFNGLGENRENDERBUFFERSPROC glGenRenderbuffers = nullptr;
 static PFNGLBINDRENDERBUFFERPROC glBindRenderbuffer = nullptr;
 static PFNGLRENDERBUFFERSTORAGEPROC glRenderbufferStorage = nullptr;
 static PFNGLDELETERENDERBUFFERSPROC glDeleteRenderbuffers = nullptr;
+static PFNGLGENBUFFERSPROC glGenBuffers = nullptr;
+static PFNGLDELETEBUFFERSPROC glDeleteBuffers = nullptr;
+static PFNGLBINDBUFFERPROC glBindBuffer = nullptr;
+static PFNGLBUFFERDATAPROC glBufferData = nullptr;
+static PFNGLMAPBUFFERRANGEPROC glMapBufferRange = nullptr;
+static PFNGLUNMAPBUFFERPROC glUnmapBuffer = nullptr;
+static PFNGLBLITFRAMEBUFFERPROC glBlitFramebuffer = nullptr;
+static PFNGLCREATESHADERPROC glCreateShader = nullptr;
+static PFNGLSHADERSOURCEPROC glShaderSource = nullptr;
+static PFNGLCOMPILESHADERPROC glCompileShader = nullptr;
+static PFNGLGETSHADERIVPROC glGetShaderiv = nullptr;
+static PFNGLDELETESHADERPROC glDeleteShader = nullptr;
+static PFNGLCREATEPROGRAMPROC glCreateProgram = nullptr;
+static PFNGLATTACHSHADERPROC glAttachShader = nullptr;
+static PFNGLLINKPROGRAMPROC glLinkProgram = nullptr;
+static PFNGLGETPROGRAMIVPROC glGetProgramiv = nullptr;
+static PFNGLDELETEPROGRAMPROC glDeleteProgram = nullptr;
+static PFNGLUSEPROGRAMPROC glUseProgram = nullptr;
+static PFNGLGENVERTEXARRAYSPROC glGenVertexArrays = nullptr;
+static PFNGLBINDVERTEXARRAYPROC glBindVertexArray = nullptr;
+static PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays = nullptr;
 
 namespace Retro {
 
@@ -99,6 +120,30 @@ bool HWRenderContext::init(const retro_hw_render_callback& cb) {
         glDeleteRenderbuffers = (PFNGLDELETERENDERBUFFERSPROC)glXGetProcAddressARB((const GLubyte*)"glDeleteRenderbuffers");
     }
 
+    // Functions only needed by the readback paths; the paths are skipped
+    // when they are missing
+    glGenBuffers = (PFNGLGENBUFFERSPROC)getProcAddress("glGenBuffers");
+    glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)getProcAddress("glDeleteBuffers");
+    glBindBuffer = (PFNGLBINDBUFFERPROC)getProcAddress("glBindBuffer");
+    glBufferData = (PFNGLBUFFERDATAPROC)getProcAddress("glBufferData");
+    glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)getProcAddress("glMapBufferRange");
+    glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)getProcAddress("glUnmapBuffer");
+    glBlitFramebuffer = (PFNGLBLITFRAMEBUFFERPROC)getProcAddress("glBlitFramebuffer");
+    glCreateShader = (PFNGLCREATESHADERPROC)getProcAddress("glCreateShader");
+    glShaderSource = (PFNGLSHADERSOURCEPROC)getProcAddress("glShaderSource");
+    glCompileShader = (PFNGLCOMPILESHADERPROC)getProcAddress("glCompileShader");
+    glGetShaderiv = (PFNGLGETSHADERIVPROC)getProcAddress("glGetShaderiv");
+    glDeleteShader = (PFNGLDELETESHADERPROC)getProcAddress("glDeleteShader");
+    glCreateProgram = (PFNGLCREATEPROGRAMPROC)getProcAddress("glCreateProgram");
+    glAttachShader = (PFNGLATTACHSHADERPROC)getProcAddress("glAttachShader");
+    glLinkProgram = (PFNGLLINKPROGRAMPROC)getProcAddress("glLinkProgram");
+    glGetProgramiv = (PFNGLGETPROGRAMIVPROC)getProcAddress("glGetProgramiv");
+    glDeleteProgram = (PFNGLDELETEPROGRAMPROC)getProcAddress("glDeleteProgram");
+    glUseProgram = (PFNGLUSEPROGRAMPROC)getProcAddress("glUseProgram");
+    glGenVertexArrays = (PFNGLGENVERTEXARRAYSPROC)getProcAddress("glGenVertexArrays");
+    glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)getProcAddress("glBindVertexArray");
+    glDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSPROC)getProcAddress("glDeleteVertexArrays");
+
     if (!glGenFramebuffers || !glBindFramebuffer) {
         std::cerr << "HWRender: Failed to load GL functions" << std::endl;
         if (m_backend == GLBackend::EGL) destroyEGL();
@@ -148,6 +193,7 @@ void HWRenderContext::destroy() {
     }
 
     destroyFramebuffer();
+    destroyScaleTarget();
     if (m_backend == GLBackend::EGL) {
         destroyEGL();
     } else if (m_backend == GLBackend::GLX) {
@@ -716,9 +762,42 @@ void HWRenderContext::destroyFramebuffer() {
         glDeleteRenderbuffers(1, &m_depthRb);
         m_depthRb = 0;
     }
+    destroyPixelBuffers();
     m_readbackBuffer.clear();
 }
 
+bool HWRenderContext::initPixelBuffers(size_t size) {
+    if (m_pixelBufferSize == size) {
+        return true;
+    }
+    destroyPixelBuffers();
+    // GLES2 contexts have no pixel pack buffers
+    if (!glGenBuffers || !glBindBuffer || !glBufferData || !glMapBufferRange || !glUnmapBuffer) {
+        return false;
+    }
+    glGenBuffers(2, m_pixelBuffers);
+    if (!m_pixelBuffers[0] || !m_pixelBuffers[1]) {
+        destroyPixelBuffers();
+        return false;
+    }
+    for (unsigned int buffer : m_pixelBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_pixelBufferSize = size;
+    return true;
+}
+
+void HWRenderContext::destroyPixelBuffers() {
+    if (m_pixelBuffers[0] || m_pixelBuffers[1]) {
+        glDeleteBuffers(2, m_pixelBuffers);
+    }
+    m_pixelBuffers[0] = m_pixelBuffers[1] = 0;
+    m_pixelBufferFrame[0] = m_pixelBufferFrame[1] = 0;
+    m_pixelBufferSize = 0;
+}
+
 void HWRenderContext::resize(unsigned width, unsigned height) {
     if (width == m_width && height == m_height) {
         return;
@@ -740,38 +819,330 @@ const void* HWRenderContext::readbackFramebuffer(unsigned width, unsigned height
         return nullptr;
     }
 
-    // Resize readback buffer if needed
     if (width != m_width || height != m_height) {
         m_width = width;
         m_height = height;
-        m_readbackBuffer.resize(width * height * 4);
     }
 
     // Read from FBO 0 (the default framebuffer / pbuffer)
-    // The core renders to FBO 0, so we read directly from there
+    // The core renders to FBO 0, so we read directly from there,
+    // unless the frame was downscaled into a smaller target first
+    unsigned int source = 0;
+    unsigned readWidth = width;
+    unsigned readHeight = height;
+    bool flip = m_callback.bottom_left_origin;
+    m_readbackWidth = width;
+    m_readbackHeight = height;
+    m_readbackGray = false;
+    if (m_scaleWidth && scaleFramebuffer(width, height)) {
+        // The downscale already flipped the frame
+        flip = false;
+        m_readbackWidth = m_scaleWidth;
+        m_readbackHeight = m_scaleHeight;
+        m_readbackGray = m_scaleGray;
+        source = m_scaleGray ? m_packFbo : m_scaleFbo;
+        readWidth = m_scaleGray ? (m_scaleWidth + 3) / 4 : m_scaleWidth;
+        readHeight = m_scaleHeight;
+    }
+
+    // Resize readback buffer if needed
+    size_t pitch = readWidth * 4;
+    if (pitch != m_readbackPitch || pitch * readHeight != m_readbackBuffer.size()) {
+        m_readbackPitch = pitch;
+        m_readbackBuffer.resize(pitch * readHeight);
+        destroyPixelBuffers();
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+
+    uint64_t frame = ++m_readbackFrame;
+    if (!initPixelBuffers(m_readbackBuffer.size())) {
+        glReadPixels(0, 0, readWidth, readHeight, GL_RGBA, GL_UNSIGNED_BYTE, m_readbackBuffer.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+        // Flip vertically if needed (OpenGL has bottom-left origin)
+        if (flip) {
+            flipVertical(pitch, readHeight);
+        }
+
+        return m_readbackBuffer.data();
+    }
+
+    // Queue this frame's readback; it completes without stalling the core
+    unsigned current = frame & 1;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[current]);
+    glReadPixels(0, 0, readWidth, readHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_readbackBuffer.data());
+    m_pixelBufferFrame[current] = frame;
 
-    // Flip vertically if needed (OpenGL has bottom-left origin)
-    if (m_callback.bottom_left_origin) {
-        flipVertical(width, height);
+    // The previous frame is only usable if it was read back right before this one
+    unsigned previous = current ^ 1;
+    if (m_asyncReadback && m_pixelBufferFrame[previous] && m_pixelBufferFrame[previous] == frame - 1) {
+        copyPixelBuffer(previous, pitch, readHeight, flip);
+    } else {
+        copyPixelBuffer(current, pitch, readHeight, flip);
     }
 
     return m_readbackBuffer.data();
 }
 
-void HWRenderContext::flipVertical(unsigned width, unsigned height) {
-    size_t rowSize = width * 4;
-    std::vector<uint8_t> tempRow(rowSize);
+void HWRenderContext::copyPixelBuffer(unsigned index, size_t pitch, unsigned rows, bool flip) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffers[index]);
+    const uint8_t* pixels = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pitch * rows, GL_MAP_READ_BIT));
+    if (pixels) {
+        // The copy out of the mapped buffer flips rows on the way
+        if (flip) {
+            for (unsigned y = 0; y < rows; ++y) {
+                memcpy(m_readbackBuffer.data() + y * pitch, pixels + (rows - 1 - y) * pitch, pitch);
+            }
+        } else {
+            memcpy(m_readbackBuffer.data(), pixels, pitch * rows);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void HWRenderContext::flipVertical(size_t pitch, unsigned rows) {
+    std::vector<uint8_t> tempRow(pitch);
 
-    for (unsigned y = 0; y < height / 2; ++y) {
-        uint8_t* topRow = m_readbackBuffer.data() + y * rowSize;
-        uint8_t* bottomRow = m_readbackBuffer.data() + (height - 1 - y) * rowSize;
+    for (unsigned y = 0; y < rows / 2; ++y) {
+        uint8_t* topRow = m_readbackBuffer.data() + y * pitch;
+        uint8_t* bottomRow = m_readbackBuffer.data() + (rows - 1 - y) * pitch;
 
-        memcpy(tempRow.data(), topRow, rowSize);
-        memcpy(topRow, bottomRow, rowSize);
-        memcpy(bottomRow, tempRow.data(), rowSize);
+        memcpy(tempRow.data(), topRow, pitch);
+        memcpy(topRow, bottomRow, pitch);
+        memcpy(bottomRow, tempRow.data(), pitch);
+    }
+}
+
+void HWRenderContext::setReadbackScale(unsigned width, unsigned height, bool gray) {
+    if (!width || !height) {
+        width = 0;
+        height = 0;
+    }
+    m_scaleWidth = width;
+    m_scaleHeight = height;
+    m_scaleGray = gray;
+    m_scaleFailed = false;
+}
+
+// Each fragment of the pack target packs the luma of four horizontally
+// adjacent pixels of the downscaled frame into one RGBA texel, so the bytes
+// read back are one gray pixel each
+static const char* s_packVertexShader =
+    "void main() {\n"
+    "    vec2 position = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* s_packFragmentShader =
+    "uniform sampler2D source;\n"
+    "out vec4 color;\n"
+    "float luma(int x, int y, int last) {\n"
+    "    vec3 rgb = texelFetch(source, ivec2(min(x, last), y), 0).rgb;\n"
+    "    return dot(rgb, vec3(0.299, 0.587, 0.114));\n"
+    "}\n"
+    "void main() {\n"
+    "    int x = int(gl_FragCoord.x) * 4;\n"
+    "    int y = int(gl_FragCoord.y);\n"
+    "    int last = textureSize(source, 0).x - 1;\n"
+    "    color = vec4(luma(x, y, last), luma(x + 1, y, last), luma(x + 2, y, last), luma(x + 3, y, last));\n"
+    "}\n";
+
+static GLuint compileShader(GLenum type, const char* header, const char* source) {
+    GLuint shader = glCreateShader(type);
+    const char* sources[] = { header, source };
+    glShaderSource(shader, 2, sources, nullptr);
+    glCompileShader(shader);
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint linkPackProgram() {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    bool es = version && strncmp(version, "OpenGL ES", 9) == 0;
+    const char* headers[] = { "#version 130\n", "#version 150\n" };
+    const char* esHeaders[] = { "#version 300 es\nprecision highp float;\n" };
+    const char* const* begin = es ? esHeaders : headers;
+    const char* const* end = es ? esHeaders + 1 : headers + 2;
+
+    for (const char* const* header = begin; header != end; ++header) {
+        GLuint vertex = compileShader(GL_VERTEX_SHADER, *header, s_packVertexShader);
+        GLuint fragment = compileShader(GL_FRAGMENT_SHADER, *header, s_packFragmentShader);
+        if (!vertex || !fragment) {
+            if (vertex) glDeleteShader(vertex);
+            if (fragment) glDeleteShader(fragment);
+            continue;
+        }
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_TRUE) {
+            return program;
+        }
+        glDeleteProgram(program);
     }
+    return 0;
+}
+
+static bool initColorTarget(unsigned width, unsigned height, GLuint* fbo, GLuint* texture) {
+    glGenTextures(1, texture);
+    glBindTexture(GL_TEXTURE_2D, *texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return complete;
+}
+
+bool HWRenderContext::initScaleTarget() {
+    if (m_scaleFailed) {
+        return false;
+    }
+    bool hasPack = m_packFbo != 0;
+    if (m_scaleFbo && m_scaleTargetWidth == m_scaleWidth && m_scaleTargetHeight == m_scaleHeight && hasPack == m_scaleGray) {
+        return true;
+    }
+    destroyScaleTarget();
+
+    bool ok = glBlitFramebuffer && initColorTarget(m_scaleWidth, m_scaleHeight, &m_scaleFbo, &m_scaleTexture);
+    if (ok && m_scaleGray) {
+        ok = glCreateShader && glGenVertexArrays && glBindVertexArray &&
+            initColorTarget((m_scaleWidth + 3) / 4, m_scaleHeight, &m_packFbo, &m_packTexture);
+        if (ok) {
+            m_packProgram = linkPackProgram();
+            ok = m_packProgram != 0;
+        }
+        if (ok) {
+            // Core profiles can't draw without a vertex array, even an empty one
+            glGenVertexArrays(1, &m_packVao);
+        }
+    }
+    if (!ok) {
+        std::cerr << "HWRender: Can't downscale on the GPU, reading back full frames" << std::endl;
+        destroyScaleTarget();
+        m_scaleFailed = true;
+        return false;
+    }
+    m_scaleTargetWidth = m_scaleWidth;
+    m_scaleTargetHeight = m_scaleHeight;
+    return true;
+}
+
+void HWRenderContext::destroyScaleTarget() {
+    if (m_scaleFbo) {
+        glDeleteFramebuffers(1, &m_scaleFbo);
+        m_scaleFbo = 0;
+    }
+    if (m_scaleTexture) {
+        glDeleteTextures(1, &m_scaleTexture);
+        m_scaleTexture = 0;
+    }
+    if (m_packFbo) {
+        glDeleteFramebuffers(1, &m_packFbo);
+        m_packFbo = 0;
+    }
+    if (m_packTexture) {
+        glDeleteTextures(1, &m_packTexture);
+        m_packTexture = 0;
+    }
+    if (m_packProgram) {
+        glDeleteProgram(m_packProgram);
+        m_packProgram = 0;
+    }
+    if (m_packVao) {
+        glDeleteVertexArrays(1, &m_packVao);
+        m_packVao = 0;
+    }
+    m_scaleTargetWidth = 0;
+    m_scaleTargetHeight = 0;
+}
+
+bool HWRenderContext::scaleFramebuffer(unsigned width, unsigned height) {
+    if (!initScaleTarget()) {
+        return false;
+    }
+
+    // The core doesn't expect its state to change between frames
+    GLint drawFbo = 0;
+    GLint readFbo = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFbo);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFbo);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+
+    // Rows are read back bottom-up, so frames with a bottom-left origin are
+    // flipped by the blit
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_scaleFbo);
+    if (m_callback.bottom_left_origin) {
+        glBlitFramebuffer(0, 0, width, height, 0, m_scaleHeight, m_scaleWidth, 0, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    } else {
+        glBlitFramebuffer(0, 0, width, height, 0, 0, m_scaleWidth, m_scaleHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+
+    if (m_scaleGray) {
+        GLint program = 0;
+        GLint vao = 0;
+        GLint activeTexture = 0;
+        GLint texture = 0;
+        GLint viewport[4];
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        const GLenum caps[] = { GL_BLEND, GL_DEPTH_TEST, GL_STENCIL_TEST, GL_CULL_FACE };
+        GLboolean enabled[4];
+        for (size_t i = 0; i < 4; ++i) {
+            enabled[i] = glIsEnabled(caps[i]);
+            glDisable(caps[i]);
+        }
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_packFbo);
+        glViewport(0, 0, (m_scaleWidth + 3) / 4, m_scaleHeight);
+        glUseProgram(m_packProgram);
+        glBindVertexArray(m_packVao);
+        glBindTexture(GL_TEXTURE_2D, m_scaleTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        for (size_t i = 0; i < 4; ++i) {
+            if (enabled[i]) {
+                glEnable(caps[i]);
+            }
+        }
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(activeTexture);
+        glBindVertexArray(vao);
+        glUseProgram(program);
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+    if (scissor) {
+        glEnable(GL_SCISSOR_TEST);
+    }
+    return true;
 }
 
 } // namespace Retro
@@ -72,16 +72,49 @@ public:
 
     /**
      * Read pixels from the GPU framebuffer into CPU memory.
+     * Readbacks go through a pair of pixel buffer objects. In async mode the
+     * readback of this frame is only queued and the previous frame's buffer
+     * is returned, unless the previous frame was not read back.
      * @param width Frame width.
      * @param height Frame height.
      * @return Pointer to the pixel data (RGBA8888 format), or nullptr on failure.
      */
     const void* readbackFramebuffer(unsigned width, unsigned height);
 
+    /**
+     * Note a frame that was not read back, so the next readback doesn't
+     * return a buffer queued before it.
+     */
+    void skipReadback() { ++m_readbackFrame; }
+
+    /**
+     * Return the previous frame from readbackFramebuffer instead of waiting
+     * for the GPU to finish the current one.
+     */
+    void setAsyncReadback(bool async) { m_asyncReadback = async; }
+    bool asyncReadback() const { return m_asyncReadback; }
+
     /**
      * Get the pitch (bytes per row) of the readback buffer.
      */
-    size_t getReadbackPitch() const { return m_width * 4; }
+    size_t getReadbackPitch() const { return m_readbackPitch; }
+
+    /**
+     * Downscale frames on the GPU before they are read back, so only the
+     * downscaled image is copied to CPU memory.
+     * @param width Width of the read back image, or 0 to read back full frames.
+     * @param height Height of the read back image.
+     * @param gray Read back one byte of luma per pixel instead of RGBA.
+     */
+    void setReadbackScale(unsigned width, unsigned height, bool gray);
+
+    /**
+     * Get the size and format of the last frame read back. Frames are only
+     * downscaled if the GPU supports it.
+     */
+    unsigned getReadbackWidth() const { return m_readbackWidth; }
+    unsigned getReadbackHeight() const { return m_readbackHeight; }
+    bool isReadbackGray() const { return m_readbackGray; }
 
     /**
      * Get the libretro callback structure.
@@ -100,7 +133,13 @@ private:
     void destroyEGL();
     void destroyGLX();
     void destroyFramebuffer();
-    void flipVertical(unsigned width, unsigned height);
+    bool initPixelBuffers(size_t size);
+    void destroyPixelBuffers();
+    void copyPixelBuffer(unsigned index, size_t pitch, unsigned rows, bool flip);
+    void flipVertical(size_t pitch, unsigned rows);
+    bool initScaleTarget();
+    void destroyScaleTarget();
+    bool scaleFramebuffer(unsigned width, unsigned height);
 
     retro_hw_render_callback m_callback{};
     bool m_enabled = false;
@@ -128,6 +167,31 @@ private:
 
     // Readback buffer
     std::vector<uint8_t> m_readbackBuffer;
+    size_t m_readbackPitch = 0;
+    unsigned m_readbackWidth = 0;
+    unsigned m_readbackHeight = 0;
+    bool m_readbackGray = false;
+
+    // Downscale target; gray frames are packed four pixels to a texel
+    unsigned m_scaleWidth = 0;
+    unsigned m_scaleHeight = 0;
+    bool m_scaleGray = false;
+    bool m_scaleFailed = false;
+    unsigned m_scaleTargetWidth = 0;
+    unsigned m_scaleTargetHeight = 0;
+    unsigned int m_scaleFbo = 0;
+    unsigned int m_scaleTexture = 0;
+    unsigned int m_packFbo = 0;
+    unsigned int m_packTexture = 0;
+    unsigned int m_packProgram = 0;
+    unsigned int m_packVao = 0;
+
+    // Pixel buffer ring; each buffer remembers the frame it was filled on
+    unsigned int m_pixelBuffers[2]{};
+    uint64_t m_pixelBufferFrame[2]{};
+    size_t m_pixelBufferSize = 0;
+    uint64_t m_readbackFrame = 0;
+    bool m_asyncReadback = false;
 };
 
 } // namespace Retro
@@ -4,6 +4,7 @@
 #include <emmintrin.h>
 #include <tmmintrin.h>
 #endif
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
 
@@ -20,6 +21,7 @@ static void imageHalveX888ToGrayInterlace(const uint32_t* in, const uint16_t* ol
 static void imageQuarterX888ToGray(const uint32_t* in, uint8_t* out, size_t w, size_t h, size_t stride);
 static void imageQuarterX888ToGrayInterlace(const uint32_t* in, const uint16_t* oldin, uint16_t* out, size_t w, size_t h, size_t stride);
 static void imageX888To888(const uint32_t* in, uint8_t* out, size_t w, size_t h, size_t stride);
+static void imageG8To888(const uint8_t* in, uint8_t* out, size_t w, size_t h, size_t stride);
 
 #ifdef __SSSE3__
 const static __m128i maskR16 = _mm_set1_epi16(0xF800);
@@ -330,8 +332,8 @@ static inline void _convert565To888(const __m128i* in, __m128i* out) {
 	/* 00 B8 00 B9 00 BA 00 BB 00 BC 00 BD 00 BE 00 BF -> BA 00 00 BB 00 00 BC 00 00 BD 00 00 BE 00 00 BF */
 	const static __m128i bblend21 = _mm_set_epi8(0x0E, 0x80, 0x80, 0x0C, 0x80, 0x80, 0x0A, 0x80, 0x80, 0x08, 0x80, 0x80, 0x06, 0x80, 0x80, 0x04);
 
-	__m128i pix0 = _mm_load_si128(&in[0]);
-	__m128i pix1 = _mm_load_si128(&in[1]);
+	__m128i pix0 = _mm_loadu_si128(&in[0]);
+	__m128i pix1 = _mm_loadu_si128(&in[1]);
 
 	// Mask out channels
 	__m128i r0 = _mm_and_si128(pix0, maskR16);
@@ -365,9 +367,9 @@ static inline void _convert565To888(const __m128i* in, __m128i* out) {
 	out2 = _mm_or_si128(out2, _mm_shuffle_epi8(g1, gblend21));
 	out2 = _mm_or_si128(out2, _mm_shuffle_epi8(b1, bblend21));
 
-	_mm_store_si128(&out[0], out0);
-	_mm_store_si128(&out[1], out1);
-	_mm_store_si128(&out[2], out2);
+	_mm_storeu_si128(&out[0], out0);
+	_mm_storeu_si128(&out[1], out1);
+	_mm_storeu_si128(&out[2], out2);
 }
 #endif
 
@@ -375,7 +377,7 @@ void image565To888(const uint16_t* in, uint8_t* out, size_t w, size_t h, size_t
 	for (size_t y = 0; y < h; ++y) {
 		size_t x = 0;
 #ifdef __SSSE3__
-		for (; x < w; x += 16) {
+		for (; x + 15 < w; x += 16) {
 			_convert565To888(reinterpret_cast<const __m128i*>(&in[x]), reinterpret_cast<__m128i*>(out));
 			out += 16 * 3;
 		}
@@ -572,10 +574,10 @@ void imageX888To888(const uint32_t* in, uint8_t* out, size_t w, size_t h, size_t
 			/* BC GC RC XC BD GD RD XD BE GE RE XE BF GF RF XF -> 00 00 00 00 RC GC BC RD GD BD RE GE BE RF GF DF */
 			const static __m128i blend23 = _mm_set_epi8(0x0C, 0x0D, 0x0E, 0x08, 0x09, 0x0A, 0x04, 0x05, 0x06, 0x00, 0x01, 0x02, 0x80, 0x80, 0x80, 0x80);
 
-			__m128i pix0 = _mm_load_si128(reinterpret_cast<const __m128i*>(&in[x]));
-			__m128i pix1 = _mm_load_si128(reinterpret_cast<const __m128i*>(&in[x + 4]));
-			__m128i pix2 = _mm_load_si128(reinterpret_cast<const __m128i*>(&in[x + 8]));
-			__m128i pix3 = _mm_load_si128(reinterpret_cast<const __m128i*>(&in[x + 12]));
+			__m128i pix0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[x]));
+			__m128i pix1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[x + 4]));
+			__m128i pix2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[x + 8]));
+			__m128i pix3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[x + 12]));
 
 			__m128i out0 = _mm_shuffle_epi8(pix0, blend00);
 			out0 = _mm_or_si128(out0, _mm_shuffle_epi8(pix1, blend01));
@@ -594,15 +596,41 @@ void imageX888To888(const uint32_t* in, uint8_t* out, size_t w, size_t h, size_t
 #endif
 		for (; x < w; ++x) {
 			uint32_t xrgb = in[x];
-			out[0] = xrgb;
+			out[0] = xrgb >> 16;
 			out[1] = xrgb >> 8;
-			out[2] = xrgb >> 16;
+			out[2] = xrgb;
 			out += 3;
 		}
 		in += stride / 4;
 	}
 }
 
+void imageG8To888(const uint8_t* in, uint8_t* out, size_t w, size_t h, size_t stride) {
+	for (size_t y = 0; y < h; ++y) {
+		for (size_t x = 0; x < w; ++x) {
+			out[0] = in[x];
+			out[1] = in[x];
+			out[2] = in[x];
+			out += 3;
+		}
+		in += stride;
+	}
+}
+
+size_t Image::formatDepth(Format format) {
+	switch (format) {
+	case Image::Format::RGB565:
+		return 2;
+	case Image::Format::RGB888:
+		return 3;
+	case Image::Format::RGBX888:
+		return 4;
+	case Image::Format::G8:
+		break;
+	}
+	return 1;
+}
+
 Image::Image(Format format, const void* in, size_t w, size_t h, size_t stride)
 	: m_constBuffer(in)
 	, m_w(w)
@@ -661,6 +689,10 @@ void Image::copyTo(Image* other) {
 		switch (other->m_format) {
 		case Image::Format::G8:
 			copyDirectlyTo(other);
+			break;
+		case Image::Format::RGB888:
+			imageG8To888(static_cast<const uint8_t*>(m_constBuffer), static_cast<uint8_t*>(other->m_buffer), m_w, m_h, m_stride);
+			break;
 		default:
 			throw logic_error("unimplemented conversion");
 		}
@@ -834,21 +866,81 @@ void Image::divideToInterlace(int divisor, Image* other, const Image* old) {
 	}
 }
 
-void Image::copyDirectlyTo(Image* other) {
-	size_t depth = 1;
-	switch (m_format) {
-	case Image::Format::RGB565:
-		depth = 2;
-		break;
-	case Image::Format::RGB888:
-		depth = 3;
-		break;
-	case Image::Format::RGBX888:
-		depth = 4;
-		break;
-	case Image::Format::G8:
-		break;
+// Crops and rotations hand the converters pointers with arbitrary alignment,
+// so the vector paths above use unaligned loads and stores throughout
+Image Image::crop(size_t x, size_t y, size_t w, size_t h) const {
+	if (x + w > m_w || y + h > m_h) {
+		throw invalid_argument("Crop is outside of the image");
+	}
+	Image cropped(*this);
+	size_t offset = y * m_stride + x * formatDepth(m_format);
+	cropped.m_constBuffer = static_cast<const uint8_t*>(m_constBuffer) + offset;
+	if (m_buffer) {
+		cropped.m_buffer = static_cast<uint8_t*>(m_buffer) + offset;
+	}
+	cropped.m_w = w;
+	cropped.m_h = h;
+	return cropped;
+}
+
+void Image::rotateTo(Image* other, int steps) {
+	steps &= 3;
+	if (!steps) {
+		copyTo(other);
+		return;
+	}
+	size_t w = steps == 2 ? m_w : m_h;
+	size_t h = steps == 2 ? m_h : m_w;
+	if (other->m_w != w || other->m_h != h) {
+		throw invalid_argument("Image dimensions don't match");
 	}
+	if (other->m_format != Image::Format::RGB888 || (m_format != Image::Format::RGB565 && m_format != Image::Format::RGBX888 && m_format != Image::Format::G8)) {
+		throw logic_error("unimplemented conversion");
+	}
+
+	uint8_t* out = static_cast<uint8_t*>(other->m_buffer);
+	for (size_t y = 0; y < m_h; ++y) {
+		const uint8_t* row = static_cast<const uint8_t*>(m_constBuffer) + y * m_stride;
+		for (size_t x = 0; x < m_w; ++x) {
+			size_t r;
+			size_t c;
+			// Counter-clockwise quarter turns, matching RETRO_ENVIRONMENT_SET_ROTATION
+			switch (steps) {
+			case 1:
+				r = m_w - 1 - x;
+				c = y;
+				break;
+			case 2:
+				r = m_h - 1 - y;
+				c = m_w - 1 - x;
+				break;
+			default:
+				r = x;
+				c = m_h - 1 - y;
+				break;
+			}
+			uint8_t* pixel = &out[(r * w + c) * 3];
+			if (m_format == Image::Format::RGB565) {
+				uint16_t rgb = reinterpret_cast<const uint16_t*>(row)[x];
+				pixel[0] = (rgb & 0xF800) >> 8;
+				pixel[1] = (rgb & 0x07E0) >> 3;
+				pixel[2] = (rgb & 0x001F) << 3;
+			} else if (m_format == Image::Format::G8) {
+				pixel[0] = row[x];
+				pixel[1] = row[x];
+				pixel[2] = row[x];
+			} else {
+				uint32_t xrgb = reinterpret_cast<const uint32_t*>(row)[x];
+				pixel[0] = xrgb >> 16;
+				pixel[1] = xrgb >> 8;
+				pixel[2] = xrgb;
+			}
+		}
+	}
+}
+
+void Image::copyDirectlyTo(Image* other) {
+	size_t depth = formatDepth(m_format);
 	if (m_stride == other->m_stride) {
 		memcpy(other->m_buffer, m_constBuffer, m_stride * m_h);
 	} else {
@@ -859,3 +951,164 @@ void Image::copyDirectlyTo(Image* other) {
 		}
 	}
 }
+
+void ImagePipeline::configure(const Config& config) {
+	m_config = config;
+	m_config.rotation &= 3;
+	m_binSource[0] = 0;
+	m_binSource[1] = 0;
+	reset();
+}
+
+void ImagePipeline::reset() {
+	m_hasPrevious = false;
+}
+
+void ImagePipeline::cropRect(size_t frameWidth, size_t frameHeight, size_t* x, size_t* y, size_t* w, size_t* h) const {
+	*x = min(m_config.cropX, frameWidth);
+	*y = min(m_config.cropY, frameHeight);
+	size_t cw = m_config.cropWidth;
+	size_t ch = m_config.cropHeight;
+	*w = cw && *x + cw <= frameWidth ? cw : frameWidth - *x;
+	*h = ch && *y + ch <= frameHeight ? ch : frameHeight - *y;
+}
+
+void ImagePipeline::outputSize(size_t frameWidth, size_t frameHeight, size_t* width, size_t* height) const {
+	size_t x, y, w, h;
+	cropRect(frameWidth, frameHeight, &x, &y, &w, &h);
+	if (m_config.rotation & 1) {
+		swap(w, h);
+	}
+	*width = m_config.width ? m_config.width : w;
+	*height = m_config.height ? m_config.height : h;
+}
+
+// Every source column and row lands in exactly one output bin, so each output
+// pixel is the mean of a box of source pixels
+void ImagePipeline::prepareBins(size_t cropWidth, size_t cropHeight, size_t width, size_t height) {
+	if (m_binSource[0] == cropWidth && m_binSource[1] == cropHeight && m_binTarget[0] == width && m_binTarget[1] == height) {
+		return;
+	}
+	m_columnBin.resize(cropWidth);
+	m_columnCount.assign(width, 0);
+	for (size_t x = 0; x < cropWidth; ++x) {
+		m_columnBin[x] = x * width / cropWidth;
+		++m_columnCount[m_columnBin[x]];
+	}
+	m_rowBin.resize(cropHeight);
+	m_rowCount.assign(height, 0);
+	for (size_t y = 0; y < cropHeight; ++y) {
+		m_rowBin[y] = y * height / cropHeight;
+		++m_rowCount[m_rowBin[y]];
+	}
+	m_binSource[0] = cropWidth;
+	m_binSource[1] = cropHeight;
+	m_binTarget[0] = width;
+	m_binTarget[1] = height;
+	m_hasPrevious = false;
+}
+
+void ImagePipeline::process(const Image& in, uint8_t* out) {
+	if (in.m_format != Image::Format::RGB565 && in.m_format != Image::Format::RGBX888 && in.m_format != Image::Format::G8) {
+		throw logic_error("unimplemented conversion");
+	}
+	size_t x0, y0, cw, ch;
+	cropRect(in.m_w, in.m_h, &x0, &y0, &cw, &ch);
+	size_t outWidth, outHeight;
+	outputSize(in.m_w, in.m_h, &outWidth, &outHeight);
+	int rotation = m_config.rotation;
+	// Bins are computed before rotating
+	size_t width = rotation & 1 ? outHeight : outWidth;
+	size_t height = rotation & 1 ? outWidth : outHeight;
+	if (!cw || !ch || width > cw || height > ch) {
+		throw invalid_argument("Observation size must not be larger than the cropped frame");
+	}
+	prepareBins(cw, ch, width, height);
+
+	size_t channels = this->channels();
+	size_t outSize = width * height * channels;
+	if (m_config.maxPool) {
+		m_current.resize(outSize);
+		if (m_previous.size() != outSize) {
+			m_previous.assign(outSize, 0);
+			m_hasPrevious = false;
+		}
+	}
+	m_sums.assign(width * channels, 0);
+
+	const uint8_t* base = static_cast<const uint8_t*>(in.m_constBuffer) + y0 * in.m_stride;
+	for (size_t y = 0; y < ch; ++y) {
+		const uint8_t* row = base + y * in.m_stride;
+		for (size_t x = 0; x < cw; ++x) {
+			unsigned r, g, b;
+			if (in.m_format == Image::Format::RGB565) {
+				uint16_t rgb = reinterpret_cast<const uint16_t*>(row)[x0 + x];
+				r = (rgb & 0xF800) >> 8;
+				g = (rgb & 0x07E0) >> 3;
+				b = (rgb & 0x001F) << 3;
+			} else if (in.m_format == Image::Format::G8) {
+				// Equal channels come out of the luma weights unchanged
+				r = g = b = row[x0 + x];
+			} else {
+				uint32_t xrgb = reinterpret_cast<const uint32_t*>(row)[x0 + x];
+				r = (xrgb >> 16) & 0xFF;
+				g = (xrgb >> 8) & 0xFF;
+				b = xrgb & 0xFF;
+			}
+			uint32_t* sum = &m_sums[m_columnBin[x] * channels];
+			if (channels == 1) {
+				// BT.601 luma in 8.8 fixed point
+				sum[0] += (r * 77 + g * 150 + b * 29) >> 8;
+			} else {
+				sum[0] += r;
+				sum[1] += g;
+				sum[2] += b;
+			}
+		}
+		if (y + 1 < ch && m_rowBin[y + 1] == m_rowBin[y]) {
+			continue;
+		}
+
+		size_t oy = m_rowBin[y];
+		for (size_t ox = 0; ox < width; ++ox) {
+			uint32_t area = m_columnCount[ox] * m_rowCount[oy];
+			size_t r, c;
+			switch (rotation) {
+			case 1:
+				r = width - 1 - ox;
+				c = oy;
+				break;
+			case 2:
+				r = height - 1 - oy;
+				c = width - 1 - ox;
+				break;
+			case 3:
+				r = ox;
+				c = height - 1 - oy;
+				break;
+			default:
+				r = oy;
+				c = ox;
+				break;
+			}
+			uint8_t* pixel = &out[(r * outWidth + c) * channels];
+			for (size_t i = 0; i < channels; ++i) {
+				uint8_t value = (m_sums[ox * channels + i] + area / 2) / area;
+				if (m_config.maxPool) {
+					size_t index = (oy * width + ox) * channels + i;
+					m_current[index] = value;
+					if (m_hasPrevious) {
+						value = max(value, m_previous[index]);
+					}
+				}
+				pixel[i] = value;
+			}
+		}
+		fill(m_sums.begin(), m_sums.end(), 0);
+	}
+
+	if (m_config.maxPool) {
+		swap(m_current, m_previous);
+		m_hasPrevious = true;
+	}
+}
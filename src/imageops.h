@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <vector>
 
 namespace Retro {
 
@@ -19,7 +20,11 @@ public:
 	Image(Format, void* in, size_t w, size_t h, size_t stride);
 	Image(const Image&) = default;
 
+	Image crop(size_t x, size_t y, size_t w, size_t h) const;
+
 	void copyTo(Image* other);
+	// Converts to RGB888 while rotating by steps quarter turns counter-clockwise
+	void rotateTo(Image* other, int steps);
 	void halveTo(Image* other);
 	void halveToInterlace(Image* other, const Image* old);
 	void quarterTo(Image* other);
@@ -28,6 +33,9 @@ public:
 	void divideToInterlace(int divisor, Image* other, const Image* old);
 
 private:
+	friend class ImagePipeline;
+
+	static size_t formatDepth(Format);
 	void copyDirectlyTo(Image* other);
 
 	const void* m_constBuffer = nullptr;
@@ -37,4 +45,50 @@ private:
 	size_t m_stride;
 	Format m_format;
 };
+
+// Crops, rotates, converts to RGB or gray, area-resizes and optionally
+// max-pools against the previous frame, all in one pass over the core's frame
+class ImagePipeline {
+public:
+	struct Config {
+		// A zero crop size extends the crop to the edge of the frame
+		size_t cropX = 0;
+		size_t cropY = 0;
+		size_t cropWidth = 0;
+		size_t cropHeight = 0;
+		int rotation = 0;
+		bool gray = false;
+		// Size after rotation; zero keeps the cropped size
+		size_t width = 0;
+		size_t height = 0;
+		bool maxPool = false;
+	};
+
+	void configure(const Config&);
+	const Config& config() const { return m_config; }
+	void reset();
+
+	// Output dimensions for a frame of the given size
+	void outputSize(size_t frameWidth, size_t frameHeight, size_t* width, size_t* height) const;
+	size_t channels() const { return m_config.gray ? 1 : 3; }
+
+	// out receives height * width * channels() bytes
+	void process(const Image& in, uint8_t* out);
+
+private:
+	void cropRect(size_t frameWidth, size_t frameHeight, size_t* x, size_t* y, size_t* w, size_t* h) const;
+	void prepareBins(size_t cropWidth, size_t cropHeight, size_t width, size_t height);
+
+	Config m_config;
+	size_t m_binSource[2]{};
+	size_t m_binTarget[2]{};
+	std::vector<uint32_t> m_columnBin;
+	std::vector<uint32_t> m_rowBin;
+	std::vector<uint32_t> m_columnCount;
+	std::vector<uint32_t> m_rowCount;
+	std::vector<uint32_t> m_sums;
+	std::vector<uint8_t> m_current;
+	std::vector<uint8_t> m_previous;
+	bool m_hasPrevious = false;
+};
 }
@@ -1,6 +1,9 @@
 #include "memory.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <type_traits>
 #include <unordered_map>
 
 using namespace Retro;
@@ -28,6 +31,102 @@ bool Retro::reduceCompare(Endian a, Endian b) {
 	return reduce(a) == reduce(b);
 }
 
+template<typename T>
+static inline T swapBytes(T value);
+
+template<>
+inline uint8_t swapBytes(uint8_t value) {
+	return value;
+}
+
+template<>
+inline uint16_t swapBytes(uint16_t value) {
+	return __builtin_bswap16(value);
+}
+
+template<>
+inline uint32_t swapBytes(uint32_t value) {
+	return __builtin_bswap32(value);
+}
+
+template<>
+inline uint64_t swapBytes(uint64_t value) {
+	return __builtin_bswap64(value);
+}
+
+template<typename T, Endian E>
+static int64_t decodeInt(const DataType&, const void* buffer) {
+	typename make_unsigned<T>::type value;
+	memcpy(&value, buffer, sizeof(value));
+	if (E != Endian::REAL_NATIVE) {
+		value = swapBytes(value);
+	}
+	return static_cast<T>(value);
+}
+
+template<typename T, Endian E>
+static void encodeInt(const DataType&, void* buffer, int64_t datum) {
+	typename make_unsigned<T>::type value = datum;
+	if (E != Endian::REAL_NATIVE) {
+		value = swapBytes(value);
+	}
+	memcpy(buffer, &value, sizeof(value));
+}
+
+template<size_t Width, Endian E>
+static int64_t decodeBcd(const DataType&, const void* buffer) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+	int64_t datum = 0;
+	for (size_t i = 0; i < Width; ++i) {
+		uint8_t b = bytes[E == Endian::BIG ? i : Width - 1 - i];
+		datum = datum * 100 + (b & 0xF) % 10 + (b >> 4) % 10 * 10;
+	}
+	return datum;
+}
+
+template<Endian E, typename Decode, typename Encode>
+static void resolveCodec(size_t width, Repr repr, Decode* decode, Encode* encode) {
+	bool sign = repr == Repr::SIGNED;
+	switch (repr) {
+	case Repr::SIGNED:
+	case Repr::UNSIGNED:
+		switch (width) {
+		case 1:
+			*decode = sign ? &decodeInt<int8_t, E> : &decodeInt<uint8_t, E>;
+			*encode = &encodeInt<uint8_t, E>;
+			break;
+		case 2:
+			*decode = sign ? &decodeInt<int16_t, E> : &decodeInt<uint16_t, E>;
+			*encode = &encodeInt<uint16_t, E>;
+			break;
+		case 4:
+			*decode = sign ? &decodeInt<int32_t, E> : &decodeInt<uint32_t, E>;
+			*encode = &encodeInt<uint32_t, E>;
+			break;
+		case 8:
+			*decode = sign ? &decodeInt<int64_t, E> : &decodeInt<uint64_t, E>;
+			*encode = &encodeInt<uint64_t, E>;
+			break;
+		}
+		break;
+	case Repr::BCD:
+		switch (width) {
+		case 1:
+			*decode = &decodeBcd<1, E>;
+			break;
+		case 2:
+			*decode = &decodeBcd<2, E>;
+			break;
+		case 4:
+			*decode = &decodeBcd<4, E>;
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
 DataType::DataType(const char* type)
 	: width(type[strlen(type) - 1] - '0')
 	, endian(
@@ -84,6 +183,17 @@ DataType::DataType(const char* type)
 			shift[i] = baseShift;
 		}
 	}
+
+	switch (width == 1 ? Endian::LITTLE : reduce(endian)) {
+	case Endian::LITTLE:
+		resolveCodec<Endian::LITTLE>(width, repr, &m_decode, &m_encode);
+		break;
+	case Endian::BIG:
+		resolveCodec<Endian::BIG>(width, repr, &m_decode, &m_encode);
+		break;
+	default:
+		break;
+	}
 }
 
 DataType::DataType(const string& type)
@@ -106,23 +216,23 @@ bool DataType::operator!=(const DataType& other) const {
 	return !(*this == other);
 }
 
-void DataType::encode(void* buffer, int64_t value) const {
-	for (size_t i = 0; i < width; ++i) {
-		uint64_t b = (uint64_t) value / shift[i];
-		b = b % cvt + b / cvt % cvt * (~maskHi + 1);
+void DataType::encodeGeneric(const DataType& type, void* buffer, int64_t value) {
+	for (size_t i = 0; i < type.width; ++i) {
+		uint64_t b = (uint64_t) value / type.shift[i];
+		b = b % type.cvt + b / type.cvt % type.cvt * (~type.maskHi + 1);
 		static_cast<uint8_t*>(buffer)[i] = b;
 	}
 }
 
-int64_t DataType::decode(const void* buffer) const {
+int64_t DataType::decodeGeneric(const DataType& type, const void* buffer) {
 	int64_t datum = 0;
-	for (size_t i = 0; i < width; ++i) {
+	for (size_t i = 0; i < type.width; ++i) {
 		uint8_t b = static_cast<const uint8_t*>(buffer)[i];
-		datum += ((b & maskLo) % cvt + ((b & maskHi) >> 4) % cvt * 10) * shift[i];
+		datum += ((b & type.maskLo) % type.cvt + ((b & type.maskHi) >> 4) % type.cvt * 10) * type.shift[i];
 	}
-	if (repr == Repr::SIGNED) {
-		datum <<= 8 * (8 - width);
-		datum >>= 8 * (8 - width);
+	if (type.repr == Repr::SIGNED) {
+		datum <<= 8 * (8 - type.width);
+		datum >>= 8 * (8 - type.width);
 	}
 	return datum;
 }
@@ -324,71 +434,103 @@ int64_t DynamicMemoryView::operator[](size_t offset) const {
 const DataType AddressSpace::s_type{ "|u1" };
 
 void AddressSpace::addBlock(size_t offset, size_t size, void* data) {
+	++m_generation;
 	if (data) {
 		m_blocks[offset].open(data, size);
 	} else {
 		m_blocks[offset].open(size);
 	}
+	rebuildSegments();
 }
 
 void AddressSpace::addBlock(size_t offset, size_t size, const void* data) {
+	++m_generation;
 	if (data) {
 		m_blocks[offset].clone(data, size);
 	} else {
 		m_blocks[offset].open(size);
 	}
+	rebuildSegments();
 }
 
 void AddressSpace::addBlock(size_t offset, const MemoryView<>& base) {
+	++m_generation;
 	m_blocks[offset].clone(base);
+	rebuildSegments();
 }
 
 void AddressSpace::updateBlock(size_t offset, void* data) {
+	++m_generation;
 	m_blocks[offset].open(data, m_blocks[offset].size());
+	rebuildSegments();
 }
 
 void AddressSpace::updateBlock(size_t offset, const void* data) {
+	++m_generation;
 	m_blocks[offset].clone(data, m_blocks[offset].size());
+	rebuildSegments();
 }
 
 void AddressSpace::updateBlock(size_t offset, const MemoryView<>& base) {
+	++m_generation;
 	m_blocks[offset].clone(base);
+	rebuildSegments();
 }
 
 bool AddressSpace::hasBlock(size_t offset) const {
-	for (const auto& block : m_blocks) {
-		if (offset < block.first) {
-			continue;
-		}
-		if (offset < block.first + block.second.size()) {
-			return true;
-		}
-	}
-	return false;
+	size_t local;
+	return find(offset, &local);
 }
 
 const MemoryView<>& AddressSpace::block(size_t offset) const {
-	for (const auto& block : m_blocks) {
-		if (offset < block.first) {
-			continue;
-		}
-		if (offset < block.first + block.second.size()) {
-			return block.second;
-		}
+	size_t local;
+	const MemoryView<>* block = find(offset, &local);
+	if (!block) {
+		throw std::out_of_range("No known mapping");
 	}
-	throw std::out_of_range("No known mapping");
+	return *block;
 }
 
 MemoryView<>& AddressSpace::block(size_t offset) {
+	size_t local;
+	MemoryView<>* block = find(offset, &local);
+	if (!block) {
+		throw std::out_of_range("No known mapping");
+	}
+	return *block;
+}
+
+const MemoryView<>* AddressSpace::find(size_t address, size_t* offset) const {
+	auto segment = upper_bound(m_segments.begin(), m_segments.end(), address, [](size_t address, const Segment& segment) {
+		return address < segment.start;
+	});
+	if (segment == m_segments.begin()) {
+		return nullptr;
+	}
+	--segment;
+	if (address >= segment->end) {
+		return nullptr;
+	}
+	*offset = address - segment->base;
+	return segment->block;
+}
+
+MemoryView<>* AddressSpace::find(size_t address, size_t* offset) {
+	return const_cast<MemoryView<>*>(static_cast<const AddressSpace*>(this)->find(address, offset));
+}
+
+void AddressSpace::rebuildSegments() {
+	m_segments.clear();
+	size_t covered = 0;
 	for (auto& block : m_blocks) {
-		if (offset < block.first) {
+		size_t start = max(block.first, covered);
+		size_t end = block.first + block.second.size();
+		if (start >= end) {
 			continue;
 		}
-		if (offset < block.first + block.second.size()) {
-			return block.second;
-		}
+		m_segments.push_back({ start, end, block.first, &block.second });
+		covered = max(covered, end);
 	}
-	throw std::out_of_range("No known mapping");
 }
 
 bool AddressSpace::ok() const {
@@ -396,15 +538,26 @@ bool AddressSpace::ok() const {
 }
 
 void AddressSpace::reset() {
+	++m_generation;
 	m_blocks.clear();
+	rebuildSegments();
 }
 
 void AddressSpace::clone(const AddressSpace& as) {
-	m_blocks.clear();
+	++m_generation;
+	// Keep blocks that are still mapped so that their buffers are reused
+	for (auto iter = m_blocks.begin(); iter != m_blocks.end();) {
+		if (as.m_blocks.find(iter->first) == as.m_blocks.end()) {
+			iter = m_blocks.erase(iter);
+		} else {
+			++iter;
+		}
+	}
 	m_overlay = make_unique<MemoryOverlay>(*as.m_overlay);
 	for (auto& kv : as.m_blocks) {
 		m_blocks[kv.first].clone(kv.second);
 	}
+	rebuildSegments();
 }
 
 void AddressSpace::clone() {
@@ -413,78 +566,105 @@ void AddressSpace::clone() {
 	}
 }
 
+void AddressSpace::swap(AddressSpace& as) {
+	++m_generation;
+	++as.m_generation;
+	m_blocks.swap(as.m_blocks);
+	m_segments.swap(as.m_segments);
+	m_overlay.swap(as.m_overlay);
+}
+
+bool AddressSpace::copyRanges(const AddressSpace& as, const vector<pair<size_t, size_t>>& ranges) {
+	if (m_blocks.size() != as.m_blocks.size()) {
+		return false;
+	}
+	for (auto mine = m_blocks.cbegin(), theirs = as.m_blocks.cbegin(); mine != m_blocks.cend(); ++mine, ++theirs) {
+		if (mine->first != theirs->first || mine->second.size() != theirs->second.size()) {
+			return false;
+		}
+	}
+	auto block = m_blocks.begin();
+	auto source = as.m_blocks.cbegin();
+	for (const auto& range : ranges) {
+		size_t start = range.first;
+		size_t end = range.first + range.second;
+		while (block != m_blocks.end() && block->first + block->second.size() <= start) {
+			++block;
+			++source;
+		}
+		// Ranges may straddle blocks or cover unmapped addresses
+		auto s = source;
+		for (auto b = block; b != m_blocks.end() && b->first < end; ++b, ++s) {
+			size_t lo = max(start, b->first);
+			size_t hi = min(end, b->first + b->second.size());
+			if (lo < hi) {
+				memcpy(b->second.offset(lo - b->first), s->second.offset(lo - b->first), hi - lo);
+			}
+		}
+	}
+	return true;
+}
+
 void AddressSpace::setOverlay(const MemoryOverlay& overlay) {
+	++m_generation;
 	m_overlay = make_unique<MemoryOverlay>(overlay);
 }
 
 Datum AddressSpace::operator[](size_t offset) {
-	for (auto& kv : m_blocks) {
-		if (offset < kv.first) {
-			throw std::out_of_range("No known mapping");
-		}
-		if (offset - kv.first >= kv.second.size()) {
-			continue;
-		}
-		return Datum(kv.second.offset(0), offset - kv.first, s_type, *m_overlay);
+	size_t local;
+	MemoryView<>* block = find(offset, &local);
+	if (!block) {
+		throw std::out_of_range("No known mapping");
 	}
-	throw std::out_of_range("No known mapping");
+	return Datum(block->offset(0), local, s_type, *m_overlay);
 }
 
 Datum AddressSpace::operator[](const Variable& var) {
-	for (auto& kv : m_blocks) {
-		if (var.address < kv.first) {
-			throw std::out_of_range("No known mapping");
-		}
-		if (var.address - kv.first >= kv.second.size()) {
-			continue;
-		}
-		return Datum(kv.second.offset(0), Variable{ var.type, var.address - kv.first, var.mask }, *m_overlay);
+	size_t local;
+	MemoryView<>* block = find(var.address, &local);
+	if (!block) {
+		throw std::out_of_range("No known mapping");
 	}
-	throw std::out_of_range("No known mapping");
+	return Datum(block->offset(0), Variable{ var.type, local, var.mask }, *m_overlay);
 }
 
 uint8_t AddressSpace::operator[](size_t offset) const {
-	for (const auto& kv : m_blocks) {
-		if (offset < kv.first) {
-			throw std::out_of_range("No known mapping");
-		}
-		if (offset - kv.first >= kv.second.size()) {
-			continue;
-		}
-		uint8_t fakeBase[16]{};
-		return s_type.decode(m_overlay->parse(kv.second.offset(0), offset - kv.first, reinterpret_cast<void*>(fakeBase), s_type.width));
+	size_t local;
+	const MemoryView<>* block = find(offset, &local);
+	if (!block) {
+		throw std::out_of_range("No known mapping");
 	}
-	throw std::out_of_range("No known mapping");
+	uint8_t fakeBase[16]{};
+	return s_type.decode(m_overlay->parse(block->offset(0), local, reinterpret_cast<void*>(fakeBase), s_type.width));
 }
 
 int64_t AddressSpace::operator[](const Variable& var) const {
-	for (const auto& kv : m_blocks) {
-		if (var.address < kv.first) {
-			throw std::out_of_range("No known mapping");
-		}
-		if (var.address - kv.first >= kv.second.size()) {
-			continue;
-		}
-		int64_t value;
-		if (m_overlay->width > 1) {
-			uint8_t fakeBase[16];
-			value = var.type.decode(m_overlay->parse(kv.second.offset(0), var.address - kv.first, reinterpret_cast<void*>(fakeBase), var.type.width));
-		} else {
-			value = var.type.decode(kv.second.offset(var.address - kv.first));
-		}
-		value &= var.mask;
-		return value;
+	size_t local;
+	const MemoryView<>* block = find(var.address, &local);
+	if (!block) {
+		throw std::out_of_range("No known mapping");
+	}
+	int64_t value;
+	if (m_overlay->width > 1) {
+		uint8_t fakeBase[16];
+		value = var.type.decode(m_overlay->parse(block->offset(0), local, reinterpret_cast<void*>(fakeBase), var.type.width));
+	} else {
+		value = var.type.decode(block->offset(local));
 	}
-	throw std::out_of_range("No known mapping");
+	value &= var.mask;
+	return value;
 }
 
 AddressSpace& AddressSpace::operator=(AddressSpace&& as) {
+	++m_generation;
 	m_blocks.clear();
 	m_overlay = move(as.m_overlay);
 	for (auto& kv : as.m_blocks) {
 		m_blocks[kv.first] = move(as.m_blocks[kv.first]);
 	}
 	as.m_blocks.clear();
+	as.rebuildSegments();
+	rebuildSegments();
 	return *this;
 }
 
@@ -6,6 +6,8 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <fcntl.h>
 #ifndef _WIN32
@@ -277,8 +279,8 @@ public:
 	bool operator==(const DataType&) const;
 	bool operator!=(const DataType&) const;
 
-	void encode(void* buffer, int64_t value) const;
-	int64_t decode(const void* buffer) const;
+	void encode(void* buffer, int64_t value) const { m_encode(*this, buffer, value); }
+	int64_t decode(const void* buffer) const { return m_decode(*this, buffer); }
 
 	const size_t width;
 	const Endian endian;
@@ -295,11 +297,20 @@ private:
 	FRIEND_TEST(DataTypeShift, 6);
 	FRIEND_TEST(DataTypeShift, 7);
 	FRIEND_TEST(DataTypeShift, 8);
+	FRIEND_TEST(DataTypeDecode, Generic);
+
+	static int64_t decodeGeneric(const DataType&, const void* buffer);
+	static void encodeGeneric(const DataType&, void* buffer, int64_t value);
 
 	const uint8_t maskLo;
 	const uint8_t maskHi;
 	const unsigned cvt;
 	int64_t shift[8]{};
+
+	// Picked at construction; plain integers and BCD in little or big endian
+	// get specialized versions, everything else uses the shift table
+	int64_t (*m_decode)(const DataType&, const void*) = &decodeGeneric;
+	void (*m_encode)(const DataType&, void*, int64_t) = &encodeGeneric;
 };
 
 struct Variable {
@@ -426,14 +437,25 @@ public:
 	bool hasBlock(size_t offset) const;
 	const MemoryView<>& block(size_t offset) const;
 	MemoryView<>& block(size_t offset);
+	// Returns the block mapping an address and sets offset to the address
+	// relative to the block, or returns nullptr if the address isn't mapped
+	const MemoryView<>* find(size_t address, size_t* offset) const;
+	MemoryView<>* find(size_t address, size_t* offset);
 
 	const std::map<size_t, MemoryView<>>& blocks() const { return m_blocks; }
 	std::map<size_t, MemoryView<>>& blocks() { return m_blocks; }
+	// Changes whenever blocks are added, replaced or removed
+	uint64_t generation() const { return m_generation; }
 
 	bool ok() const;
 	void reset();
 	void clone(const AddressSpace&);
 	void clone();
+	void swap(AddressSpace&);
+
+	// Copies [address, address + size) ranges from an address space with the
+	// same block layout. Returns false without copying if the layouts differ
+	bool copyRanges(const AddressSpace&, const std::vector<std::pair<size_t, size_t>>& ranges);
 
 	void setOverlay(const MemoryOverlay& overlay);
 	const MemoryOverlay& overlay() const { return *m_overlay; };
@@ -446,10 +468,24 @@ public:
 	AddressSpace& operator=(AddressSpace&&);
 
 private:
+	// A run of addresses served by one block. Where blocks overlap, the one
+	// with the lowest start wins
+	struct Segment {
+		size_t start;
+		size_t end;
+		size_t base;
+		MemoryView<>* block;
+	};
+
+	void rebuildSegments();
+
 	static const DataType s_type;
 	;
 	std::map<size_t, MemoryView<>> m_blocks;
+	// Sorted, non-overlapping translation table rebuilt whenever blocks change
+	std::vector<Segment> m_segments;
 	std::unique_ptr<MemoryOverlay> m_overlay = std::make_unique<MemoryOverlay>();
+	uint64_t m_generation = 0;
 };
 
 int64_t toBcd(int64_t);
@@ -45,6 +45,9 @@ static const unordered_map<char, string> s_buttonNames{
 	make_pair('r', "R"),
 };
 
+static const string s_keyframePrefix = "Keyframes/";
+static const string s_keyframeSuffix = ".bin";
+
 static const unordered_map<string, unordered_map<char, string>> s_platformButtonNames{
 	make_pair<string, unordered_map<char, string>>("Atari2600", {
 																	make_pair('B', "Button"),
@@ -97,21 +100,9 @@ MovieBK2::MovieBK2(unique_ptr<Zip> zip)
 		}
 	}
 
-	string tmp = m_log->readline();
-	if (tmp == "[Input]") {
-		tmp = m_log->readline();
-		size_t pos = 0;
-		string token;
-		while ((pos = tmp.find('|')) != std::string::npos) {
-			unsigned player = stoul(tmp.substr(1, 2));
-			if (player > m_players) {
-				m_players = player;
-			}
-			tmp.erase(0, pos + 1);
-		}
-	}
-
+	loadInputs();
 	loadState();
+	loadKeyframes();
 }
 
 MovieBK2::MovieBK2(const std::string& path, bool write, unsigned players)
@@ -125,7 +116,9 @@ MovieBK2::MovieBK2(const std::string& path, bool write, unsigned players)
 		headerText << "[Input]" << endl;
 		m_log->write(static_cast<const void*>(headerText.str().c_str()), headerText.str().size());
 	} else {
+		loadInputs();
 		loadState();
+		loadKeyframes();
 	}
 }
 
@@ -182,9 +175,17 @@ void MovieBK2::writeHeader() {
 	headerText << "rerecordCount 1" << endl;
 	header->write(static_cast<const void*>(headerText.str().c_str()), headerText.str().size());
 
+	m_buttonOrder.assign(m_buttonmap.begin(), m_buttonmap.end());
+	m_line.assign("|..|");
+	for (unsigned p = 0; p < m_players; ++p) {
+		m_line.append(m_buttonOrder.size(), '.');
+		m_line.push_back('|');
+	}
+	m_line.push_back('\n');
+
 	headerText.str("LogKey:#Reset|Power|#");
 	for (unsigned p = 1; p < m_players + 1; ++p) {
-		for (const auto& key : m_buttonmap) {
+		for (const auto& key : m_buttonOrder) {
 			if (s_platformButtonNames.find(m_coreName) != s_platformButtonNames.end()) {
 				const auto& platformButtons = s_platformButtonNames.at(m_coreName);
 				if (platformButtons.find(key.second) != platformButtons.end()) {
@@ -205,62 +206,79 @@ bool MovieBK2::step() {
 		return false;
 	}
 	if (m_write) {
+		++m_frame;
 		if (!m_headerWritten) {
 			writeHeader();
 		}
-		stringstream line;
-		line << "|..|";
+		char* column = &m_line[4];
 		for (unsigned i = 0; i < m_players; ++i) {
-			for (const auto& key : m_buttonmap) {
-				if (m_keys[i] & (1 << key.first)) {
-					line << key.second;
-				} else {
-					line << '.';
-				}
+			for (const auto& key : m_buttonOrder) {
+				*column++ = (m_keys[i] & (1 << key.first)) ? key.second : '.';
 			}
 			m_keys[i] = 0;
-			line << '|';
+			++column;
 		}
-		line << endl;
-		m_log->write(static_cast<const void*>(line.str().c_str()), line.str().size());
+		m_log->write(static_cast<const void*>(m_line.data()), m_line.size());
 		return true;
-	} else {
-		string tmp = m_log->readline();
-		while (tmp.size() && tmp[0] != '|') {
-			tmp = m_log->readline();
-		}
-		if (!tmp.size()) {
+	}
+	if (m_frame >= frameCount()) {
+		return false;
+	}
+	for (unsigned i = 0; i < m_players; ++i) {
+		m_keys[i] = m_inputs[m_frame * m_players + i];
+	}
+	++m_frame;
+	return true;
+}
+
+size_t MovieBK2::frameCount() const {
+	if (m_write) {
+		return m_frame;
+	}
+	return m_inputs.size() / m_players;
+}
+
+void MovieBK2::addKeyframe(const uint8_t* state, size_t size) {
+	if (!m_write || !m_zip) {
+		return;
+	}
+	Zip::File* keyframe = m_zip->openFile(s_keyframePrefix + to_string(m_frame) + s_keyframeSuffix, true);
+	if (keyframe) {
+		keyframe->write(state, size);
+	}
+}
+
+bool MovieBK2::seek(size_t frame, Emulator& emulator) {
+	if (m_write || !m_zip || frame > frameCount()) {
+		return false;
+	}
+	size_t start = 0;
+	vector<uint8_t> keyframe;
+	const vector<uint8_t>* state = &m_state;
+	auto found = m_keyframes.upper_bound(frame);
+	if (found != m_keyframes.begin()) {
+		--found;
+		if (!m_zip->readFile(found->second, &keyframe)) {
 			return false;
 		}
-		auto iter = tmp.begin();
-		if (*iter == '|') {
-			++iter;
-			while (iter != tmp.end() && *iter != '|') {
-				// Ignore commands
-				++iter;
-			}
-			if (iter == tmp.end()) {
-				return false;
-			}
-			for (unsigned i = 0; i < m_players; ++i) {
-				m_keys[i] = 0;
-				++iter;
-				while (iter != tmp.end() && *iter != '|') {
-					if (*iter == '.') {
-						++iter;
-						continue;
-					}
-					auto found = m_keymap.find(*iter);
-					if (found != m_keymap.end()) {
-						m_keys[i] |= 1 << found->second;
-					}
-					++iter;
-				}
+		start = found->first;
+		state = &keyframe;
+	}
+	if (state->empty() || !emulator.unserialize(state->data(), state->size())) {
+		return false;
+	}
+	for (size_t f = start; f < frame; ++f) {
+		for (unsigned p = 0; p < m_players; ++p) {
+			uint16_t mask = m_inputs[f * m_players + p];
+			for (int key = 0; key < N_BUTTONS; ++key) {
+				emulator.setKey(p, key, (mask >> key) & 1);
 			}
-			return true;
 		}
+		emulator.run();
 	}
-	return false;
+	m_frame = frame;
+	memset(m_keys, 0, sizeof(m_keys));
+	return true;
 }
 
 void MovieBK2::close() {
@@ -293,6 +311,69 @@ void MovieBK2::setState(const uint8_t* state, size_t size) {
 	memcpy(m_state.data(), state, size);
 }
 
+void MovieBK2::loadInputs() {
+	m_inputs.clear();
+	m_frame = 0;
+	string tmp = m_log->readline();
+	if (tmp == "[Input]") {
+		tmp = m_log->readline();
+		size_t pos = 0;
+		while ((pos = tmp.find('|')) != std::string::npos) {
+			unsigned player = stoul(tmp.substr(1, 2));
+			if (player > m_players) {
+				m_players = player;
+			}
+			tmp.erase(0, pos + 1);
+		}
+	}
+
+	while (true) {
+		tmp = m_log->readline();
+		while (tmp.size() && tmp[0] != '|') {
+			tmp = m_log->readline();
+		}
+		if (!tmp.size()) {
+			break;
+		}
+		auto iter = tmp.begin() + 1;
+		while (iter != tmp.end() && *iter != '|') {
+			// Ignore commands
+			++iter;
+		}
+		if (iter == tmp.end()) {
+			break;
+		}
+		for (unsigned i = 0; i < m_players; ++i) {
+			uint16_t keys = 0;
+			if (iter != tmp.end()) {
+				++iter;
+			}
+			while (iter != tmp.end() && *iter != '|') {
+				auto found = m_keymap.find(*iter);
+				if (*iter != '.' && found != m_keymap.end()) {
+					keys |= 1 << found->second;
+				}
+				++iter;
+			}
+			m_inputs.push_back(keys);
+		}
+	}
+}
+
+void MovieBK2::loadKeyframes() {
+	m_keyframes.clear();
+	for (const auto& name : m_zip->list()) {
+		if (name.size() <= s_keyframePrefix.size() + s_keyframeSuffix.size() || name.compare(0, s_keyframePrefix.size(), s_keyframePrefix) || name.compare(name.size() - s_keyframeSuffix.size(), s_keyframeSuffix.size(), s_keyframeSuffix)) {
+			continue;
+		}
+		string frame = name.substr(s_keyframePrefix.size(), name.size() - s_keyframePrefix.size() - s_keyframeSuffix.size());
+		if (frame.find_first_not_of("0123456789") != string::npos) {
+			continue;
+		}
+		m_keyframes[stoull(frame)] = name;
+	}
+}
+
 void MovieBK2::loadState() {
 	Zip::File* state = m_zip->openFile("Core.bin");
 	if (!state) {
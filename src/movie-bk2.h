@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <unordered_map>
 #include <vector>
 
@@ -29,15 +30,31 @@ public:
 	virtual bool getState(std::vector<uint8_t>*) const override;
 	virtual void setState(const uint8_t*, size_t) override;
 
+	// Store a state to seek to, taken before the next recorded frame
+	void addKeyframe(const uint8_t*, size_t);
+	virtual bool seek(size_t frame, Emulator&) override;
+	virtual size_t frame() const override { return m_frame; }
+	virtual size_t frameCount() const override;
+
 private:
+	void loadInputs();
 	void loadState();
+	void loadKeyframes();
 
 	std::unique_ptr<Zip> m_zip;
 	Zip::File* m_log;
 	std::vector<uint8_t> m_state;
 
+	// Playback input is parsed up front into a key mask per player per frame
+	std::vector<uint16_t> m_inputs;
+	std::map<size_t, std::string> m_keyframes;
+	size_t m_frame = 0;
+
 	std::unordered_map<char, int> m_keymap;
 	std::unordered_map<int, char> m_buttonmap;
+	// Buttons in the order the log columns are written, and the line they're written into
+	std::vector<std::pair<int, char>> m_buttonOrder;
+	std::string m_line;
 	bool m_write = false;
 
 	bool m_headerWritten = false;
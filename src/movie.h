@@ -22,6 +22,13 @@ public:
 	virtual bool getState(std::vector<uint8_t>*) const { return false; }
 	virtual void setState(const uint8_t*, size_t) {}
 
+	// Restore the emulator to its state before the given frame, from the
+	// nearest stored state at or before it, so the next step() reads that
+	// frame's input. Returns false if the movie can't seek there
+	virtual bool seek(size_t, Emulator&) { return false; }
+	virtual size_t frame() const { return 0; }
+	virtual size_t frameCount() const { return 0; }
+
 	bool getKey(int, unsigned player = 0);
 	void setKey(int key, bool, unsigned player = 0);
 
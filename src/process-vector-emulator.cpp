@@ -0,0 +1,545 @@
+#include "process-vector-emulator.h"
+
+#include "data.h"
+#include "script.h"
+#include "vector-emulator.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+using namespace std;
+using namespace Retro;
+
+namespace {
+enum Command : uint32_t {
+	COMMAND_NONE,
+	COMMAND_MAP,
+	COMMAND_RESET,
+	COMMAND_STEP,
+	COMMAND_QUIT,
+};
+
+// How long to block on a channel before checking that the other side is alive
+const int POLL_TIMEOUT_MS = 1000;
+
+size_t align(size_t bytes) {
+	return (bytes + 63) & ~size_t(63);
+}
+}
+
+struct alignas(64) ProcessVectorEmulator::Control {
+	// Written by the parent
+	uint32_t command;
+	uint32_t slot;
+	uint32_t filterActions;
+	uint16_t masks[MAX_PLAYERS];
+
+	// Written by the worker
+	int32_t status;
+	int32_t width;
+	int32_t height;
+	uint32_t buttons;
+	uint64_t ramSize;
+	char error[256];
+};
+
+ProcessVectorEmulator::ProcessVectorEmulator(size_t numEnvs, size_t depth)
+	: m_numEnvs(numEnvs)
+	, m_depth(depth ? depth : 1) {
+}
+
+ProcessVectorEmulator::~ProcessVectorEmulator() {
+	stop();
+}
+
+#ifdef _WIN32
+bool ProcessVectorEmulator::start(const string&, const string&, const string&, const vector<uint8_t>&) {
+	m_error = "ProcessVectorEmulator is not supported on Windows";
+	return false;
+}
+
+void ProcessVectorEmulator::stop() {
+}
+
+void ProcessVectorEmulator::send(size_t, uint32_t) {
+}
+
+bool ProcessVectorEmulator::receive(size_t) {
+	return false;
+}
+
+void ProcessVectorEmulator::workerMain(size_t, const string&, const string&, const string&, const vector<uint8_t>&) {
+}
+#else
+static bool openChannel(int* read, int* write) {
+#ifdef __linux__
+	int fd = eventfd(0, EFD_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	*read = fd;
+	*write = fd;
+#else
+	int fds[2];
+	if (pipe(fds) < 0) {
+		return false;
+	}
+	*read = fds[0];
+	*write = fds[1];
+#endif
+	return true;
+}
+
+static void closeChannel(int* read, int* write) {
+	if (*read >= 0) {
+		close(*read);
+	}
+	if (*write >= 0 && *write != *read) {
+		close(*write);
+	}
+	*read = -1;
+	*write = -1;
+}
+
+static void notify(int fd) {
+#ifdef __linux__
+	uint64_t value = 1;
+#else
+	uint8_t value = 1;
+#endif
+	while (write(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+	}
+}
+
+// Returns 1 once notified, 0 on timeout and -1 on error
+static int waitFor(int fd) {
+	pollfd pfd{ fd, POLLIN, 0 };
+	int ready = poll(&pfd, 1, POLL_TIMEOUT_MS);
+	if (ready < 0) {
+		return errno == EINTR ? 0 : -1;
+	}
+	if (!ready) {
+		return 0;
+	}
+#ifdef __linux__
+	uint64_t value;
+#else
+	uint8_t value;
+#endif
+	if (read(fd, &value, sizeof(value)) < 0) {
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+	}
+	return 1;
+}
+
+static string ringDirectory() {
+	if (access("/dev/shm", W_OK) == 0) {
+		return "/dev/shm";
+	}
+	const char* tmpdir = getenv("TMPDIR");
+	return tmpdir && *tmpdir ? tmpdir : "/tmp";
+}
+
+bool ProcessVectorEmulator::start(const string& romPath, const string& dataPath, const string& scenarioPath, const vector<uint8_t>& state) {
+	if (!m_workers.empty()) {
+		stop();
+	}
+	m_error.clear();
+	if (!m_numEnvs) {
+		m_error = "No environments requested";
+		return false;
+	}
+
+	m_control.open(m_numEnvs * sizeof(Control));
+	m_ringPath = ringDirectory() + "/stable-retro-ring-XXXXXX";
+	int fd = mkstemp(&m_ringPath[0]);
+	if (fd < 0) {
+		m_ringPath.clear();
+		m_error = "Could not create shared memory ring";
+		return false;
+	}
+	::close(fd);
+
+	m_commands.resize(m_numEnvs);
+	m_responses.resize(m_numEnvs);
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		if (!openChannel(&m_commands[i].read, &m_commands[i].write) || !openChannel(&m_responses[i].read, &m_responses[i].write)) {
+			m_error = "Could not create worker channels";
+			stop();
+			return false;
+		}
+	}
+
+	m_parent = getpid();
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			m_error = "Could not start worker process";
+			stop();
+			return false;
+		}
+		if (pid == 0) {
+			try {
+				workerMain(i, romPath, dataPath, scenarioPath, state);
+			} catch (...) {
+				_exit(1);
+			}
+			_exit(0);
+		}
+		m_workers.push_back(pid);
+	}
+
+	// Workers report their geometry once the game is loaded; the ring can only
+	// be sized after that
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		if (!receive(i)) {
+			stop();
+			return false;
+		}
+		const Control& reply = control(i);
+		if (reply.status < 0) {
+			m_error = reply.error;
+			stop();
+			return false;
+		}
+		if (i == 0) {
+			m_width = reply.width;
+			m_height = reply.height;
+			m_buttons = reply.buttons;
+			m_ramSize = reply.ramSize;
+		} else if (reply.width != m_width || reply.height != m_height || reply.ramSize != m_ramSize) {
+			m_error = "Workers disagree on screen or memory size";
+			stop();
+			return false;
+		}
+	}
+
+	if (!m_ring.open(m_ringPath, slotSize() * m_depth)) {
+		m_error = "Could not map shared memory ring";
+		stop();
+		return false;
+	}
+	if (broadcast(COMMAND_MAP) == SIZE_MAX) {
+		stop();
+		return false;
+	}
+	// Every process has the ring mapped now, so the name is no longer needed
+	unlink(m_ringPath.c_str());
+	m_ringPath.clear();
+	return true;
+}
+
+void ProcessVectorEmulator::stop() {
+	for (size_t i = 0; i < m_workers.size(); ++i) {
+		if (m_workers[i] > 0) {
+			send(i, COMMAND_QUIT);
+		}
+	}
+	for (size_t i = 0; i < m_workers.size(); ++i) {
+		if (m_workers[i] > 0) {
+			int status;
+			while (waitpid(m_workers[i], &status, 0) < 0 && errno == EINTR) {
+			}
+		}
+	}
+	m_workers.clear();
+	for (auto& channel : m_commands) {
+		closeChannel(&channel.read, &channel.write);
+	}
+	for (auto& channel : m_responses) {
+		closeChannel(&channel.read, &channel.write);
+	}
+	m_commands.clear();
+	m_responses.clear();
+	// The ring stays mapped for views of the last results; start() and the
+	// destructor replace or release it
+	if (!m_ringPath.empty()) {
+		unlink(m_ringPath.c_str());
+		m_ringPath.clear();
+	}
+	m_next = 0;
+	m_pending = 0;
+	m_stepping = false;
+}
+
+void ProcessVectorEmulator::send(size_t env, uint32_t command) {
+	control(env).command = command;
+	notify(m_commands[env].write);
+}
+
+bool ProcessVectorEmulator::receive(size_t env) {
+	while (true) {
+		int result = waitFor(m_responses[env].read);
+		if (result > 0) {
+			return true;
+		}
+		// Only ever poll this worker's own pid: waitpid(0) would reap siblings or
+		// unrelated children of the host process
+		int status;
+		if (m_workers[env] <= 0) {
+			m_error = "Worker process is not running";
+			return false;
+		}
+		if (result < 0 || waitpid(m_workers[env], &status, WNOHANG) == m_workers[env]) {
+			m_workers[env] = 0;
+			m_error = "Worker process exited unexpectedly";
+			return false;
+		}
+	}
+}
+
+void ProcessVectorEmulator::workerMain(size_t env, const string& romPath, const string& dataPath, const string& scenarioPath, const vector<uint8_t>& state) {
+	Control& ctl = control(env);
+	auto fail = [this, &ctl, env](const string& error) {
+		strncpy(ctl.error, error.c_str(), sizeof(ctl.error) - 1);
+		ctl.status = -1;
+		notify(m_responses[env].write);
+		_exit(1);
+	};
+
+	// Script contexts inherited from the parent point at its game data
+	ScriptContext::reset();
+
+	Emulator emulator;
+	GameData data;
+	Scenario scenario(data);
+	emulator.setAudioEnabled(false);
+	if (!emulator.loadRom(romPath)) {
+		fail("Could not load ROM");
+	}
+	emulator.configureData(&data);
+	if (!dataPath.empty() && !data.load(dataPath)) {
+		fail("Could not load data");
+	}
+	if (!scenarioPath.empty() && !scenario.load(scenarioPath)) {
+		fail("Could not load scenario");
+	}
+	emulator.run();
+
+	size_t ramSize = 0;
+	for (const auto& block : data.addressSpace().blocks()) {
+		ramSize += block.second.size();
+	}
+	ctl.width = emulator.getImageWidth();
+	ctl.height = emulator.getImageHeight();
+	ctl.buttons = emulator.buttons().size();
+	ctl.ramSize = ramSize;
+	ctl.status = 0;
+	m_width = ctl.width;
+	m_height = ctl.height;
+	m_ramSize = ramSize;
+	notify(m_responses[env].write);
+
+	size_t frameSize = static_cast<size_t>(ctl.width) * ctl.height * 3;
+	while (true) {
+		int result = waitFor(m_commands[env].read);
+		if (result < 0) {
+			_exit(1);
+		}
+		if (!result) {
+			if (getppid() != m_parent) {
+				_exit(0);
+			}
+			continue;
+		}
+
+		switch (ctl.command) {
+		case COMMAND_MAP:
+			if (!m_ring.open(m_ringPath)) {
+				fail("Could not map shared memory ring");
+			}
+			break;
+		case COMMAND_RESET:
+			if (!state.empty()) {
+				emulator.unserialize(state.data(), state.size());
+			}
+			for (int player = 0; player < MAX_PLAYERS; ++player) {
+				for (int key = 0; key < N_BUTTONS; ++key) {
+					emulator.setKey(player, key, false);
+				}
+			}
+			emulator.run();
+			scenario.restart();
+			scenario.reloadScripts();
+			data.updateRam();
+			scenario.update();
+			break;
+		case COMMAND_STEP:
+			for (int player = 0; player < MAX_PLAYERS; ++player) {
+				unsigned mask = ctl.masks[player];
+				if (ctl.filterActions) {
+					mask = scenario.filterAction(mask);
+				}
+				for (int key = 0; key < N_BUTTONS; ++key) {
+					emulator.setKey(player, key, (mask >> key) & 1);
+				}
+			}
+			emulator.run();
+			data.updateRam();
+			scenario.update();
+			break;
+		case COMMAND_QUIT:
+			_exit(0);
+		default:
+			break;
+		}
+
+		if (ctl.command == COMMAND_RESET || ctl.command == COMMAND_STEP) {
+			// The ring was sized from the geometry reported at start, so anything
+			// larger would spill into other environments' rows
+			if (emulator.getImageWidth() != m_width || emulator.getImageHeight() != m_height) {
+				fail("Screen size changed");
+			}
+			ramSize = 0;
+			for (const auto& block : data.addressSpace().blocks()) {
+				ramSize += block.second.size();
+			}
+			if (ramSize != m_ramSize) {
+				fail("Memory size changed");
+			}
+			try {
+				uint8_t* frames = const_cast<uint8_t*>(this->frames(ctl.slot));
+				VectorEmulator::copyScreen(emulator, &frames[env * frameSize]);
+				uint8_t* ram = const_cast<uint8_t*>(this->ram(ctl.slot)) + env * m_ramSize;
+				for (const auto& block : data.addressSpace().blocks()) {
+					memcpy(ram, block.second.offset(0), block.second.size());
+					ram += block.second.size();
+				}
+				const_cast<float*>(rewards(ctl.slot))[env] = scenario.currentReward();
+				const_cast<bool*>(dones(ctl.slot))[env] = scenario.isDone();
+			} catch (const exception& e) {
+				fail(e.what());
+			}
+		}
+		ctl.status = 0;
+		notify(m_responses[env].write);
+	}
+}
+#endif
+
+size_t ProcessVectorEmulator::broadcast(uint32_t command) {
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		control(i).slot = m_next;
+		send(i, command);
+	}
+	// A failed worker leaves the others' replies unread, so the whole pool is
+	// torn down rather than left out of step
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		if (!receive(i)) {
+			stop();
+			return SIZE_MAX;
+		}
+		if (control(i).status < 0) {
+			m_error = control(i).error;
+			stop();
+			return SIZE_MAX;
+		}
+	}
+	return m_next;
+}
+
+size_t ProcessVectorEmulator::reset() {
+	if (m_workers.empty()) {
+		throw runtime_error("ProcessVectorEmulator is not running");
+	}
+	if (m_stepping) {
+		stepWait();
+	}
+	size_t slot = broadcast(COMMAND_RESET);
+	if (slot == SIZE_MAX) {
+		throw runtime_error(m_error);
+	}
+	m_next = (m_next + 1) % m_depth;
+	return slot;
+}
+
+void ProcessVectorEmulator::stepAsync(const uint16_t* masks, bool filterActions) {
+	if (m_workers.empty()) {
+		throw runtime_error("ProcessVectorEmulator is not running");
+	}
+	if (m_stepping) {
+		throw runtime_error("A step is already in progress");
+	}
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		Control& ctl = control(i);
+		ctl.slot = m_next;
+		ctl.filterActions = filterActions;
+		memcpy(ctl.masks, &masks[i * MAX_PLAYERS], sizeof(ctl.masks));
+		send(i, COMMAND_STEP);
+	}
+	m_pending = m_next;
+	m_stepping = true;
+}
+
+size_t ProcessVectorEmulator::stepWait() {
+	if (!m_stepping) {
+		throw runtime_error("No step is in progress");
+	}
+	m_stepping = false;
+	for (size_t i = 0; i < m_numEnvs; ++i) {
+		if (!receive(i)) {
+			stop();
+			throw runtime_error(m_error);
+		}
+		if (control(i).status < 0) {
+			m_error = control(i).error;
+			stop();
+			throw runtime_error(m_error);
+		}
+	}
+	m_next = (m_next + 1) % m_depth;
+	return m_pending;
+}
+
+size_t ProcessVectorEmulator::step(const uint16_t* masks, bool filterActions) {
+	stepAsync(masks, filterActions);
+	return stepWait();
+}
+
+ProcessVectorEmulator::Control& ProcessVectorEmulator::control(size_t env) {
+	return static_cast<Control*>(m_control.offset(0))[env];
+}
+
+// Each slot holds every environment's frame, RAM, reward and done flag
+// back to back so that they can be viewed as contiguous arrays
+size_t ProcessVectorEmulator::slotSize() const {
+	size_t frameSize = static_cast<size_t>(m_width) * m_height * 3;
+	return align(m_numEnvs * frameSize) + align(m_numEnvs * m_ramSize) + align(m_numEnvs * sizeof(float)) + align(m_numEnvs * sizeof(bool));
+}
+
+uint8_t* ProcessVectorEmulator::slot(size_t index) {
+	return static_cast<uint8_t*>(m_ring.offset(index * slotSize()));
+}
+
+const uint8_t* ProcessVectorEmulator::slot(size_t index) const {
+	return static_cast<const uint8_t*>(m_ring.offset(index * slotSize()));
+}
+
+const uint8_t* ProcessVectorEmulator::frames(size_t index) const {
+	return slot(index);
+}
+
+const uint8_t* ProcessVectorEmulator::ram(size_t index) const {
+	size_t frameSize = static_cast<size_t>(m_width) * m_height * 3;
+	return slot(index) + align(m_numEnvs * frameSize);
+}
+
+const float* ProcessVectorEmulator::rewards(size_t index) const {
+	return reinterpret_cast<const float*>(ram(index) + align(m_numEnvs * m_ramSize));
+}
+
+const bool* ProcessVectorEmulator::dones(size_t index) const {
+	return reinterpret_cast<const bool*>(reinterpret_cast<const uint8_t*>(rewards(index)) + align(m_numEnvs * sizeof(float)));
+}
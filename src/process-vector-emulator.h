@@ -0,0 +1,84 @@
+#pragma once
+
+#include "emulator.h"
+#include "memory.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Retro {
+
+// Runs one emulator, game data and scenario per worker process. Workers write
+// frames, RAM, rewards and done flags into a shared memory ring of depth slots
+// that the parent reads in place; each step fills the next slot
+class ProcessVectorEmulator {
+public:
+	ProcessVectorEmulator(size_t numEnvs, size_t depth = 2);
+	~ProcessVectorEmulator();
+	ProcessVectorEmulator(const ProcessVectorEmulator&) = delete;
+
+	bool start(const std::string& romPath, const std::string& dataPath = {}, const std::string& scenarioPath = {}, const std::vector<uint8_t>& state = {});
+	// Stops the workers. The last results stay readable until the next start()
+	// or destruction
+	void stop();
+	const std::string& error() const { return m_error; }
+
+	size_t reset();
+
+	// masks holds numEnvs() rows of MAX_PLAYERS button masks
+	void stepAsync(const uint16_t* masks, bool filterActions);
+	size_t stepWait();
+	size_t step(const uint16_t* masks, bool filterActions);
+
+	size_t numEnvs() const { return m_numEnvs; }
+	size_t depth() const { return m_depth; }
+	size_t numButtons() const { return m_buttons; }
+	int screenWidth() const { return m_width; }
+	int screenHeight() const { return m_height; }
+	size_t ramSize() const { return m_ramSize; }
+
+	const uint8_t* frames(size_t slot) const;
+	const uint8_t* ram(size_t slot) const;
+	const float* rewards(size_t slot) const;
+	const bool* dones(size_t slot) const;
+
+private:
+	struct Control;
+	struct Channel {
+		int read = -1;
+		int write = -1;
+	};
+
+	Control& control(size_t env);
+	size_t slotSize() const;
+	uint8_t* slot(size_t index);
+	const uint8_t* slot(size_t index) const;
+
+	void send(size_t env, uint32_t command);
+	bool receive(size_t env);
+	size_t broadcast(uint32_t command);
+
+	void workerMain(size_t env, const std::string& romPath, const std::string& dataPath, const std::string& scenarioPath, const std::vector<uint8_t>& state);
+
+	size_t m_numEnvs;
+	size_t m_depth;
+	size_t m_next = 0;
+	size_t m_pending = 0;
+	bool m_stepping = false;
+
+	size_t m_buttons = 0;
+	int m_width = 0;
+	int m_height = 0;
+	size_t m_ramSize = 0;
+
+	MemoryView<> m_control;
+	MemoryView<> m_ring;
+	std::string m_ringPath;
+	std::vector<Channel> m_commands;
+	std::vector<Channel> m_responses;
+	std::vector<int> m_workers;
+	int m_parent = 0;
+	std::string m_error;
+};
+}
@@ -17,9 +17,13 @@ static inline T _hypot(T x, T y) {
 #include "imageops.h"
 #include "memory.h"
 #include "search.h"
+#include "action-table.h"
 #include "script.h"
+#include "state-pool.h"
 #include "movie.h"
 #include "movie-bk2.h"
+#include "process-vector-emulator.h"
+#include "vector-emulator.h"
 
 #include <map>
 #include <unordered_map>
@@ -34,10 +38,19 @@ struct PyGameData;
 struct PyRetroEmulator {
 	Retro::Emulator m_re;
 	int m_cheats = 0;
+	py::array_t<uint8_t> m_screenBuffer;
+	size_t m_screenCrop[4]{};
+	bool m_screenRotate = false;
+	bool m_hasScreenBuffer = false;
+	ImagePipeline m_pipeline;
+	std::vector<uint8_t> m_observation;
+	size_t m_observationSize[2]{};
+	bool m_hasPipeline = false;
+	Retro::StatePool m_states;
+	size_t m_slotViews = 0;
+	size_t m_audioViews = 0;
+	Retro::ActionTable m_actions;
 	PyRetroEmulator(const string& rom_path) {
-		if (Emulator::isLoaded()) {
-			throw std::runtime_error("Cannot create multiple emulator instances per process, make sure to call env.close() on each environment before creating a new one");
-		}
 		if (!m_re.loadRom(rom_path.c_str())) {
 			throw std::runtime_error("Could not load ROM");
 		}
@@ -46,6 +59,12 @@ struct PyRetroEmulator {
 
 	void step() {
 		m_re.run();
+		if (m_hasScreenBuffer) {
+			renderScreen(m_screenBuffer.mutable_data(), m_screenCrop[0], m_screenCrop[1], m_screenCrop[2], m_screenCrop[3], m_screenRotate);
+		}
+		if (m_hasPipeline) {
+			processObservation();
+		}
 	}
 
 	py::bytes getState() {
@@ -55,16 +74,66 @@ struct PyRetroEmulator {
 		return bytes;
 	}
 
-	bool setState(py::bytes o) {
-		return m_re.unserialize(PyBytes_AsString(o.ptr()), PyBytes_Size(o.ptr()));
+	bool setState(py::buffer o) {
+		py::buffer_info info = o.request();
+		m_pipeline.reset();
+		return m_re.unserialize(info.ptr, info.size * info.itemsize);
 	}
 
-	py::array_t<uint8_t> getScreen() {
-		long w = m_re.getImageWidth();
-		long h = m_re.getImageHeight();
-		py::array_t<uint8_t> arr({ { h, w, 3 } });
-		uint8_t* data = arr.mutable_data();
-		Image out(Image::Format::RGB888, data, w, h, w);
+	void allocateSlots(size_t slots) {
+		if (m_slotViews) {
+			throw std::runtime_error("Cannot reallocate slots while slot views are alive");
+		}
+		if (!m_states.allocate(m_re, slots)) {
+			throw std::runtime_error("Core does not support savestates");
+		}
+	}
+
+	void checkSlot(size_t slot) const {
+		if (slot >= m_states.numSlots()) {
+			throw py::index_error("slot is out of range");
+		}
+	}
+
+	void saveSlot(size_t slot) {
+		checkSlot(slot);
+		if (!m_states.save(m_re, slot)) {
+			throw std::runtime_error("Could not save state");
+		}
+	}
+
+	void loadSlot(size_t slot) {
+		checkSlot(slot);
+		if (!m_states.stateSize(slot)) {
+			throw std::runtime_error("State slot is empty");
+		}
+		m_pipeline.reset();
+		if (!m_states.load(m_re, slot)) {
+			throw std::runtime_error("Could not load state");
+		}
+	}
+
+	// Read-only view of a slot; it is overwritten by the next save_slot. The
+	// view keeps the emulator alive, and allocate_slots refuses to free the
+	// arena while any view is
+	py::array_t<uint8_t> slotView(size_t slot) {
+		checkSlot(slot);
+		py::capsule base(new py::object(py::cast(this)), [](void* p) {
+			py::object* self = static_cast<py::object*>(p);
+			--self->cast<PyRetroEmulator&>().m_slotViews;
+			delete self;
+		});
+		++m_slotViews;
+		py::array_t<uint8_t> view(m_states.stateSize(slot), m_states.slot(slot), base);
+		py::detail::array_proxy(view.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+		return view;
+	}
+
+	size_t numSlots() const {
+		return m_states.numSlots();
+	}
+
+	Image screenImage() {
 		const void* img = m_re.getImageData();
 		if (!img) {
 			// Some cores (notably N64) can take a number of frames before the first CPU framebuffer is produced.
@@ -80,15 +149,170 @@ struct PyRetroEmulator {
 				"For N64/parallel_n64, try forcing a software renderer (parallel-n64-gfxplugin=angrylion)."
 			);
 		}
-		Image in;
+		long w = m_re.getImageWidth();
+		long h = m_re.getImageHeight();
 		if (m_re.getImageDepth() == 16) {
-			in = Image(Image::Format::RGB565, img, w, h, m_re.getImagePitch());
+			return Image(Image::Format::RGB565, img, w, h, m_re.getImagePitch());
 		} else if (m_re.getImageDepth() == 32) {
-			in = Image(Image::Format::RGBX888, img, w, h, m_re.getImagePitch());
+			return Image(Image::Format::RGBX888, img, w, h, m_re.getImagePitch());
+		} else if (m_re.getImageDepth() == 8) {
+			return Image(Image::Format::G8, img, w, h, m_re.getImagePitch());
+		}
+		throw std::runtime_error("Unsupported image depth from core");
+	}
+
+	// Takes an (x, y, width, height) tuple as returned by GameData.crop_info; a
+	// zero or out of bounds size extends the crop to the edge of the screen
+	void cropRect(py::handle crop, size_t* x, size_t* y, size_t* w, size_t* h) {
+		size_t width = m_re.getImageWidth();
+		size_t height = m_re.getImageHeight();
+		*x = 0;
+		*y = 0;
+		*w = width;
+		*h = height;
+		if (crop.is_none()) {
+			return;
+		}
+		py::sequence rect = py::reinterpret_borrow<py::sequence>(crop);
+		if (rect.size() != 4) {
+			throw std::runtime_error("crop must be an (x, y, width, height) tuple");
+		}
+		*x = std::min(rect[0].cast<size_t>(), width);
+		*y = std::min(rect[1].cast<size_t>(), height);
+		size_t cw = rect[2].cast<size_t>();
+		size_t ch = rect[3].cast<size_t>();
+		*w = cw && *x + cw <= width ? cw : width - *x;
+		*h = ch && *y + ch <= height ? ch : height - *y;
+	}
+
+	void renderScreen(uint8_t* data, size_t x, size_t y, size_t w, size_t h, bool rotate) {
+		Image in = screenImage();
+		if (x || y || w != static_cast<size_t>(m_re.getImageWidth()) || h != static_cast<size_t>(m_re.getImageHeight())) {
+			in = in.crop(x, y, w, h);
+		}
+		int steps = rotate ? m_re.getRotation() & 3 : 0;
+		if (steps & 1) {
+			Image out(Image::Format::RGB888, data, h, w, h);
+			in.rotateTo(&out, steps);
 		} else {
-			throw std::runtime_error("Unsupported image depth from core");
+			Image out(Image::Format::RGB888, data, w, h, w);
+			in.rotateTo(&out, steps);
 		}
-		in.copyTo(&out);
+	}
+
+	py::array_t<uint8_t> getScreen(py::object out, py::object crop, bool rotate) {
+		// Fetch the image first so that slow-starting cores have settled on a resolution
+		screenImage();
+		size_t x, y, w, h;
+		cropRect(crop, &x, &y, &w, &h);
+		long rows = h;
+		long cols = w;
+		if (rotate && (m_re.getRotation() & 1)) {
+			std::swap(rows, cols);
+		}
+		py::array_t<uint8_t> arr;
+		if (out.is_none()) {
+			arr = py::array_t<uint8_t>({ rows, cols, 3L });
+		} else {
+			arr = checkScreenBuffer(out, rows, cols);
+		}
+		renderScreen(arr.mutable_data(), x, y, w, h, rotate);
+		return arr;
+	}
+
+	static py::array_t<uint8_t> checkScreenBuffer(py::object buffer, long rows, long cols, long channels = 3) {
+		if (!py::isinstance<py::array_t<uint8_t>>(buffer)) {
+			throw std::runtime_error("Screen buffer must be a uint8 numpy array");
+		}
+		py::array_t<uint8_t> arr = py::reinterpret_borrow<py::array_t<uint8_t>>(buffer);
+		if (!(arr.flags() & py::array::c_style) || !arr.writeable()) {
+			throw std::runtime_error("Screen buffer must be C-contiguous and writeable");
+		}
+		if (arr.ndim() != 3 || arr.shape(0) != rows || arr.shape(1) != cols || arr.shape(2) != channels) {
+			throw std::runtime_error("Screen buffer has the wrong shape");
+		}
+		return arr;
+	}
+
+	// Registers an array that every later step() renders the screen into
+	void setScreenBuffer(py::object buffer, py::object crop, bool rotate) {
+		if (buffer.is_none()) {
+			m_screenBuffer = py::array_t<uint8_t>();
+			m_hasScreenBuffer = false;
+			return;
+		}
+		screenImage();
+		cropRect(crop, &m_screenCrop[0], &m_screenCrop[1], &m_screenCrop[2], &m_screenCrop[3]);
+		long rows = m_screenCrop[3];
+		long cols = m_screenCrop[2];
+		if (rotate && (m_re.getRotation() & 1)) {
+			std::swap(rows, cols);
+		}
+		m_screenBuffer = checkScreenBuffer(buffer, rows, cols);
+		m_screenRotate = rotate;
+		m_hasScreenBuffer = true;
+		renderScreen(m_screenBuffer.mutable_data(), m_screenCrop[0], m_screenCrop[1], m_screenCrop[2], m_screenCrop[3], m_screenRotate);
+	}
+
+	void processObservation() {
+		Image in = screenImage();
+		size_t w, h;
+		m_pipeline.outputSize(m_re.getImageWidth(), m_re.getImageHeight(), &w, &h);
+		m_observation.resize(w * h * m_pipeline.channels());
+		m_pipeline.process(in, m_observation.data());
+		m_observationSize[0] = w;
+		m_observationSize[1] = h;
+	}
+
+	// Runs crop, rotation, color conversion, resizing and max-pooling natively
+	// after every step(); pass no arguments besides crop to get plain RGB
+	void configureObservation(py::object crop, bool rotate, bool gray, py::object size, bool max_pool) {
+		ImagePipeline::Config config;
+		if (!crop.is_none()) {
+			py::sequence rect = py::reinterpret_borrow<py::sequence>(crop);
+			if (rect.size() != 4) {
+				throw std::runtime_error("crop must be an (x, y, width, height) tuple");
+			}
+			config.cropX = rect[0].cast<size_t>();
+			config.cropY = rect[1].cast<size_t>();
+			config.cropWidth = rect[2].cast<size_t>();
+			config.cropHeight = rect[3].cast<size_t>();
+		}
+		if (!size.is_none()) {
+			py::sequence dims = py::reinterpret_borrow<py::sequence>(size);
+			if (dims.size() != 2) {
+				throw std::runtime_error("size must be a (width, height) tuple");
+			}
+			config.width = dims[0].cast<size_t>();
+			config.height = dims[1].cast<size_t>();
+		}
+		config.rotation = rotate ? m_re.getRotation() : 0;
+		config.gray = gray;
+		config.maxPool = max_pool;
+		m_pipeline.configure(config);
+		m_hasPipeline = true;
+		try {
+			processObservation();
+		} catch (...) {
+			m_hasPipeline = false;
+			throw;
+		}
+	}
+
+	py::array_t<uint8_t> getObservation(py::object out) {
+		if (!m_hasPipeline) {
+			throw std::runtime_error("configure_observation has not been called");
+		}
+		long rows = m_observationSize[1];
+		long cols = m_observationSize[0];
+		long channels = m_pipeline.channels();
+		py::array_t<uint8_t> arr;
+		if (out.is_none()) {
+			arr = py::array_t<uint8_t>({ rows, cols, channels });
+		} else {
+			arr = checkScreenBuffer(out, rows, cols, channels);
+		}
+		memcpy(arr.mutable_data(), m_observation.data(), m_observation.size());
 		return arr;
 	}
 
@@ -103,6 +327,70 @@ struct PyRetroEmulator {
 		return arr;
 	}
 
+	// Read-only view of the most recent samples in the audio ring. Running
+	// more frames than set_audio_history allows for overwrites its contents.
+	// The view keeps the emulator alive, and set_audio_history and
+	// set_audio_enabled refuse to reallocate the ring while any view is
+	py::array_t<int16_t> getAudioWindow(py::object samples) {
+		size_t available = m_re.getAudioHistorySamples();
+		size_t n = samples.is_none() ? available : std::min(samples.cast<size_t>(), available);
+		py::capsule base(new py::object(py::cast(this)), [](void* p) {
+			py::object* self = static_cast<py::object*>(p);
+			--self->cast<PyRetroEmulator&>().m_audioViews;
+			delete self;
+		});
+		++m_audioViews;
+		py::array_t<int16_t> view({ n, static_cast<size_t>(2) }, m_re.getAudioHistory(n), base);
+		py::detail::array_proxy(view.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+		return view;
+	}
+
+	void checkAudioViews() const {
+		if (m_audioViews) {
+			throw std::runtime_error("Cannot reallocate the audio ring while audio windows are alive");
+		}
+	}
+
+	void setAudioEnabled(bool enabled) {
+		checkAudioViews();
+		m_re.setAudioEnabled(enabled);
+	}
+
+	bool audioEnabled() const {
+		return m_re.isAudioEnabled();
+	}
+
+	void setVideoEnabled(bool enabled) {
+		m_re.setVideoEnabled(enabled);
+	}
+
+	bool videoEnabled() const {
+		return m_re.isVideoEnabled();
+	}
+
+	void setAsyncReadback(bool async) {
+		m_re.setAsyncReadback(async);
+	}
+
+	// Hardware-rendered cores downscale frames on the GPU, so only the
+	// downscaled frame is read back; other cores ignore this
+	void setReadbackScale(py::object size, bool gray) {
+		if (size.is_none()) {
+			m_re.setReadbackScale(0, 0, false);
+			return;
+		}
+		py::sequence dims = py::reinterpret_borrow<py::sequence>(size);
+		if (dims.size() != 2) {
+			throw std::runtime_error("size must be a (width, height) tuple");
+		}
+		m_re.setReadbackScale(dims[0].cast<unsigned>(), dims[1].cast<unsigned>(), gray);
+	}
+
+	void setAudioHistory(size_t frames) {
+		checkAudioViews();
+		m_re.setAudioHistory(frames);
+	}
+
 	double getAudioRate() {
 		return m_re.getAudioRate();
 	}
@@ -127,6 +415,43 @@ struct PyRetroEmulator {
 		}
 	}
 
+	void setAction(py::handle action) {
+		uint16_t masks[MAX_PLAYERS];
+		decodeAction(action, masks);
+		for (unsigned player = 0; player < m_actions.players(); ++player) {
+			m_re.setButtonMask(player, masks[player]);
+		}
+	}
+
+	py::list getActionMasks(py::handle action) {
+		uint16_t masks[MAX_PLAYERS];
+		decodeAction(action, masks);
+		py::list list;
+		for (unsigned player = 0; player < m_actions.players(); ++player) {
+			list.append(masks[player]);
+		}
+		return list;
+	}
+
+	void decodeAction(py::handle action, uint16_t* masks) {
+		if (!m_actions.players()) {
+			throw std::runtime_error("Actions are not configured");
+		}
+		bool valid;
+		if (m_actions.mode() == ActionTable::Mode::DISCRETE) {
+			valid = m_actions.decode(static_cast<int64_t>(py::int_(py::reinterpret_borrow<py::object>(action))), masks);
+		} else {
+			auto values = py::array_t<int64_t, py::array::c_style | py::array::forcecast>::ensure(action);
+			if (!values || static_cast<size_t>(values.size()) != m_actions.width()) {
+				throw std::runtime_error("Action has the wrong number of values");
+			}
+			valid = m_actions.decode(values.data(), masks);
+		}
+		if (!valid) {
+			throw std::runtime_error("Action is out of range");
+		}
+	}
+
 	void addCheat(const string& code) {
 		m_re.setCheat(m_cheats, true, code.c_str());
 		++m_cheats;
@@ -138,6 +463,8 @@ struct PyRetroEmulator {
 	}
 
 	void configureData(PyGameData& data);
+	void configureActions(PyGameData& data, int mode, unsigned players);
+	py::tuple stepRepeat(PyGameData& data, unsigned repeat, unsigned players, bool skipRender);
 	static bool loadCoreInfo(const string& json) {
 		return Retro::loadCoreInfo(json);
 	}
@@ -333,6 +660,53 @@ struct PyGameData {
 		return data;
 	}
 
+	static py::array_t<int64_t> checkInfoBuffer(py::object buffer, std::vector<long> shape) {
+		if (!py::isinstance<py::array_t<int64_t>>(buffer)) {
+			throw std::runtime_error("Info buffer must be an int64 numpy array");
+		}
+		py::array_t<int64_t> arr = py::reinterpret_borrow<py::array_t<int64_t>>(buffer);
+		if (!(arr.flags() & py::array::c_style) || !arr.writeable()) {
+			throw std::runtime_error("Info buffer must be C-contiguous and writeable");
+		}
+		if (arr.ndim() != static_cast<long>(shape.size())) {
+			throw std::runtime_error("Info buffer has the wrong shape");
+		}
+		for (size_t i = 0; i < shape.size(); ++i) {
+			if (arr.shape(i) != shape[i]) {
+				throw std::runtime_error("Info buffer has the wrong shape");
+			}
+		}
+		return arr;
+	}
+
+	py::list infoSchema() {
+		py::list names;
+		for (const auto& name : m_data.infoSchema()) {
+			names.append(py::str(name));
+		}
+		return names;
+	}
+
+	void setInfoSchema(py::iterable names) {
+		std::vector<string> schema;
+		for (const auto& name : names) {
+			schema.emplace_back(py::str(name));
+		}
+		m_data.setInfoSchema(schema);
+	}
+
+	py::array_t<int64_t> lookupArray(py::object out) {
+		long cols = m_data.infoSchema().size();
+		py::array_t<int64_t> arr;
+		if (out.is_none()) {
+			arr = py::array_t<int64_t>(cols);
+		} else {
+			arr = checkInfoBuffer(out, { cols });
+		}
+		m_data.lookupInfo(arr.mutable_data());
+		return arr;
+	}
+
 	py::dict getVariable(py::str name) const {
 		py::dict obj;
 		Retro::Variable var = m_data.getVariable(name);
@@ -415,6 +789,393 @@ void PyRetroEmulator::configureData(PyGameData& data) {
 	m_re.configureData(&data.m_data);
 }
 
+void PyRetroEmulator::configureActions(PyGameData& data, int mode, unsigned players) {
+	if (mode < 0 || mode > static_cast<int>(ActionTable::Mode::MULTI_DISCRETE)) {
+		throw std::runtime_error("Unknown action mode");
+	}
+	if (!m_actions.compile(data.m_scen, static_cast<ActionTable::Mode>(mode), m_re.buttons().size(), players)) {
+		throw std::runtime_error("Could not compile action space");
+	}
+}
+
+// Runs up to repeat frames with the current button masks, updating the
+// scenario every frame and stopping early once it is done. Observations are
+// only produced for the frames that can reach the caller, so with skipRender
+// an episode that ends early returns an older frame; the last value returned
+// counts the frames run since the one observed
+py::tuple PyRetroEmulator::stepRepeat(PyGameData& data, unsigned repeat, unsigned players, bool skipRender) {
+	if (!repeat) {
+		throw std::runtime_error("repeat must be at least 1");
+	}
+	if (!players || players > MAX_PLAYERS) {
+		throw std::runtime_error("players must be between 1 and MAX_PLAYERS");
+	}
+	bool maxPool = m_hasPipeline && m_pipeline.config().maxPool;
+	float rewards[MAX_PLAYERS]{};
+	bool done = false;
+	unsigned frames = 0;
+	// Frame 0 is the last frame of the previous step, which the pipeline has seen
+	unsigned pooled = 0;
+	bool videoEnabled = m_re.isVideoEnabled();
+	unsigned rendered = 0;
+	while (frames < repeat && !done) {
+		if (skipRender && videoEnabled) {
+			// Only the last frame and the one pooled with it get observed,
+			// unless the episode ends before then
+			m_re.setVideoEnabled(frames + 1 >= repeat - (maxPool ? 1 : 0));
+		}
+		m_re.run();
+		++frames;
+		if (m_re.isVideoEnabled()) {
+			rendered = frames;
+		}
+		data.m_data.updateRam();
+		data.m_scen.update();
+		for (unsigned player = 0; player < players; ++player) {
+			rewards[player] += data.m_scen.currentReward(player);
+		}
+		done = data.m_scen.isDone();
+		if (maxPool && frames + 1 == repeat && !done) {
+			processObservation();
+			pooled = frames;
+		}
+	}
+	m_re.setVideoEnabled(videoEnabled);
+	if (maxPool && pooled + 1 != frames) {
+		// Don't pool with a frame from further back than the previous one
+		m_pipeline.reset();
+	}
+	if (m_hasScreenBuffer) {
+		renderScreen(m_screenBuffer.mutable_data(), m_screenCrop[0], m_screenCrop[1], m_screenCrop[2], m_screenCrop[3], m_screenRotate);
+	}
+	if (m_hasPipeline) {
+		processObservation();
+	}
+	py::list rewardList;
+	for (unsigned player = 0; player < players; ++player) {
+		rewardList.append(rewards[player]);
+	}
+	return py::make_tuple(rewardList, done, frames, frames - rendered);
+}
+
+struct PyVectorEmulator {
+	Retro::VectorEmulator m_vec;
+	py::array_t<uint8_t> m_observations;
+	py::array_t<float> m_rewards;
+	py::array_t<bool> m_dones;
+
+	PyVectorEmulator(const string& rom_path, size_t num_envs, size_t num_threads)
+		: m_vec(num_envs, num_threads) {
+		if (!num_envs) {
+			throw std::runtime_error("num_envs must be at least 1");
+		}
+		if (!m_vec.loadRom(rom_path)) {
+			throw std::runtime_error("Could not load ROM");
+		}
+		long n = m_vec.numEnvs();
+		long w = m_vec.screenWidth();
+		long h = m_vec.screenHeight();
+		m_observations = py::array_t<uint8_t>({ n, h, w, 3L });
+		m_rewards = py::array_t<float>(n);
+		m_dones = py::array_t<bool>(n);
+	}
+
+	// Rewards have shape (num_envs,) for one player and (num_envs, players)
+	// otherwise, as RetroEnv returns a scalar or a per-player array
+	float* rewardBuffer(unsigned players) {
+		long n = m_vec.numEnvs();
+		long expected = players > 1 ? players : 0;
+		long current = m_rewards.ndim() > 1 ? m_rewards.shape(1) : 0;
+		if (current != expected) {
+			if (players > 1) {
+				m_rewards = py::array_t<float>({ n, static_cast<long>(players) });
+			} else {
+				m_rewards = py::array_t<float>(n);
+			}
+		}
+		return m_rewards.mutable_data();
+	}
+
+	void load(py::handle data = py::none(), py::handle scen = py::none()) {
+		string dataPath;
+		string scenPath;
+		if (!data.is_none()) {
+			dataPath = py::str(data);
+		}
+		if (!scen.is_none()) {
+			scenPath = py::str(scen);
+		}
+		if (!m_vec.loadData(dataPath, scenPath)) {
+			throw std::runtime_error("Could not load data or scenario");
+		}
+		if (m_vec.isScripted()) {
+			// Script contexts are shared by the whole process
+			throw std::runtime_error("Scripted scenarios are not supported by VectorEmulator");
+		}
+	}
+
+	void setState(py::bytes o) {
+		m_vec.setInitialState(PyBytes_AsString(o.ptr()), PyBytes_Size(o.ptr()));
+	}
+
+	py::array_t<uint8_t> reset() {
+		uint8_t* observations = m_observations.mutable_data();
+		size_t frameSize = m_observations.size() / m_vec.numEnvs();
+		{
+			py::gil_scoped_release release;
+			m_vec.reset();
+			for (size_t i = 0; i < m_vec.numEnvs(); ++i) {
+				m_vec.copyScreen(i, &observations[i * frameSize]);
+			}
+		}
+		return m_observations;
+	}
+
+	py::array_t<uint8_t> resetEnv(size_t env) {
+		if (env >= m_vec.numEnvs()) {
+			throw py::index_error("env is out of range");
+		}
+		uint8_t* observations = m_observations.mutable_data();
+		size_t frameSize = m_observations.size() / m_vec.numEnvs();
+		{
+			py::gil_scoped_release release;
+			m_vec.reset(env);
+			m_vec.copyScreen(env, &observations[env * frameSize]);
+		}
+		return m_observations;
+	}
+
+	py::tuple step(py::array_t<uint8_t, py::array::c_style | py::array::forcecast> actions, bool filter_actions) {
+		size_t buttons = m_vec.numButtons();
+		if (actions.ndim() != 2 || static_cast<size_t>(actions.shape(0)) != m_vec.numEnvs()) {
+			throw std::runtime_error("actions must have shape (num_envs, players * num_buttons)");
+		}
+		if (!buttons || !actions.shape(1) || actions.shape(1) % buttons || actions.shape(1) / buttons > MAX_PLAYERS) {
+			throw std::runtime_error("actions must have shape (num_envs, players * num_buttons)");
+		}
+		unsigned players = actions.shape(1) / buttons;
+		const uint8_t* actionData = actions.data();
+		uint8_t* observations = m_observations.mutable_data();
+		float* rewards = rewardBuffer(players);
+		bool* dones = m_dones.mutable_data();
+		{
+			py::gil_scoped_release release;
+			m_vec.step(actionData, players, filter_actions, observations, rewards, dones);
+		}
+		return py::make_tuple(m_observations, m_rewards, m_dones);
+	}
+
+	void configureActions(int mode, unsigned players) {
+		if (mode < 0 || mode > static_cast<int>(ActionTable::Mode::MULTI_DISCRETE)) {
+			throw std::runtime_error("Unknown action mode");
+		}
+		if (!m_vec.configureActions(static_cast<ActionTable::Mode>(mode), players)) {
+			throw std::runtime_error("Could not compile action space");
+		}
+	}
+
+	py::tuple stepActions(py::array_t<int64_t, py::array::c_style | py::array::forcecast> actions) {
+		const ActionTable& table = m_vec.actionTable();
+		if (!table.players()) {
+			throw std::runtime_error("Actions are not configured");
+		}
+		if (static_cast<size_t>(actions.size()) != m_vec.numEnvs() * table.width() || (actions.ndim() && static_cast<size_t>(actions.shape(0)) != m_vec.numEnvs())) {
+			throw std::runtime_error("actions must have num_envs rows of one action each");
+		}
+		const int64_t* actionData = actions.data();
+		uint8_t* observations = m_observations.mutable_data();
+		float* rewards = rewardBuffer(table.players());
+		bool* dones = m_dones.mutable_data();
+		{
+			py::gil_scoped_release release;
+			m_vec.step(actionData, observations, rewards, dones);
+		}
+		return py::make_tuple(m_observations, m_rewards, m_dones);
+	}
+
+	py::dict lookupAll(size_t env) {
+		if (env >= m_vec.numEnvs()) {
+			throw py::index_error("env is out of range");
+		}
+		py::dict data;
+		const Retro::GameData& gameData = m_vec.data(env);
+		for (const auto& var : gameData.lookupAll()) {
+			data[py::str(var.first)] = var.second;
+		}
+		return data;
+	}
+
+	py::list infoSchema() {
+		py::list names;
+		for (const auto& name : m_vec.data(0).infoSchema()) {
+			names.append(py::str(name));
+		}
+		return names;
+	}
+
+	void setInfoSchema(py::iterable names) {
+		std::vector<string> schema;
+		for (const auto& name : names) {
+			schema.emplace_back(py::str(name));
+		}
+		for (size_t i = 0; i < m_vec.numEnvs(); ++i) {
+			m_vec.data(i).setInfoSchema(schema);
+		}
+	}
+
+	// Every env shares the schema of env 0 as long as they all load the
+	// same data
+	py::array_t<int64_t> lookupArray(py::object out) {
+		long rows = m_vec.numEnvs();
+		long cols = m_vec.data(0).infoSchema().size();
+		for (size_t i = 1; i < m_vec.numEnvs(); ++i) {
+			if (m_vec.data(i).infoSchema() != m_vec.data(0).infoSchema()) {
+				throw std::runtime_error("Envs have different info schemas");
+			}
+		}
+		py::array_t<int64_t> arr;
+		if (out.is_none()) {
+			arr = py::array_t<int64_t>({ rows, cols });
+		} else {
+			arr = PyGameData::checkInfoBuffer(out, { rows, cols });
+		}
+		int64_t* values = arr.mutable_data();
+		for (size_t i = 0; i < m_vec.numEnvs(); ++i) {
+			m_vec.data(i).lookupInfo(&values[i * cols]);
+		}
+		return arr;
+	}
+
+	size_t numEnvs() const {
+		return m_vec.numEnvs();
+	}
+
+	size_t numThreads() const {
+		return m_vec.numThreads();
+	}
+
+	py::tuple getResolution() const {
+		return py::make_tuple(m_vec.screenWidth(), m_vec.screenHeight());
+	}
+};
+
+struct PyProcessVectorEmulator {
+	Retro::ProcessVectorEmulator m_vec;
+	size_t m_slot = 0;
+
+	PyProcessVectorEmulator(const string& rom_path, size_t num_envs, py::handle data, py::handle scen, py::handle state, size_t depth)
+		: m_vec(num_envs, depth) {
+		string dataPath;
+		string scenPath;
+		std::vector<uint8_t> initialState;
+		if (!data.is_none()) {
+			dataPath = py::str(data);
+		}
+		if (!scen.is_none()) {
+			scenPath = py::str(scen);
+		}
+		if (!state.is_none()) {
+			py::bytes bytes = py::reinterpret_borrow<py::bytes>(state);
+			const uint8_t* begin = reinterpret_cast<const uint8_t*>(PyBytes_AsString(bytes.ptr()));
+			initialState.assign(begin, begin + PyBytes_Size(bytes.ptr()));
+		}
+		bool started;
+		{
+			py::gil_scoped_release release;
+			started = m_vec.start(rom_path, dataPath, scenPath, initialState);
+		}
+		if (!started) {
+			throw std::runtime_error(m_vec.error());
+		}
+	}
+
+	py::array_t<uint8_t> observations(size_t slot) {
+		long n = m_vec.numEnvs();
+		long w = m_vec.screenWidth();
+		long h = m_vec.screenHeight();
+		return py::array_t<uint8_t>({ n, h, w, 3L }, m_vec.frames(slot), py::cast(this));
+	}
+
+	py::tuple results(size_t slot) {
+		long n = m_vec.numEnvs();
+		return py::make_tuple(observations(slot),
+			py::array_t<float>(n, m_vec.rewards(slot), py::cast(this)),
+			py::array_t<bool>(n, m_vec.dones(slot), py::cast(this)));
+	}
+
+	py::array_t<uint8_t> reset() {
+		size_t slot;
+		{
+			py::gil_scoped_release release;
+			slot = m_vec.reset();
+		}
+		m_slot = slot;
+		return observations(slot);
+	}
+
+	void stepAsync(py::array_t<uint8_t, py::array::c_style | py::array::forcecast> actions, bool filter_actions) {
+		size_t buttons = m_vec.numButtons();
+		if (actions.ndim() != 2 || static_cast<size_t>(actions.shape(0)) != m_vec.numEnvs()) {
+			throw std::runtime_error("actions must have shape (num_envs, players * num_buttons)");
+		}
+		if (!buttons || !actions.shape(1) || actions.shape(1) % buttons || actions.shape(1) / buttons > MAX_PLAYERS) {
+			throw std::runtime_error("actions must have shape (num_envs, players * num_buttons)");
+		}
+		size_t players = actions.shape(1) / buttons;
+		std::vector<uint16_t> masks(m_vec.numEnvs() * MAX_PLAYERS);
+		for (size_t i = 0; i < m_vec.numEnvs(); ++i) {
+			const uint8_t* row = actions.data(i, 0);
+			for (size_t player = 0; player < players; ++player) {
+				uint16_t mask = 0;
+				for (size_t key = 0; key < buttons; ++key) {
+					mask |= (row[player * buttons + key] ? 1 : 0) << key;
+				}
+				masks[i * MAX_PLAYERS + player] = mask;
+			}
+		}
+		m_vec.stepAsync(masks.data(), filter_actions);
+	}
+
+	py::tuple stepWait() {
+		size_t slot;
+		{
+			py::gil_scoped_release release;
+			slot = m_vec.stepWait();
+		}
+		m_slot = slot;
+		return results(slot);
+	}
+
+	py::tuple step(py::array_t<uint8_t, py::array::c_style | py::array::forcecast> actions, bool filter_actions) {
+		stepAsync(actions, filter_actions);
+		return stepWait();
+	}
+
+	py::array_t<uint8_t> getRam() {
+		size_t slot = m_slot;
+		long n = m_vec.numEnvs();
+		long size = m_vec.ramSize();
+		return py::array_t<uint8_t>({ n, size }, m_vec.ram(slot), py::cast(this));
+	}
+
+	// Arrays already returned keep this object, and so the ring, alive
+	void close() {
+		m_vec.stop();
+	}
+
+	size_t numEnvs() const {
+		return m_vec.numEnvs();
+	}
+
+	size_t depth() const {
+		return m_vec.depth();
+	}
+
+	py::tuple getResolution() const {
+		return py::make_tuple(m_vec.screenWidth(), m_vec.screenHeight());
+	}
+};
+
 struct PyMovie {
 	std::unique_ptr<Retro::Movie> m_movie;
 	bool recording = false;
@@ -470,6 +1231,26 @@ struct PyMovie {
 	void setState(py::bytes data) {
 		m_movie->setState(reinterpret_cast<uint8_t*>(PyBytes_AsString(data.ptr())), PyBytes_Size(data.ptr()));
 	}
+
+	void addKeyframe(py::buffer state) {
+		if (!recording) {
+			throw std::runtime_error("Keyframes can only be added while recording");
+		}
+		py::buffer_info info = state.request();
+		static_cast<MovieBK2*>(m_movie.get())->addKeyframe(static_cast<const uint8_t*>(info.ptr), info.size * info.itemsize);
+	}
+
+	bool seek(size_t frame, PyRetroEmulator& emu) {
+		return m_movie->seek(frame, emu.m_re);
+	}
+
+	size_t frame() const {
+		return m_movie->frame();
+	}
+
+	size_t frameCount() const {
+		return m_movie->frameCount();
+	}
 };
 
 py::str corePath(py::handle hint = py::none()) {
@@ -486,20 +1267,75 @@ PYBIND11_MODULE(_retro, m) {
 	py::class_<PyRetroEmulator>(m, "RetroEmulator")
 		.def(py::init<const string&>())
 		.def("step", &PyRetroEmulator::step)
+		.def("step_repeat", &PyRetroEmulator::stepRepeat,
+			"Repeat the current action for up to repeat frames, stopping once the scenario is done. "
+			"Returns (rewards, done, frames, stale). With skip_render, only the frames that can be "
+			"observed at the end are rendered, so if the episode ends earlier the screen and "
+			"observation come from an older frame; stale is the number of frames run since the "
+			"observed one and is 0 when it is current",
+			py::arg("data"), py::arg("repeat"), py::arg("players") = 1, py::arg("skip_render") = false)
 		.def("set_button_mask", &PyRetroEmulator::setButtonMask, py::arg("mask"), py::arg("player") = 0)
 		.def("get_state", &PyRetroEmulator::getState)
 		.def("set_state", &PyRetroEmulator::setState)
-		.def("get_screen", &PyRetroEmulator::getScreen)
+		.def("allocate_slots", &PyRetroEmulator::allocateSlots, py::arg("slots"))
+		.def("save_slot", &PyRetroEmulator::saveSlot, py::arg("slot"))
+		.def("load_slot", &PyRetroEmulator::loadSlot, py::arg("slot"))
+		.def("slot_view", &PyRetroEmulator::slotView, py::arg("slot"))
+		.def_property_readonly("num_slots", &PyRetroEmulator::numSlots)
+		.def("get_screen", &PyRetroEmulator::getScreen, py::arg("out") = py::none(), py::arg("crop") = py::none(), py::arg("rotate") = false)
+		.def("configure_observation", &PyRetroEmulator::configureObservation, py::arg("crop") = py::none(), py::arg("rotate") = false, py::arg("gray") = false, py::arg("size") = py::none(), py::arg("max_pool") = false)
+		.def("get_observation", &PyRetroEmulator::getObservation, py::arg("out") = py::none())
+		.def("set_screen_buffer", &PyRetroEmulator::setScreenBuffer, py::arg("buffer"), py::arg("crop") = py::none(), py::arg("rotate") = false)
 		.def("get_rotation", &PyRetroEmulator::getRotation)
 		.def("get_screen_rate", &PyRetroEmulator::getScreenRate)
 		.def("get_audio", &PyRetroEmulator::getAudio)
+		.def("get_audio_window", &PyRetroEmulator::getAudioWindow, py::arg("samples") = py::none())
+		.def("set_audio_history", &PyRetroEmulator::setAudioHistory, py::arg("frames"))
+		.def("set_audio_enabled", &PyRetroEmulator::setAudioEnabled, py::arg("enabled"))
+		.def_property_readonly("audio_enabled", &PyRetroEmulator::audioEnabled)
+		.def("set_video_enabled", &PyRetroEmulator::setVideoEnabled, py::arg("enabled"))
+		.def_property_readonly("video_enabled", &PyRetroEmulator::videoEnabled)
+		.def("set_async_readback", &PyRetroEmulator::setAsyncReadback, py::arg("enabled"))
+		.def("set_readback_scale", &PyRetroEmulator::setReadbackScale, py::arg("size") = py::none(), py::arg("gray") = false)
 		.def("get_audio_rate", &PyRetroEmulator::getAudioRate)
 		.def("get_resolution", &PyRetroEmulator::getResolution)
 		.def("configure_data", &PyRetroEmulator::configureData)
+		.def("configure_actions", &PyRetroEmulator::configureActions, py::arg("data"), py::arg("mode"), py::arg("players") = 1)
+		.def("set_action", &PyRetroEmulator::setAction, py::arg("action"))
+		.def("get_action_masks", &PyRetroEmulator::getActionMasks, py::arg("action"))
 		.def("add_cheat", &PyRetroEmulator::addCheat)
 		.def("clear_cheats", &PyRetroEmulator::clearCheats)
 		.def_static("load_core_info", &PyRetroEmulator::loadCoreInfo);
 
+	py::class_<PyVectorEmulator>(m, "VectorEmulator")
+		.def(py::init<const string&, size_t, size_t>(), py::arg("rom_path"), py::arg("num_envs"), py::arg("num_threads") = 0)
+		.def("load", &PyVectorEmulator::load, py::arg("data") = py::none(), py::arg("scen") = py::none())
+		.def("set_state", &PyVectorEmulator::setState)
+		.def("reset", &PyVectorEmulator::reset)
+		.def("reset_env", &PyVectorEmulator::resetEnv, py::arg("env"))
+		.def("step", &PyVectorEmulator::step, py::arg("actions"), py::arg("filter_actions") = true)
+		.def("configure_actions", &PyVectorEmulator::configureActions, py::arg("mode"), py::arg("players") = 1)
+		.def("step_actions", &PyVectorEmulator::stepActions, py::arg("actions"))
+		.def("lookup_all", &PyVectorEmulator::lookupAll, py::arg("env"))
+		.def("info_schema", &PyVectorEmulator::infoSchema)
+		.def("set_info_schema", &PyVectorEmulator::setInfoSchema, py::arg("names"))
+		.def("lookup_array", &PyVectorEmulator::lookupArray, py::arg("out") = py::none())
+		.def("get_resolution", &PyVectorEmulator::getResolution)
+		.def_property_readonly("num_envs", &PyVectorEmulator::numEnvs)
+		.def_property_readonly("num_threads", &PyVectorEmulator::numThreads);
+
+	py::class_<PyProcessVectorEmulator>(m, "ProcessVectorEmulator")
+		.def(py::init<const string&, size_t, py::handle, py::handle, py::handle, size_t>(), py::arg("rom_path"), py::arg("num_envs"), py::arg("data") = py::none(), py::arg("scen") = py::none(), py::arg("state") = py::none(), py::arg("depth") = 2)
+		.def("reset", &PyProcessVectorEmulator::reset)
+		.def("step", &PyProcessVectorEmulator::step, py::arg("actions"), py::arg("filter_actions") = true)
+		.def("step_async", &PyProcessVectorEmulator::stepAsync, py::arg("actions"), py::arg("filter_actions") = true)
+		.def("step_wait", &PyProcessVectorEmulator::stepWait)
+		.def("get_ram", &PyProcessVectorEmulator::getRam)
+		.def("get_resolution", &PyProcessVectorEmulator::getResolution)
+		.def("close", &PyProcessVectorEmulator::close)
+		.def_property_readonly("num_envs", &PyProcessVectorEmulator::numEnvs)
+		.def_property_readonly("depth", &PyProcessVectorEmulator::depth);
+
 	py::class_<PyMemoryView>(m, "Memory")
 		.def(py::init<Retro::AddressSpace&>())
 		.def("extract", &PyMemoryView::extract, py::arg("address"), py::arg("type"))
@@ -526,6 +1362,9 @@ PYBIND11_MODULE(_retro, m) {
 		.def("lookup_value", &PyGameData::lookupValue)
 		.def("set_value", &PyGameData::setValue)
 		.def("lookup_all", &PyGameData::lookupAll)
+		.def("info_schema", &PyGameData::infoSchema)
+		.def("set_info_schema", &PyGameData::setInfoSchema, py::arg("names"))
+		.def("lookup_array", &PyGameData::lookupArray, py::arg("out") = py::none())
 		.def("get_variable", &PyGameData::getVariable)
 		.def("set_variable", &PyGameData::setVariable)
 		.def("remove_variable", &PyGameData::removeVariable)
@@ -551,7 +1390,11 @@ PYBIND11_MODULE(_retro, m) {
 		.def("get_key", &PyMovie::getKey)
 		.def("set_key", &PyMovie::setKey)
 		.def("get_state", &PyMovie::getState)
-		.def("set_state", &PyMovie::setState);
+		.def("set_state", &PyMovie::setState)
+		.def("add_keyframe", &PyMovie::addKeyframe)
+		.def("seek", &PyMovie::seek)
+		.def_property_readonly("frame", &PyMovie::frame)
+		.def_property_readonly("num_frames", &PyMovie::frameCount);
 
 	m.def("core_path", &::corePath, py::arg("hint") = py::none());
 	m.def("data_path", &::dataPath, py::arg("hint") = py::none());
@@ -15,10 +15,43 @@ ScriptLua::~ScriptLua() {
 	}
 }
 
+// Upvalue of the data accessors. Variable names are resolved to GameData
+// slots once and cached in a table (the second upvalue of _getData) until the
+// variables change
+struct DataBinding {
+	GameData* data;
+	uint64_t generation;
+};
+
 static int _getData(lua_State* L) {
-	lua_pushstring(L, "__ptr");
-	lua_gettable(L, 1);
-	const GameData* data = static_cast<const GameData*>(lua_touserdata(L, -1));
+	DataBinding* binding = static_cast<DataBinding*>(lua_touserdata(L, lua_upvalueindex(1)));
+	GameData* data = binding->data;
+	if (lua_type(L, 2) == LUA_TSTRING) {
+		if (binding->generation != data->generation()) {
+			lua_newtable(L);
+			lua_replace(L, lua_upvalueindex(2));
+			binding->generation = data->generation();
+		}
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(2));
+		size_t slot;
+		if (lua_isnil(L, -1)) {
+			slot = data->compileVariable(lua_tostring(L, 2));
+			lua_pushvalue(L, 2);
+			lua_pushnumber(L, slot == SIZE_MAX ? -1 : static_cast<lua_Number>(slot));
+			lua_rawset(L, lua_upvalueindex(2));
+		} else {
+			lua_Number cached = lua_tonumber(L, -1);
+			slot = cached < 0 ? SIZE_MAX : static_cast<size_t>(cached);
+		}
+		lua_pop(L, 1);
+		int64_t value;
+		if (slot != SIZE_MAX && data->lookupCompiled(slot, &value)) {
+			lua_pushnumber(L, value);
+			return 1;
+		}
+	}
+
 	Variant datum;
 	if (lua_isnumber(L, 2)) {
 		int64_t address = lua_tonumber(L, 2);
@@ -30,7 +63,7 @@ static int _getData(lua_State* L) {
 		datum = static_cast<int64_t>(as[address]);
 	} else {
 		const char* name = lua_tostring(L, 2);
-		datum = data->lookupValue(name);
+		datum = static_cast<const GameData*>(data)->lookupValue(name);
 	}
 
 	switch (datum.type()) {
@@ -51,9 +84,7 @@ static int _getData(lua_State* L) {
 }
 
 static int _setData(lua_State* L) {
-	lua_pushstring(L, "__ptr");
-	lua_gettable(L, 1);
-	GameData* data = static_cast<GameData*>(lua_touserdata(L, -1));
+	GameData* data = static_cast<DataBinding*>(lua_touserdata(L, lua_upvalueindex(1)))->data;
 	if (!lua_isstring(L, 2)) {
 		lua_pushstring(L, "Invalid variable name");
 		lua_error(L);
@@ -101,6 +132,71 @@ static int _noop(lua_State*) {
 	return 0;
 }
 
+#ifdef LUAJIT_VERSION
+// memory.pointer(address) returns a pointer to the mapped byte at address and
+// the number of bytes mapped after it, for use with ffi.cast
+static int _memoryPointer(lua_State* L) {
+	GameData* data = static_cast<DataBinding*>(lua_touserdata(L, lua_upvalueindex(1)))->data;
+	size_t offset;
+	MemoryView<>* block = data->addressSpace().find(static_cast<size_t>(luaL_checknumber(L, 1)), &offset);
+	if (!block) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushlightuserdata(L, static_cast<uint8_t*>(block->offset(0)) + offset);
+	lua_pushnumber(L, block->size() - offset);
+	return 2;
+}
+
+// memory.variable(name) returns a pointer to a variable and the C type to
+// cast it to, or nil if its type can't be read with a plain load
+static int _memoryVariable(lua_State* L) {
+	GameData* data = static_cast<DataBinding*>(lua_touserdata(L, lua_upvalueindex(1)))->data;
+	const char* name = luaL_checkstring(L, 1);
+	if (!data->listVariables().count(name) || data->addressSpace().overlay().width != 1) {
+		lua_pushnil(L);
+		return 1;
+	}
+	Variable var = data->getVariable(name);
+	const DataType& type = var.type;
+	bool native = type.width == 1 || reduce(type.endian) == Endian::REAL_NATIVE;
+	bool plain = type.repr == Repr::SIGNED || type.repr == Repr::UNSIGNED;
+	size_t offset;
+	MemoryView<>* block = data->addressSpace().find(var.address, &offset);
+	if (!native || !plain || var.mask != UINT64_MAX || !block || offset + type.width > block->size()) {
+		lua_pushnil(L);
+		return 1;
+	}
+	const char* ctype;
+	switch (type.width) {
+	case 1:
+		ctype = type.repr == Repr::SIGNED ? "int8_t*" : "uint8_t*";
+		break;
+	case 2:
+		ctype = type.repr == Repr::SIGNED ? "int16_t*" : "uint16_t*";
+		break;
+	case 4:
+		ctype = type.repr == Repr::SIGNED ? "int32_t*" : "uint32_t*";
+		break;
+	case 8:
+		ctype = type.repr == Repr::SIGNED ? "int64_t*" : "uint64_t*";
+		break;
+	default:
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushlightuserdata(L, static_cast<uint8_t*>(block->offset(0)) + offset);
+	lua_pushstring(L, ctype);
+	return 2;
+}
+
+static int _memoryGeneration(lua_State* L) {
+	GameData* data = static_cast<DataBinding*>(lua_touserdata(L, lua_upvalueindex(1)))->data;
+	lua_pushnumber(L, data->addressSpace().generation());
+	return 1;
+}
+#endif
+
 void ScriptLua::setData(GameData* data) {
 	ScriptContext::setData(data);
 
@@ -110,16 +206,44 @@ void ScriptLua::setData(GameData* data) {
 	lua_pushlightuserdata(m_L, const_cast<void*>(static_cast<const void*>(data)));
 	lua_setfield(m_L, -2, "__ptr");
 
+	DataBinding* binding = static_cast<DataBinding*>(lua_newuserdata(m_L, sizeof(DataBinding)));
+	binding->data = data;
+	binding->generation = data ? data->generation() : 0;
+	int bindingIndex = lua_gettop(m_L);
+
 	// Make metatable
 	lua_createtable(m_L, 0, 3);
-	lua_pushcfunction(m_L, _getData);
+	lua_pushvalue(m_L, bindingIndex);
+	lua_newtable(m_L);
+	lua_pushcclosure(m_L, _getData, 2);
 	lua_setfield(m_L, -2, "__index");
 
-	lua_pushcfunction(m_L, _setData);
+	lua_pushvalue(m_L, bindingIndex);
+	lua_pushcclosure(m_L, _setData, 1);
 	lua_setfield(m_L, -2, "__newindex");
 
-	lua_setmetatable(m_L, -2);
+	lua_setmetatable(m_L, -3);
+
+#ifdef LUAJIT_VERSION
+	// Raw pointers into RAM for scripts that read it through the FFI. They
+	// stay valid until memory.generation() changes
+	lua_createtable(m_L, 0, 3);
+	lua_pushvalue(m_L, bindingIndex);
+	lua_pushcclosure(m_L, _memoryPointer, 1);
+	lua_setfield(m_L, -2, "pointer");
+	lua_pushvalue(m_L, bindingIndex);
+	lua_pushcclosure(m_L, _memoryVariable, 1);
+	lua_setfield(m_L, -2, "variable");
+	lua_pushvalue(m_L, bindingIndex);
+	lua_pushcclosure(m_L, _memoryGeneration, 1);
+	lua_setfield(m_L, -2, "generation");
+	lua_setglobal(m_L, "memory");
+	saveGlobal("memory");
+#endif
+
+	lua_pop(m_L, 1);
 	lua_setglobal(m_L, "data");
+	saveGlobal("data");
 };
 
 void ScriptLua::setScenario(const Scenario* scen) {
@@ -141,6 +265,7 @@ void ScriptLua::setScenario(const Scenario* scen) {
 
 	lua_setmetatable(m_L, -2);
 	lua_setglobal(m_L, "scenario");
+	saveGlobal("scenario");
 };
 
 bool ScriptLua::init() {
@@ -152,22 +277,201 @@ bool ScriptLua::init() {
 	luaopen_table(m_L);
 	luaopen_string(m_L);
 	luaopen_math(m_L);
+#ifdef LUAJIT_VERSION
+	lua_pushcfunction(m_L, luaopen_ffi);
+	lua_call(m_L, 0, 1);
+	lua_setglobal(m_L, "ffi");
+#endif
 
 	vector<string> functions = listFunctions();
 	m_blacklist = { functions.begin(), functions.end() };
+
+	saveGlobals();
 	return true;
 }
 
+// Copies the contents and metatable of the table at index into m_saved
+void ScriptLua::saveTable(int index) {
+	lua_pushvalue(m_L, index);
+	int table = lua_gettop(m_L);
+	lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_saved);
+	lua_pushvalue(m_L, table);
+	lua_createtable(m_L, 2, 0);
+	lua_newtable(m_L);
+	lua_pushnil(m_L);
+	while (lua_next(m_L, table) != 0) {
+		lua_pushvalue(m_L, -2);
+		lua_insert(m_L, -2);
+		lua_rawset(m_L, -4);
+	}
+	lua_rawseti(m_L, -2, 1);
+	if (lua_getmetatable(m_L, table)) {
+		lua_rawseti(m_L, -2, 2);
+	}
+	lua_rawset(m_L, -3);
+	lua_pop(m_L, 2);
+}
+
+void ScriptLua::saveGlobals() {
+	luaL_unref(m_L, LUA_REGISTRYINDEX, m_saved);
+	lua_newtable(m_L);
+	m_saved = luaL_ref(m_L, LUA_REGISTRYINDEX);
+
+	// Scripts can change library tables as well as globals, so keep a copy
+	// of every table reachable from the globals and of the string metatable
+	saveTable(LUA_GLOBALSINDEX);
+	lua_pushnil(m_L);
+	while (lua_next(m_L, LUA_GLOBALSINDEX) != 0) {
+		if (lua_istable(m_L, -1)) {
+			saveTable(lua_gettop(m_L));
+		}
+		lua_pop(m_L, 1);
+	}
+	lua_pushliteral(m_L, "");
+	if (lua_getmetatable(m_L, -1)) {
+		saveTable(lua_gettop(m_L));
+		lua_pop(m_L, 1);
+	}
+	lua_pop(m_L, 1);
+}
+
+// Globals bound before any script ran belong to the saved state. Binding
+// them again later only updates that global instead of saving the state
+// the scripts left behind
+void ScriptLua::saveGlobal(const char* name) {
+	if (m_chunks.empty()) {
+		saveGlobals();
+		return;
+	}
+	lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_saved);
+	lua_pushvalue(m_L, LUA_GLOBALSINDEX);
+	lua_rawget(m_L, -2);
+	lua_rawgeti(m_L, -1, 1);
+	lua_getglobal(m_L, name);
+	lua_setfield(m_L, -2, name);
+	lua_pop(m_L, 3);
+}
+
+void ScriptLua::restoreGlobals() {
+	lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_saved);
+	int saved = lua_gettop(m_L);
+	lua_pushnil(m_L);
+	while (lua_next(m_L, saved) != 0) {
+		int table = lua_gettop(m_L) - 1;
+		// Clearing existing fields while traversing a table is allowed
+		lua_pushnil(m_L);
+		while (lua_next(m_L, table) != 0) {
+			lua_pop(m_L, 1);
+			lua_pushvalue(m_L, -1);
+			lua_pushnil(m_L);
+			lua_rawset(m_L, table);
+		}
+		lua_rawgeti(m_L, -1, 1);
+		lua_pushnil(m_L);
+		while (lua_next(m_L, -2) != 0) {
+			lua_pushvalue(m_L, -2);
+			lua_insert(m_L, -2);
+			lua_rawset(m_L, table);
+		}
+		lua_pop(m_L, 1);
+		lua_rawgeti(m_L, -1, 2);
+		lua_setmetatable(m_L, table);
+		lua_pop(m_L, 1);
+	}
+	lua_pop(m_L, 1);
+
+	// LuaJIT seeds a new state's generator with 0 the first time it is used
+	lua_getglobal(m_L, "math");
+	if (lua_istable(m_L, -1)) {
+		lua_getfield(m_L, -1, "randomseed");
+		if (lua_isfunction(m_L, -1)) {
+			lua_pushnumber(m_L, 0);
+			if (lua_pcall(m_L, 1, 0, 0) != 0) {
+				lua_pop(m_L, 1);
+			}
+		} else {
+			lua_pop(m_L, 1);
+		}
+	}
+	lua_pop(m_L, 1);
+}
+
 bool ScriptLua::load(const string& filename) {
-	return luaL_dofile(m_L, filename.c_str()) == 0;
+	if (luaL_loadfile(m_L, filename.c_str()) != 0) {
+		lua_pop(m_L, 1);
+		return false;
+	}
+	return runChunk();
 }
 
 bool ScriptLua::loadString(const string& script) {
-	return luaL_dostring(m_L, script.c_str()) == 0;
+	if (luaL_loadstring(m_L, script.c_str()) != 0) {
+		lua_pop(m_L, 1);
+		return false;
+	}
+	return runChunk();
+}
+
+bool ScriptLua::runChunk() {
+	lua_pushvalue(m_L, -1);
+	int chunk = luaL_ref(m_L, LUA_REGISTRYINDEX);
+	if (lua_pcall(m_L, 0, 0, 0) != 0) {
+		lua_pop(m_L, 1);
+		luaL_unref(m_L, LUA_REGISTRYINDEX, chunk);
+		return false;
+	}
+	m_chunks.push_back(chunk);
+	rebindFunctions();
+	return true;
+}
+
+bool ScriptLua::restart() {
+	// Put the globals and library tables back the way they were before any
+	// script ran, then run the compiled chunks again
+	restoreGlobals();
+
+	bool success = true;
+	for (int chunk : m_chunks) {
+		lua_rawgeti(m_L, LUA_REGISTRYINDEX, chunk);
+		if (lua_pcall(m_L, 0, 0, 0) != 0) {
+			lua_pop(m_L, 1);
+			success = false;
+		}
+	}
+	rebindFunctions();
+	return success;
+}
+
+size_t ScriptLua::bindFunction(const string& funcName) {
+	for (size_t i = 0; i < m_bound.size(); ++i) {
+		if (m_bound[i].first == funcName) {
+			return i;
+		}
+	}
+	lua_getglobal(m_L, funcName.c_str());
+	m_bound.emplace_back(funcName, luaL_ref(m_L, LUA_REGISTRYINDEX));
+	return m_bound.size() - 1;
+}
+
+void ScriptLua::rebindFunctions() {
+	for (auto& bound : m_bound) {
+		luaL_unref(m_L, LUA_REGISTRYINDEX, bound.second);
+		lua_getglobal(m_L, bound.first.c_str());
+		bound.second = luaL_ref(m_L, LUA_REGISTRYINDEX);
+	}
+}
+
+Variant ScriptLua::callBound(size_t function) {
+	lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_bound[function].second);
+	return call();
 }
 
 Variant ScriptLua::callFunction(const string& funcName) {
 	lua_getglobal(m_L, funcName.c_str());
+	return call();
+}
+
+Variant ScriptLua::call() {
 	int status = lua_pcall(m_L, 0, 1, 0);
 	if (status != 0) {
 		string error = string("Lua call failed: ") + lua_tostring(m_L, -1);
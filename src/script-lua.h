@@ -19,11 +19,30 @@ public:
 	bool init() override;
 	bool load(const std::string&) override;
 	bool loadString(const std::string&) override;
+	bool restart() override;
 	Variant callFunction(const std::string&) override;
+	size_t bindFunction(const std::string&) override;
+	Variant callBound(size_t) override;
 	std::vector<std::string> listFunctions() override;
 
 private:
+	bool runChunk();
+	void rebindFunctions();
+	Variant call();
+	void saveGlobals();
+	void saveGlobal(const char* name);
+	void saveTable(int index);
+	void restoreGlobals();
+
 	lua_State* m_L = nullptr;
 	std::unordered_set<std::string> m_blacklist;
+
+	// Registry references to every chunk loaded, in load order, and to a
+	// table mapping the globals table and every library table to copies of
+	// their contents and metatables from before any chunk ran
+	std::vector<int> m_chunks;
+	int m_saved = LUA_NOREF;
+	// Bound function names and registry references to their current values
+	std::vector<std::pair<std::string, int>> m_bound;
 };
 }
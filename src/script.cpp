@@ -12,6 +12,7 @@ static unordered_map<string, function<shared_ptr<ScriptContext>()>> s_scriptType
 };
 
 static unordered_map<string, shared_ptr<ScriptContext>> s_scriptContexts;
+static uint64_t s_generation = 0;
 
 shared_ptr<ScriptContext> ScriptContext::get(const string& type) {
 	if (type.empty() && s_scriptContexts.size() == 1) {
@@ -44,6 +45,11 @@ vector<string> ScriptContext::listContexts() {
 
 void ScriptContext::reset() {
 	s_scriptContexts.clear();
+	++s_generation;
+}
+
+uint64_t ScriptContext::generation() {
+	return s_generation;
 }
 
 void ScriptContext::setData(GameData* data) {
@@ -61,3 +67,7 @@ void ScriptContext::setScenario(const Scenario* scen) {
 const Scenario* ScriptContext::scenario() {
 	return m_scen;
 }
+
+bool ScriptContext::isBoundTo(const Scenario* scen) const {
+	return m_scen == scen;
+}
@@ -16,6 +16,8 @@ public:
 	static std::shared_ptr<ScriptContext> get(const std::string& type);
 	static std::vector<std::string> listContexts();
 	static void reset();
+	// Changes whenever reset() discards the contexts
+	static uint64_t generation();
 
 	virtual void setData(GameData*);
 	virtual void setScenario(const Scenario*);
@@ -23,9 +25,18 @@ public:
 	virtual bool init() = 0;
 	virtual bool load(const std::string&) = 0;
 	virtual bool loadString(const std::string&) = 0;
+	// Return the scripts to the state they had right after loading, without
+	// reading or compiling them again
+	virtual bool restart() = 0;
 	virtual Variant callFunction(const std::string&) = 0;
+	// Resolves a function once so it can be called without looking it up by
+	// name. Bindings are re-resolved after every load and restart()
+	virtual size_t bindFunction(const std::string&) = 0;
+	virtual Variant callBound(size_t) = 0;
 	virtual std::vector<std::string> listFunctions() = 0;
 
+	bool isBoundTo(const Scenario*) const;
+
 protected:
 	GameData* data();
 	const Scenario* scenario();
@@ -1,7 +1,13 @@
 #include "search.h"
 
 #include "data.h"
+#include "thread-pool.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -92,16 +98,70 @@ Search::Search(const vector<DataType>& types)
 	: m_types(types) {
 }
 
+static uint64_t searchBytes(int64_t value) {
+	uint64_t unsignedValue = value;
+	if (value < 0) {
+		if (value > -0x100) {
+			unsignedValue = value & 0xFF;
+		} else if (value > -0x10000) {
+			unsignedValue = value & 0xFFFF;
+		} else if (value > -0x100000000) {
+			unsignedValue = value & 0xFFFFFFFF;
+		}
+	}
+	return unsignedValue;
+}
+
+// Finds every occurrence of each of the given distinct byte values in a
+// single pass over each block. positions is indexed by byte value
+static void scanBytes(const AddressSpace& mem, const vector<uint8_t>& values, vector<vector<size_t>>* positions) {
+	positions->assign(256, {});
+	bool wanted[256]{};
+	for (uint8_t value : values) {
+		wanted[value] = true;
+	}
+#ifdef __SSE2__
+	__m128i needles[256];
+	for (size_t v = 0; v < values.size(); ++v) {
+		needles[v] = _mm_set1_epi8(static_cast<char>(values[v]));
+	}
+#endif
+	for (const auto& block : mem.blocks()) {
+		const uint8_t* data = static_cast<const uint8_t*>(block.second.offset(0));
+		size_t size = block.second.size();
+		size_t i = 0;
+#ifdef __SSE2__
+		for (; i + 16 <= size; i += 16) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&data[i]));
+			for (size_t v = 0; v < values.size(); ++v) {
+				unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needles[v]));
+				while (mask) {
+					(*positions)[values[v]].push_back(block.first + i + __builtin_ctz(mask));
+					mask &= mask - 1;
+				}
+			}
+		}
+#endif
+		for (; i < size; ++i) {
+			if (wanted[data[i]]) {
+				(*positions)[data[i]].push_back(block.first + i);
+			}
+		}
+	}
+}
+
 void Search::search(const AddressSpace& mem, int64_t value) {
-	vector<SearchResult> results = makeResults(searchValue(mem, value));
+	// Every scaled, biased and BCD encoded form of the value that is searched
+	// for, along with the transformation that maps it back
+	vector<pair<int64_t, SearchResult>> variants;
+	variants.push_back({ value, { 0, 1, 1, 0 } });
 
 	int64_t vscale = 1;
 	int64_t v10 = value;
 	while (v10 && !(v10 % 10)) {
 		v10 /= 10;
 		vscale *= 10;
-		const auto& r = makeResults(searchValue(mem, v10), 1, vscale);
-		results.insert(results.end(), r.begin(), r.end());
+		variants.push_back({ v10, { 0, 1, static_cast<uint64_t>(vscale), 0 } });
 	}
 
 	vscale = 1;
@@ -109,8 +169,7 @@ void Search::search(const AddressSpace& mem, int64_t value) {
 	while (v16 && !(v16 & 0xF)) {
 		v16 >>= 4;
 		vscale <<= 4;
-		const auto& r = makeResults(searchValue(mem, v16), 1, vscale);
-		results.insert(results.end(), r.begin(), r.end());
+		variants.push_back({ v16, { 0, 1, static_cast<uint64_t>(vscale), 0 } });
 	}
 
 	vscale = 1;
@@ -118,52 +177,50 @@ void Search::search(const AddressSpace& mem, int64_t value) {
 	while (v2 && v2 < 0x100000000 && vscale < 4) {
 		v2 <<= 1;
 		vscale <<= 1;
-		const auto& r = makeResults(searchValue(mem, v2), vscale);
-		results.insert(results.end(), r.begin(), r.end());
+		variants.push_back({ v2, { 0, static_cast<uint64_t>(vscale), 1, 0 } });
 	}
 
-	int64_t v1 = value + 1;
-	{
-		const auto& r = makeResults(searchValue(mem, v1), 1, 1, 1);
-		results.insert(results.end(), r.begin(), r.end());
-	}
-
-	v1 = value - 1;
-	{
-		const auto& r = makeResults(searchValue(mem, v1), 1, 1, -1);
-		results.insert(results.end(), r.begin(), r.end());
-	}
+	variants.push_back({ value + 1, { 0, 1, 1, 1 } });
+	variants.push_back({ value - 1, { 0, 1, 1, -1 } });
 
 	int64_t vBcd = toBcd(value);
 	if (vBcd != value) {
-		{
-			const auto& r = makeResults(searchValue(mem, vBcd));
-			results.insert(results.end(), r.begin(), r.end());
-		}
+		variants.push_back({ vBcd, { 0, 1, 1, 0 } });
 		vscale = 1;
 		while (vBcd && !(vBcd & 0xF)) {
 			vBcd >>= 4;
 			vscale <<= 4;
-			const auto& r = makeResults(searchValue(mem, vBcd), 1, vscale);
-			results.insert(results.end(), r.begin(), r.end());
+			variants.push_back({ vBcd, { 0, 1, static_cast<uint64_t>(vscale), 0 } });
 		}
 	}
 
 	int64_t vNBcd = toLNBcd(value);
 	if (vNBcd != value) {
-		{
-			const auto& r = makeResults(searchValue(mem, vNBcd));
-			results.insert(results.end(), r.begin(), r.end());
-		}
+		variants.push_back({ vNBcd, { 0, 1, 1, 0 } });
 		vscale = 1;
 		while (vNBcd && !(vNBcd & 0xF)) {
 			vNBcd >>= 8;
 			vscale <<= 8;
-			const auto& r = makeResults(searchValue(mem, vNBcd), 1, vscale);
-			results.insert(results.end(), r.begin(), r.end());
+			variants.push_back({ vNBcd, { 0, 1, static_cast<uint64_t>(vscale), 0 } });
 		}
 	}
 
+	vector<uint8_t> firstBytes;
+	for (const auto& variant : variants) {
+		uint8_t b = searchBytes(variant.first);
+		if (find(firstBytes.begin(), firstBytes.end(), b) == firstBytes.end()) {
+			firstBytes.push_back(b);
+		}
+	}
+	vector<vector<size_t>> positions;
+	scanBytes(mem, firstBytes, &positions);
+
+	vector<SearchResult> results;
+	for (const auto& variant : variants) {
+		const auto& r = makeResults(searchValue(mem, variant.first, positions), variant.second.mult, variant.second.div, variant.second.bias);
+		results.insert(results.end(), r.begin(), r.end());
+	}
+
 	sort(results.begin(), results.end());
 	auto last = unique(results.begin(), results.end());
 	results.erase(last, results.end());
@@ -172,6 +229,11 @@ void Search::search(const AddressSpace& mem, int64_t value) {
 }
 
 void Search::delta(const AddressSpace& mem, const AddressSpace& oldMem, Operation op, int64_t reference) {
+	if (!m_hasStarted || m_dense) {
+		deltaDense(mem, oldMem, op, reference);
+		return;
+	}
+
 	vector<DataType> newTypes;
 	multimap<size_t, DataType> results;
 	for (const auto& type : m_types) {
@@ -224,9 +286,207 @@ void Search::delta(const AddressSpace& mem, const AddressSpace& oldMem, Operatio
 	intersectCurrent(move(results2));
 }
 
+// Delta searches from every Search share one pool and take turns using it
+static mutex s_poolMutex;
+
+static ThreadPool& searchPool() {
+	static ThreadPool pool;
+	return pool;
+}
+
+// Number of bitmap words, each covering 64 addresses, tested per task
+static const size_t s_wordsPerTask = 1024;
+
+// Tests the set bits in words [begin, end) of a bitmap, where decode reads the
+// value at an offset into a block. The first search of a block starts with all
+// count addresses set
+template<typename Decode>
+static bool deltaWords(const Decode& decode, const uint8_t* data, const uint8_t* oldData, uint64_t* words, size_t begin, size_t end, size_t count, bool first, Operation op, int64_t reference) {
+	bool found = false;
+	for (size_t w = begin; w < end; ++w) {
+		uint64_t word = words[w];
+		if (first) {
+			word = count - w * 64 >= 64 ? ~0ULL : (1ULL << (count - w * 64)) - 1;
+		}
+		uint64_t out = 0;
+		while (word) {
+			unsigned bit = __builtin_ctzll(word);
+			size_t i = w * 64 + bit;
+			out |= static_cast<uint64_t>(calculate(op, reference, decode(data, i) - decode(oldData, i)) != 0) << bit;
+			word &= word - 1;
+		}
+		words[w] = out;
+		found = found || out;
+	}
+	return found;
+}
+
+static bool deltaRange(const DataType& type, const MemoryOverlay& overlay, const MemoryView<>& block, const MemoryView<>& oldBlock, uint64_t* words, size_t begin, size_t end, size_t count, bool first, Operation op, int64_t reference) {
+	const uint8_t* data = static_cast<const uint8_t*>(block.offset(0));
+	const uint8_t* oldData = static_cast<const uint8_t*>(oldBlock.offset(0));
+	auto run = [&](const auto& decode) {
+		return deltaWords(decode, data, oldData, words, begin, end, count, first, op, reference);
+	};
+
+	// Plain integers are decoded inline; everything else goes through the
+	// generic decoder
+	if (overlay.width <= 1 && (type.repr == Repr::UNSIGNED || type.repr == Repr::SIGNED)) {
+		bool sign = type.repr == Repr::SIGNED;
+		Endian endian = type.width == 1 ? Endian::LITTLE : reduce(type.endian);
+		if (type.width == 1) {
+			if (sign) {
+				return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<int8_t>(p[i]); });
+			}
+			return run([](const uint8_t* p, size_t i) -> int64_t { return p[i]; });
+		}
+		if (type.width == 2 && endian == Endian::LITTLE) {
+			if (sign) {
+				return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<int16_t>(p[i] | p[i + 1] << 8); });
+			}
+			return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<uint16_t>(p[i] | p[i + 1] << 8); });
+		}
+		if (type.width == 2 && endian == Endian::BIG) {
+			if (sign) {
+				return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<int16_t>(p[i] << 8 | p[i + 1]); });
+			}
+			return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<uint16_t>(p[i] << 8 | p[i + 1]); });
+		}
+		if (type.width == 4 && endian == Endian::LITTLE) {
+			if (sign) {
+				return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<int32_t>(p[i] | p[i + 1] << 8 | p[i + 2] << 16 | static_cast<uint32_t>(p[i + 3]) << 24); });
+			}
+			return run([](const uint8_t* p, size_t i) -> int64_t { return p[i] | p[i + 1] << 8 | p[i + 2] << 16 | static_cast<uint32_t>(p[i + 3]) << 24; });
+		}
+		if (type.width == 4 && endian == Endian::BIG) {
+			if (sign) {
+				return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<int32_t>(static_cast<uint32_t>(p[i]) << 24 | p[i + 1] << 16 | p[i + 2] << 8 | p[i + 3]); });
+			}
+			return run([](const uint8_t* p, size_t i) -> int64_t { return static_cast<uint32_t>(p[i]) << 24 | p[i + 1] << 16 | p[i + 2] << 8 | p[i + 3]; });
+		}
+	}
+	// Same as DynamicMemoryView
+	return run([&type, &overlay](const uint8_t* p, size_t i) -> int64_t {
+		if (overlay.width > 1) {
+			uint8_t fakeBase[16]{};
+			return type.decode(overlay.parse(p, i, reinterpret_cast<void*>(fakeBase), type.width));
+		}
+		return type.decode(&p[i]);
+	});
+}
+
+void Search::deltaDense(const AddressSpace& mem, const AddressSpace& oldMem, Operation op, int64_t reference) {
+	bool first = !m_hasStarted;
+	if (first) {
+		m_bitmaps.clear();
+		for (const auto& type : m_types) {
+			m_bitmaps.push_back({ type, {} });
+		}
+	}
+
+	// Split every (type, block) bitmap into ranges of words that are tested in
+	// parallel. Each task owns its words, so the result doesn't depend on the
+	// order in which tasks run
+	struct Task {
+		size_t bitmap;
+		const MemoryView<>* block;
+		const MemoryView<>* oldBlock;
+		uint64_t* words;
+		size_t begin;
+		size_t end;
+		size_t count;
+	};
+	vector<Task> tasks;
+	for (size_t b = 0; b < m_bitmaps.size(); ++b) {
+		TypeBitmap& bitmap = m_bitmaps[b];
+		for (const auto& block : mem.blocks()) {
+			size_t count = block.second.size() >= bitmap.type.width ? block.second.size() - bitmap.type.width + 1 : 0;
+			size_t words = (count + 63) / 64;
+			auto bits = bitmap.blocks.find(block.first);
+			if (first) {
+				bits = bitmap.blocks.emplace(block.first, vector<uint64_t>(words, 0)).first;
+			} else if (bits == bitmap.blocks.end()) {
+				continue;
+			} else if (bits->second.size() > words) {
+				bits->second.resize(words);
+			}
+			const MemoryView<>& oldBlock = oldMem.block(block.first);
+			for (size_t w = 0; w < bits->second.size(); w += s_wordsPerTask) {
+				tasks.push_back({ b, &block.second, &oldBlock, bits->second.data(), w, min(w + s_wordsPerTask, bits->second.size()), count });
+			}
+		}
+	}
+
+	vector<uint8_t> found(tasks.size());
+	const MemoryOverlay& overlay = mem.overlay();
+	{
+		lock_guard<mutex> lock(s_poolMutex);
+		searchPool().run(tasks.size(), [&](size_t i) {
+			const Task& task = tasks[i];
+			found[i] = deltaRange(m_bitmaps[task.bitmap].type, overlay, *task.block, *task.oldBlock, task.words, task.begin, task.end, task.count, first, op, reference);
+		});
+	}
+
+	vector<bool> typeFound(m_bitmaps.size());
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		if (found[i]) {
+			typeFound[tasks[i].bitmap] = true;
+		}
+	}
+	vector<DataType> newTypes;
+	vector<TypeBitmap> bitmaps;
+	for (size_t b = 0; b < m_bitmaps.size(); ++b) {
+		if (typeFound[b]) {
+			newTypes.emplace_back(m_bitmaps[b].type);
+			bitmaps.emplace_back(move(m_bitmaps[b]));
+		}
+	}
+	m_types = move(newTypes);
+	m_bitmaps = move(bitmaps);
+	m_dense = true;
+	m_currentStale = true;
+	m_hasStarted = true;
+}
+
+// Lists the dense candidates ordered by address, then by type
+const vector<TypedSearchResult>& Search::current() const {
+	if (!m_dense || !m_currentStale) {
+		return m_current;
+	}
+	m_current.clear();
+	map<size_t, size_t> blocks;
+	for (const auto& bitmap : m_bitmaps) {
+		for (const auto& bits : bitmap.blocks) {
+			blocks[bits.first] = max(blocks[bits.first], bits.second.size());
+		}
+	}
+	for (const auto& block : blocks) {
+		for (size_t w = 0; w < block.second; ++w) {
+			uint64_t any = 0;
+			for (const auto& bitmap : m_bitmaps) {
+				auto bits = bitmap.blocks.find(block.first);
+				if (bits != bitmap.blocks.end() && w < bits->second.size()) {
+					any |= bits->second[w];
+				}
+			}
+			while (any) {
+				unsigned bit = __builtin_ctzll(any);
+				for (const auto& bitmap : m_bitmaps) {
+					auto bits = bitmap.blocks.find(block.first);
+					if (bits != bitmap.blocks.end() && w < bits->second.size() && (bits->second[w] >> bit) & 1) {
+						m_current.emplace_back(SearchResult{ block.first + w * 64 + bit, 1, 1, 0 }, bitmap.type);
+					}
+				}
+				any &= any - 1;
+			}
+		}
+	}
+	m_currentStale = false;
+	return m_current;
+}
+
 vector<SearchResult> Search::results() const {
 	vector<SearchResult> results;
-	for (const auto& iter : m_current) {
+	for (const auto& iter : current()) {
 		if (results.size() && results.back() == iter) {
 			continue;
 		}
@@ -237,7 +497,7 @@ vector<SearchResult> Search::results() const {
 }
 
 const vector<TypedSearchResult>& Search::typedResults() const {
-	return m_current;
+	return current();
 }
 
 vector<DataType> Search::validTypes() const {
@@ -246,10 +506,36 @@ vector<DataType> Search::validTypes() const {
 
 void Search::stuff(const vector<TypedSearchResult>& fakeResults) {
 	m_current = vector<TypedSearchResult>(fakeResults.begin(), fakeResults.end());
+	m_bitmaps.clear();
+	m_dense = false;
 	m_hasStarted = true;
 }
 
 void Search::remove(const vector<TypedSearchResult>& removedResults) {
+	if (m_dense) {
+		for (const auto& result : removedResults) {
+			if (result.mult != 1 || result.div != 1 || result.bias != 0) {
+				continue;
+			}
+			for (auto& bitmap : m_bitmaps) {
+				if (bitmap.type != result.type) {
+					continue;
+				}
+				auto bits = bitmap.blocks.upper_bound(result.address);
+				if (bits == bitmap.blocks.begin()) {
+					continue;
+				}
+				--bits;
+				size_t i = result.address - bits->first;
+				if (i / 64 < bits->second.size()) {
+					bits->second[i / 64] &= ~(1ULL << (i % 64));
+				}
+			}
+		}
+		m_currentStale = true;
+		return;
+	}
+
 	vector<TypedSearchResult> out;
 	unordered_set<TypedSearchResult, hash<TypedSearchResult>> results{ removedResults.begin(), removedResults.end() };
 	for (const auto& result : m_current) {
@@ -261,10 +547,60 @@ void Search::remove(const vector<TypedSearchResult>& removedResults) {
 }
 
 size_t Search::numResults() const {
-	return m_current.size();
+	if (!m_dense) {
+		return m_current.size();
+	}
+	size_t count = 0;
+	for (const auto& bitmap : m_bitmaps) {
+		for (const auto& bits : bitmap.blocks) {
+			for (uint64_t word : bits.second) {
+				count += __builtin_popcountll(word);
+			}
+		}
+	}
+	return count;
 }
 
 bool Search::hasUniqueResult() const {
+	if (m_dense) {
+		// Mirror the sparse check against the front of current(): the lowest
+		// candidate address, typed by the first bitmap that holds it. Every
+		// dense candidate shares its transform, so only addresses compare
+		size_t front = SIZE_MAX;
+		size_t end = SIZE_MAX;
+		for (const auto& bitmap : m_bitmaps) {
+			for (const auto& bits : bitmap.blocks) {
+				auto word = find_if(bits.second.begin(), bits.second.end(), [](uint64_t w) { return w != 0; });
+				if (word == bits.second.end()) {
+					continue;
+				}
+				size_t address = bits.first + (word - bits.second.begin()) * 64 + __builtin_ctzll(*word);
+				if (address < front) {
+					front = address;
+					end = address + bitmap.type.width - 1;
+				}
+				break;
+			}
+		}
+		if (front == SIZE_MAX) {
+			return false;
+		}
+		for (const auto& bitmap : m_bitmaps) {
+			for (const auto& bits : bitmap.blocks) {
+				for (size_t w = 0; w < bits.second.size(); ++w) {
+					uint64_t word = bits.second[w];
+					while (word) {
+						size_t address = bits.first + w * 64 + __builtin_ctzll(word);
+						if (address != front && address + bitmap.type.width - 1 != end) {
+							return false;
+						}
+						word &= word - 1;
+					}
+				}
+			}
+		}
+		return true;
+	}
 	if (!m_current.size()) {
 		return false;
 	}
@@ -281,7 +617,7 @@ bool Search::hasUniqueResult() const {
 }
 
 TypedSearchResult Search::uniqueResult() const {
-	return m_current.front();
+	return current().front();
 }
 
 Search& Search::operator=(const Search& other) {
@@ -289,6 +625,12 @@ Search& Search::operator=(const Search& other) {
 	for (const auto& iter : other.m_current) {
 		m_current.emplace_back(iter);
 	}
+	m_currentStale = other.m_currentStale;
+	m_bitmaps.clear();
+	for (const auto& iter : other.m_bitmaps) {
+		m_bitmaps.emplace_back(iter);
+	}
+	m_dense = other.m_dense;
 	m_types.clear();
 	for (const auto& iter : other.m_types) {
 		m_types.emplace_back(iter);
@@ -305,17 +647,8 @@ vector<SearchResult> Search::makeResults(vector<size_t> addrs, uint64_t mult, ui
 	return out;
 }
 
-vector<size_t> Search::searchValue(const AddressSpace& mem, int64_t value) {
-	uint64_t unsignedValue = value;
-	if (value < 0) {
-		if (value > -0x100) {
-			unsignedValue = value & 0xFF;
-		} else if (value > -0x10000) {
-			unsignedValue = value & 0xFFFF;
-		} else if (value > -0x100000000) {
-			unsignedValue = value & 0xFFFFFFFF;
-		}
-	}
+vector<size_t> Search::searchValue(const AddressSpace& mem, int64_t value, const vector<vector<size_t>>& firstBytes) {
+	uint64_t unsignedValue = searchBytes(value);
 
 	vector<size_t> start;
 	vector<size_t> end;
@@ -328,8 +661,14 @@ vector<size_t> Search::searchValue(const AddressSpace& mem, int64_t value) {
 			const auto& e = searchByte(mem, b, end, 1);
 			start.insert(start.end(), s.begin(), s.end());
 			end.insert(end.end(), e.begin(), e.end());
+		} else if (nbytes == 1) {
+			start = firstBytes[b];
+			end = start;
 		} else {
-			start = searchByte(mem, b);
+			// Only the first byte of each variant was scanned up front
+			vector<vector<size_t>> positions;
+			scanBytes(mem, { b }, &positions);
+			start = move(positions[b]);
 			end = start;
 		}
 		unsignedValue >>= 8;
@@ -358,35 +697,33 @@ vector<size_t> Search::searchValue(const AddressSpace& mem, int64_t value) {
 	return results;
 }
 
-vector<size_t> Search::searchByte(const AddressSpace& mem, uint8_t value, const vector<size_t> addresses, ssize_t offset) {
+vector<size_t> Search::searchByte(const AddressSpace& mem, uint8_t value, const vector<size_t>& addresses, ssize_t offset) {
 	vector<size_t> results;
-	if (addresses.size()) {
-		for (const auto& i : addresses) {
-			if (offset < 0 && i < -offset) {
-				continue;
-			} else if (!mem.hasBlock(i) || !mem.hasBlock(i + offset)) {
-				continue;
-			}
-			if (mem[i + offset] == value) {
-				results.push_back(i + offset);
-			}
+	bool overlay = mem.overlay().width > 1;
+	for (const auto& i : addresses) {
+		if (offset < 0 && i < -offset) {
+			continue;
 		}
-	} else {
-		for (const auto& block : mem.blocks()) {
-			if (offset < 0) {
-				offset = 0;
-			}
-			for (ssize_t i = offset; i < block.second.size(); ++i) {
-				if (block.second[i] == value) {
-					results.push_back(i + block.first);
-				}
-			}
+		size_t address = i + offset;
+		size_t local;
+		const MemoryView<>* block = mem.find(address, &local);
+		if (!block) {
+			continue;
+		}
+		uint8_t byte;
+		if (overlay) {
+			byte = mem[address];
+		} else {
+			byte = *static_cast<const uint8_t*>(block->offset(local));
+		}
+		if (byte == value) {
+			results.push_back(address);
 		}
 	}
 	return results;
 }
 
-vector<size_t> Search::overlap(const vector<size_t> start, vector<size_t> end, size_t width) {
+vector<size_t> Search::overlap(const vector<size_t>& start, const vector<size_t>& end, size_t width) {
 	vector<size_t> results;
 	auto siter = start.cbegin();
 	auto eiter = end.cbegin();
@@ -447,7 +784,33 @@ void Search::reduceOnTypes(const AddressSpace& mem, const vector<SearchResult>&
 }
 
 void Search::intersectCurrent(vector<TypedSearchResult>&& results) {
-	if (m_hasStarted) {
+	if (m_dense) {
+		// Value searches only keep the candidates that are still in the bitmaps
+		vector<TypedSearchResult> out;
+		for (const auto& result : results) {
+			if (result.mult != 1 || result.div != 1 || result.bias != 0) {
+				continue;
+			}
+			for (const auto& bitmap : m_bitmaps) {
+				if (bitmap.type != result.type) {
+					continue;
+				}
+				auto bits = bitmap.blocks.upper_bound(result.address);
+				if (bits == bitmap.blocks.begin()) {
+					break;
+				}
+				--bits;
+				size_t i = result.address - bits->first;
+				if (i / 64 < bits->second.size() && (bits->second[i / 64] >> (i % 64)) & 1) {
+					out.emplace_back(result);
+				}
+				break;
+			}
+		}
+		m_current = move(out);
+		m_bitmaps.clear();
+		m_dense = false;
+	} else if (m_hasStarted) {
 		vector<TypedSearchResult> out;
 		auto oldResults = m_current.begin();
 		for (const auto& result : results) {
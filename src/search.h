@@ -3,6 +3,7 @@
 #include "memory.h"
 #include "utils.h"
 
+#include <map>
 #include <vector>
 
 namespace Retro {
@@ -52,15 +53,33 @@ public:
 
 private:
 	std::vector<SearchResult> makeResults(std::vector<size_t> addrs, uint64_t mult = 1, uint64_t div = 1, int64_t bias = 0);
-	std::vector<size_t> searchValue(const AddressSpace& mem, int64_t value);
-	std::vector<size_t> searchByte(const AddressSpace& mem, uint8_t value, const std::vector<size_t> addresses = {}, ssize_t offset = 0);
-	std::vector<size_t> overlap(const std::vector<size_t> start, std::vector<size_t> end, size_t width);
+	// firstBytes holds the sorted addresses of every byte value that starts
+	// one of the searched values, as found by scanBytes
+	std::vector<size_t> searchValue(const AddressSpace& mem, int64_t value, const std::vector<std::vector<size_t>>& firstBytes);
+	std::vector<size_t> searchByte(const AddressSpace& mem, uint8_t value, const std::vector<size_t>& addresses, ssize_t offset);
+	std::vector<size_t> overlap(const std::vector<size_t>& start, const std::vector<size_t>& end, size_t width);
 	void reduceOnTypes(const AddressSpace& mem, const std::vector<SearchResult>&, int64_t value);
 
 	void intersectCurrent(std::vector<TypedSearchResult>&&);
 	void differenceCurrent(const std::vector<TypedSearchResult>&);
 
-	std::vector<TypedSearchResult> m_current;
+	// Candidates of one type as a bit per address of each block, keyed by the
+	// start of the block. Delta searches keep their untransformed candidates
+	// in these until a value search or stuff() narrows them down
+	struct TypeBitmap {
+		DataType type;
+		std::map<size_t, std::vector<uint64_t>> blocks;
+	};
+
+	void deltaDense(const AddressSpace& mem, const AddressSpace& oldMem, Operation op, int64_t reference);
+	const std::vector<TypedSearchResult>& current() const;
+
+	// Holds the results when they aren't dense, otherwise a cache of the
+	// bitmaps that current() rebuilds when it is stale
+	mutable std::vector<TypedSearchResult> m_current;
+	mutable bool m_currentStale = false;
+	std::vector<TypeBitmap> m_bitmaps;
+	bool m_dense = false;
 	std::vector<DataType> m_types;
 	bool m_hasStarted = false;
 };
@@ -0,0 +1,44 @@
+#include "state-pool.h"
+
+#include "emulator.h"
+
+using namespace std;
+using namespace Retro;
+
+bool StatePool::allocate(Emulator& emulator, size_t slots) {
+	emulator.ensureInitializedForSerialization();
+	size_t size = emulator.serializeSize();
+	if (!size) {
+		return false;
+	}
+	m_slotSize = size;
+	m_arena.assign(slots * size, 0);
+	m_sizes.assign(slots, 0);
+	return true;
+}
+
+void StatePool::clear() {
+	m_arena.clear();
+	m_arena.shrink_to_fit();
+	m_sizes.clear();
+	m_slotSize = 0;
+}
+
+bool StatePool::save(Emulator& emulator, size_t index) {
+	if (index >= numSlots()) {
+		return false;
+	}
+	size_t size = emulator.serializeSize();
+	if (size > m_slotSize || !emulator.serialize(slot(index), size)) {
+		return false;
+	}
+	m_sizes[index] = size;
+	return true;
+}
+
+bool StatePool::load(Emulator& emulator, size_t index) const {
+	if (index >= numSlots() || !m_sizes[index]) {
+		return false;
+	}
+	return emulator.unserialize(slot(index), m_sizes[index]);
+}
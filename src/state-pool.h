@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Retro {
+
+class Emulator;
+
+// A fixed number of savestate slots in one preallocated arena. Saving and
+// loading a slot never allocates, so slot pointers stay valid until the next
+// allocate()
+class StatePool {
+public:
+	// Sizes every slot for the current serializeSize() of the emulator
+	bool allocate(Emulator&, size_t slots);
+	void clear();
+
+	size_t numSlots() const { return m_sizes.size(); }
+	size_t slotSize() const { return m_slotSize; }
+	// Size of the state saved in a slot, or 0 if it is empty
+	size_t stateSize(size_t slot) const { return m_sizes[slot]; }
+
+	const uint8_t* slot(size_t slot) const { return &m_arena[slot * m_slotSize]; }
+	uint8_t* slot(size_t slot) { return &m_arena[slot * m_slotSize]; }
+
+	// Fail if the slot is out of range, the core's state outgrew the slot or
+	// the slot has never been saved to
+	bool save(Emulator&, size_t slot);
+	bool load(Emulator&, size_t slot) const;
+
+private:
+	std::vector<uint8_t> m_arena;
+	std::vector<size_t> m_sizes;
+	size_t m_slotSize = 0;
+};
+}
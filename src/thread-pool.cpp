@@ -0,0 +1,89 @@
+#include "thread-pool.h"
+
+using namespace std;
+using namespace Retro;
+
+ThreadPool::ThreadPool(size_t threads) {
+	if (!threads) {
+		threads = thread::hardware_concurrency();
+	}
+	for (size_t i = 1; i < threads; ++i) {
+		m_threads.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::run(size_t tasks, const function<void(size_t)>& task) {
+	if (!tasks) {
+		return;
+	}
+	if (m_threads.empty() || tasks == 1) {
+		for (size_t i = 0; i < tasks; ++i) {
+			task(i);
+		}
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_task = &task;
+		m_tasks = tasks;
+		m_next = 0;
+		m_busy = m_threads.size() + 1;
+		m_error = nullptr;
+		++m_generation;
+	}
+	m_wake.notify_all();
+	drain();
+
+	unique_lock<mutex> lock(m_mutex);
+	m_finished.wait(lock, [this]() { return m_busy == 0; });
+	m_task = nullptr;
+	if (m_error) {
+		exception_ptr error = m_error;
+		m_error = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+void ThreadPool::work() {
+	uint64_t generation = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [this, generation]() { return m_stop || m_generation != generation; });
+			if (m_stop) {
+				return;
+			}
+			generation = m_generation;
+		}
+		drain();
+	}
+}
+
+void ThreadPool::drain() {
+	for (size_t i = m_next++; i < m_tasks; i = m_next++) {
+		try {
+			(*m_task)(i);
+		} catch (...) {
+			lock_guard<mutex> lock(m_mutex);
+			if (!m_error) {
+				m_error = current_exception();
+			}
+		}
+	}
+	lock_guard<mutex> lock(m_mutex);
+	if (--m_busy == 0) {
+		m_finished.notify_one();
+	}
+}
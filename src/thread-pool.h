@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Retro {
+
+class ThreadPool {
+public:
+	// A thread count of 0 uses one thread per hardware thread
+	ThreadPool(size_t threads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+
+	size_t size() const { return m_threads.size() + 1; }
+
+	// Calls task(i) for every i in [0, tasks) and returns once all calls have
+	// finished. The calling thread takes part in the work. The first exception
+	// thrown by a task is rethrown here
+	void run(size_t tasks, const std::function<void(size_t)>& task);
+
+private:
+	void work();
+	void drain();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_finished;
+
+	const std::function<void(size_t)>* m_task = nullptr;
+	size_t m_tasks = 0;
+	std::atomic<size_t> m_next{ 0 };
+	size_t m_busy = 0;
+	uint64_t m_generation = 0;
+	bool m_stop = false;
+	std::exception_ptr m_error;
+};
+}
@@ -530,6 +530,9 @@ void EmulatorController::runOnce() {
 		case 15:
 			format = QImage::Format_RGB555;
 			break;
+		case 8:
+			format = QImage::Format_Grayscale8;
+			break;
 		}
 		m_screen = QImage(static_cast<const uchar*>(m_re.getImageData()), m_re.getImageWidth(), m_re.getImageHeight(), m_re.getImagePitch(), format);
 		m_crop = crop;
@@ -0,0 +1,211 @@
+#include "vector-emulator.h"
+
+#include "imageops.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace Retro;
+
+static size_t defaultThreads(size_t numEnvs) {
+	size_t threads = thread::hardware_concurrency();
+	if (!threads) {
+		threads = 1;
+	}
+	return min(threads, max<size_t>(numEnvs, 1));
+}
+
+VectorEmulator::VectorEmulator(size_t numEnvs, size_t numThreads)
+	: m_pool(numThreads ? numThreads : defaultThreads(numEnvs)) {
+	for (size_t i = 0; i < numEnvs; ++i) {
+		m_envs.emplace_back(make_unique<Env>());
+	}
+}
+
+bool VectorEmulator::loadRom(const string& romPath) {
+	for (auto& env : m_envs) {
+		// Nothing reads audio back from a batch, so let cores skip it
+		env->emulator.setAudioEnabled(false);
+		if (!env->emulator.loadRom(romPath)) {
+			return false;
+		}
+		env->emulator.configureData(&env->data);
+	}
+	// Cores only report a usable frame after running once
+	parallel([this](size_t i) {
+		m_envs[i]->emulator.run();
+	});
+	if (!m_envs.empty()) {
+		m_buttons = m_envs[0]->emulator.buttons().size();
+		m_width = m_envs[0]->emulator.getImageWidth();
+		m_height = m_envs[0]->emulator.getImageHeight();
+	}
+	return true;
+}
+
+bool VectorEmulator::loadData(const string& dataPath, const string& scenarioPath) {
+	for (auto& env : m_envs) {
+		if (!dataPath.empty() && !env->data.load(dataPath)) {
+			return false;
+		}
+		if (!scenarioPath.empty() && !env->scenario.load(scenarioPath)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool VectorEmulator::isScripted() const {
+	for (const auto& env : m_envs) {
+		const Scenario& scen = env->scenario;
+		if (!scen.scripts().empty() || !scen.doneFunction().first.empty()) {
+			return true;
+		}
+		for (unsigned player = 0; player < MAX_PLAYERS; ++player) {
+			if (!scen.rewardFunction(player).first.empty()) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void VectorEmulator::setInitialState(const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	m_initialState.assign(bytes, bytes + size);
+}
+
+void VectorEmulator::reset() {
+	parallel([this](size_t i) {
+		reset(i);
+	});
+}
+
+void VectorEmulator::reset(size_t env) {
+	Env& e = *m_envs[env];
+	if (!m_initialState.empty()) {
+		e.emulator.unserialize(m_initialState.data(), m_initialState.size());
+	}
+	for (int player = 0; player < MAX_PLAYERS; ++player) {
+		e.emulator.setButtonMask(player, 0);
+	}
+	e.emulator.setVideoEnabled(true);
+	e.emulator.run();
+	e.scenario.restart();
+	e.data.updateRam();
+	e.scenario.update();
+}
+
+void VectorEmulator::step(const uint8_t* actions, unsigned players, bool filterActions, uint8_t* observations, float* rewards, bool* dones) {
+	if (players > MAX_PLAYERS) {
+		throw invalid_argument("players > MAX_PLAYERS");
+	}
+	size_t rowSize = players * m_buttons;
+	parallel([&](size_t i) {
+		Env& e = *m_envs[i];
+		const uint8_t* row = &actions[i * rowSize];
+		for (unsigned player = 0; player < players; ++player) {
+			unsigned action = 0;
+			for (size_t key = 0; key < m_buttons; ++key) {
+				action |= (row[player * m_buttons + key] ? 1u : 0u) << key;
+			}
+			if (filterActions) {
+				action = e.scenario.filterAction(action);
+			}
+			e.emulator.setButtonMask(player, action);
+		}
+		runEnv(i, players, observations, rewards, dones);
+	});
+}
+
+bool VectorEmulator::configureActions(ActionTable::Mode mode, unsigned players) {
+	if (m_envs.empty()) {
+		return false;
+	}
+	// Every env loads the same scenario
+	return m_actionTable.compile(m_envs[0]->scenario, mode, m_buttons, players);
+}
+
+void VectorEmulator::step(const int64_t* actions, uint8_t* observations, float* rewards, bool* dones) {
+	unsigned players = m_actionTable.players();
+	if (!players) {
+		throw logic_error("actions are not configured");
+	}
+	// Decode up front so a bad action fails before any env runs
+	size_t width = m_actionTable.width();
+	m_masks.resize(m_envs.size() * players);
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		if (!m_actionTable.decode(&actions[i * width], &m_masks[i * players])) {
+			throw out_of_range("action out of range");
+		}
+	}
+	parallel([&](size_t i) {
+		Env& e = *m_envs[i];
+		for (unsigned player = 0; player < players; ++player) {
+			e.emulator.setButtonMask(player, m_masks[i * players + player]);
+		}
+		runEnv(i, players, observations, rewards, dones);
+	});
+}
+
+void VectorEmulator::runEnv(size_t env, unsigned players, uint8_t* observations, float* rewards, bool* dones) {
+	Env& e = *m_envs[env];
+	// Cores that support it don't need to render frames nobody copies
+	e.emulator.setVideoEnabled(observations != nullptr);
+	e.emulator.run();
+	e.data.updateRam();
+	e.scenario.update();
+	if (observations) {
+		size_t frameSize = static_cast<size_t>(m_width) * m_height * 3;
+		copyScreen(env, &observations[env * frameSize]);
+	}
+	if (rewards) {
+		for (unsigned player = 0; player < players; ++player) {
+			rewards[env * players + player] = e.scenario.currentReward(player);
+		}
+	}
+	if (dones) {
+		dones[env] = e.scenario.isDone();
+	}
+}
+
+void VectorEmulator::copyScreen(size_t env, uint8_t* out) {
+	Emulator& emulator = m_envs[env]->emulator;
+	if (emulator.getImageWidth() != m_width || emulator.getImageHeight() != m_height) {
+		throw runtime_error("Screen size changed");
+	}
+	copyScreen(emulator, out);
+}
+
+void VectorEmulator::copyScreen(Emulator& emulator, uint8_t* out) {
+	int width = emulator.getImageWidth();
+	int height = emulator.getImageHeight();
+	const void* img = emulator.getImageData();
+	if (!img) {
+		throw runtime_error("Core did not provide a CPU framebuffer");
+	}
+	Image in;
+	if (emulator.getImageDepth() == 16) {
+		in = Image(Image::Format::RGB565, img, width, height, emulator.getImagePitch());
+	} else if (emulator.getImageDepth() == 32) {
+		in = Image(Image::Format::RGBX888, img, width, height, emulator.getImagePitch());
+	} else if (emulator.getImageDepth() == 8) {
+		in = Image(Image::Format::G8, img, width, height, emulator.getImagePitch());
+	} else {
+		throw runtime_error("Unsupported image depth from core");
+	}
+	Image dst(Image::Format::RGB888, out, width, height, width);
+	in.copyTo(&dst);
+}
+
+void VectorEmulator::parallel(const function<void(size_t)>& task) {
+	// GL contexts are bound to the thread that created them
+	if (!m_envs.empty() && m_envs[0]->emulator.isHWRenderEnabled()) {
+		for (size_t i = 0; i < m_envs.size(); ++i) {
+			task(i);
+		}
+		return;
+	}
+	m_pool.run(m_envs.size(), task);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "action-table.h"
+#include "data.h"
+#include "emulator.h"
+#include "thread-pool.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Retro {
+
+// Owns a batch of independent emulator, game data and scenario triples that
+// are stepped together on a thread pool
+class VectorEmulator {
+public:
+	VectorEmulator(size_t numEnvs, size_t numThreads = 0);
+	VectorEmulator(const VectorEmulator&) = delete;
+
+	bool loadRom(const std::string& romPath);
+	bool loadData(const std::string& dataPath, const std::string& scenarioPath);
+	bool isScripted() const;
+
+	void setInitialState(const void* data, size_t size);
+	void reset();
+	void reset(size_t env);
+
+	// actions holds numEnvs() rows of players * numButtons() bytes, one byte per
+	// button. observations receives numEnvs() RGB888 frames of
+	// screenHeight() * screenWidth() * 3 bytes and rewards numEnvs() rows of
+	// one reward per player; rewards and dones may be null. Without
+	// observations, cores that support it skip rendering the frame
+	void step(const uint8_t* actions, unsigned players, bool filterActions, uint8_t* observations, float* rewards, bool* dones);
+
+	// Compile the action space every env is stepped with by the overload below
+	bool configureActions(ActionTable::Mode, unsigned players);
+	const ActionTable& actionTable() const { return m_actionTable; }
+	// actions holds numEnvs() rows of actionTable().width() values and rewards
+	// receives numEnvs() rows of actionTable().players() values
+	void step(const int64_t* actions, uint8_t* observations, float* rewards, bool* dones);
+
+	size_t numEnvs() const { return m_envs.size(); }
+	size_t numThreads() const { return m_pool.size(); }
+	size_t numButtons() const { return m_buttons; }
+	int screenWidth() const { return m_width; }
+	int screenHeight() const { return m_height; }
+
+	Emulator& emulator(size_t env) { return m_envs[env]->emulator; }
+	GameData& data(size_t env) { return m_envs[env]->data; }
+	Scenario& scenario(size_t env) { return m_envs[env]->scenario; }
+
+	void copyScreen(size_t env, uint8_t* out);
+	static void copyScreen(Emulator&, uint8_t* out);
+
+private:
+	struct Env {
+		Emulator emulator;
+		GameData data;
+		Scenario scenario{ data };
+	};
+
+	void parallel(const std::function<void(size_t)>& task);
+	void runEnv(size_t env, unsigned players, uint8_t* observations, float* rewards, bool* dones);
+
+	std::vector<std::unique_ptr<Env>> m_envs;
+	ThreadPool m_pool;
+	std::vector<uint8_t> m_initialState;
+	ActionTable m_actionTable;
+	std::vector<uint16_t> m_masks;
+	size_t m_buttons = 0;
+	int m_width = 0;
+	int m_height = 0;
+};
+}
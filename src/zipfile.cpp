@@ -1,10 +1,14 @@
 #include "zipfile.h"
 
 #include <algorithm>
+#include <cstring>
 
 using namespace Retro;
 using namespace std;
 
+static const size_t WRITE_CHUNK = 64 * 1024;
+static const size_t COMPRESS_CHUNK = 16 * 1024;
+
 Zip::Zip(const string& path)
 	: m_path(path) {
 }
@@ -48,12 +52,51 @@ Zip::File* Zip::openFile(const std::string& name, bool write) {
 	return zf;
 }
 
+bool Zip::readFile(const string& name, vector<uint8_t>* data) {
+	if (!m_zip) {
+		return false;
+	}
+	zip_stat_t stat;
+	if (zip_stat(m_zip, name.c_str(), 0, &stat) < 0 || !(stat.valid & ZIP_STAT_SIZE)) {
+		return false;
+	}
+	zip_file_t* file = zip_fopen(m_zip, name.c_str(), 0);
+	if (!file) {
+		return false;
+	}
+	data->resize(stat.size);
+	zip_int64_t read = zip_fread(file, data->data(), data->size());
+	zip_fclose(file);
+	return read == static_cast<zip_int64_t>(data->size());
+}
+
+vector<string> Zip::list() const {
+	vector<string> names;
+	if (!m_zip) {
+		return names;
+	}
+	zip_int64_t entries = zip_get_num_entries(m_zip, 0);
+	for (zip_int64_t i = 0; i < entries; ++i) {
+		const char* name = zip_get_name(m_zip, i, 0);
+		if (name) {
+			names.emplace_back(name);
+		}
+	}
+	return names;
+}
+
 Zip::File::File(zip_t* zip, const std::string& name, zip_file_t* file)
 	: m_zip(zip)
 	, m_file(file)
 	, m_name(name) {
 }
 
+Zip::File::~File() {
+	if (m_deflating) {
+		deflateEnd(&m_deflate);
+	}
+}
+
 string Zip::File::readline() {
 	auto pos = m_buffer.end();
 	pos = find(m_buffer.begin(), m_buffer.end(), '\n');
@@ -88,20 +131,92 @@ ssize_t Zip::File::read(void* buffer, size_t size) {
 }
 
 ssize_t Zip::File::write(const void* buffer, size_t size) {
-	m_buffer.insert(m_buffer.end(), static_cast<const char*>(buffer), static_cast<const char*>(buffer) + size);
+	if (!m_deflating) {
+		if (deflateInit2(&m_deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			return -1;
+		}
+		m_deflating = true;
+		m_crc = crc32(0, nullptr, 0);
+		m_buffer.reserve(WRITE_CHUNK);
+	}
+	const char* bytes = static_cast<const char*>(buffer);
+	m_crc = crc32(m_crc, reinterpret_cast<const Bytef*>(bytes), size);
+	m_size += size;
+	m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+	if (m_buffer.size() >= WRITE_CHUNK) {
+		compress(Z_NO_FLUSH);
+	}
 	return size;
 }
 
+void Zip::File::compress(int flush) {
+	m_deflate.next_in = reinterpret_cast<Bytef*>(m_buffer.data());
+	m_deflate.avail_in = m_buffer.size();
+	int ret;
+	do {
+		size_t used = m_compressed.size();
+		m_compressed.resize(used + COMPRESS_CHUNK);
+		m_deflate.next_out = &m_compressed[used];
+		m_deflate.avail_out = COMPRESS_CHUNK;
+		ret = deflate(&m_deflate, flush);
+		m_compressed.resize(used + COMPRESS_CHUNK - m_deflate.avail_out);
+	} while (ret != Z_STREAM_ERROR && (m_deflate.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END)));
+	m_buffer.clear();
+}
+
+zip_int64_t Zip::File::source(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+	File* file = static_cast<File*>(userdata);
+	switch (cmd) {
+	case ZIP_SOURCE_OPEN:
+		file->m_readOffset = 0;
+		return 0;
+	case ZIP_SOURCE_READ: {
+		size_t size = min<zip_uint64_t>(len, file->m_compressed.size() - file->m_readOffset);
+		memcpy(data, &file->m_compressed[file->m_readOffset], size);
+		file->m_readOffset += size;
+		return size;
+	}
+	case ZIP_SOURCE_CLOSE:
+	case ZIP_SOURCE_FREE:
+		return 0;
+	case ZIP_SOURCE_STAT: {
+		zip_stat_t* stat = static_cast<zip_stat_t*>(data);
+		zip_stat_init(stat);
+		stat->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_ENCRYPTION_METHOD;
+		stat->size = file->m_size;
+		stat->comp_size = file->m_compressed.size();
+		stat->comp_method = ZIP_CM_DEFLATE;
+		stat->crc = file->m_crc;
+		stat->encryption_method = ZIP_EM_NONE;
+		return sizeof(*stat);
+	}
+	case ZIP_SOURCE_ERROR: {
+		zip_error_t error;
+		zip_error_init(&error);
+		return zip_error_to_data(&error, data, len);
+	}
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+	default:
+		return -1;
+	}
+}
+
 void Zip::File::close() {
 	if (m_file) {
 		zip_fclose(m_file);
-	} else if (m_buffer.size()) {
-		zip_source_t* source = zip_source_buffer(m_zip, static_cast<void*>(&m_buffer.front()), m_buffer.size(), 0);
+	} else if (m_deflating) {
+		compress(Z_FINISH);
+		deflateEnd(&m_deflate);
+		m_deflating = false;
+		// The compressed data is copied into the archive as is when it's closed
+		zip_source_t* source = zip_source_function(m_zip, &File::source, this);
 		if (!source) {
 			return;
 		}
 		zip_int64_t i = zip_file_add(m_zip, m_name.c_str(), source, ZIP_FL_OVERWRITE);
 		if (i < 0) {
+			zip_source_free(source);
 			return;
 		}
 	}
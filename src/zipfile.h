@@ -2,6 +2,8 @@
 
 #include "zip.h"
 
+#include <zlib.h>
+
 #include <memory>
 #include <string>
 #include <vector>
@@ -14,6 +16,7 @@ public:
 	public:
 		File(zip_t*, const std::string& name, zip_file_t* = nullptr);
 		File(File&) = delete;
+		~File();
 
 		std::string readline();
 		ssize_t read(void* buffer, size_t size);
@@ -21,12 +24,23 @@ public:
 
 	private:
 		void close();
+		void compress(int flush);
+		static zip_int64_t source(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd);
 		friend class Zip;
 
 		zip_t* m_zip;
 		zip_file_t* m_file;
 		std::vector<char> m_buffer;
 		std::string m_name;
+
+		// Written data is deflated in chunks as it arrives and handed to
+		// libzip already compressed when the archive is closed
+		z_stream m_deflate{};
+		bool m_deflating = false;
+		std::vector<uint8_t> m_compressed;
+		size_t m_readOffset = 0;
+		uLong m_crc = 0;
+		size_t m_size = 0;
 	};
 
 	Zip(const std::string& path);
@@ -36,6 +50,8 @@ public:
 	void close();
 
 	File* openFile(const std::string& name, bool write = false);
+	bool readFile(const std::string& name, std::vector<uint8_t>* data);
+	std::vector<std::string> list() const;
 
 private:
 	std::string m_path;
@@ -2,7 +2,13 @@ import os
 import sys
 
 import stable_retro.data
-from stable_retro._retro import Movie, RetroEmulator, core_path
+from stable_retro._retro import (
+    Movie,
+    ProcessVectorEmulator,
+    RetroEmulator,
+    VectorEmulator,
+    core_path,
+)
 from stable_retro.enums import Actions, Observations, State
 from stable_retro.retro_env import RetroEnv
 
@@ -16,6 +22,8 @@ with open(os.path.join(os.path.dirname(__file__), "VERSION.txt")) as f:
 __all__ = [
     "Movie",
     "RetroEmulator",
+    "VectorEmulator",
+    "ProcessVectorEmulator",
     "Actions",
     "State",
     "Observations",
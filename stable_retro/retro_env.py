@@ -17,6 +17,12 @@ class RetroEnv(gym.Env):
     Gym Retro environment class
 
     Provides a Gym interface to classic video games
+
+    With frameskip, each action is repeated natively for up to that many
+    frames. Every repeated frame is rendered, so when an episode ends partway
+    through a step the observation is that of the terminal frame. Calling
+    RetroEmulator.step_repeat with skip_render=True instead skips rendering
+    the frames in between, and reports how stale the observation is
     """
 
     metadata = {"render_modes": ["human", "rgb_array"], "video.frames_per_second": 60.0}
@@ -33,10 +39,18 @@ class RetroEnv(gym.Env):
         inttype=retro.data.Integrations.STABLE,
         obs_type=retro.Observations.IMAGE,
         render_mode="human",
+        grayscale=False,
+        resize=None,
+        max_pool=False,
+        frameskip=1,
     ):
         if not hasattr(self, "spec"):
             self.spec = None
         self._obs_type = obs_type
+        self._preprocess = grayscale or resize is not None or max_pool
+        if frameskip < 1:
+            raise ValueError("frameskip must be at least 1")
+        self.frameskip = frameskip
         self.img = None
         self.ram = None
         self.viewer = None
@@ -96,7 +110,7 @@ class RetroEnv(gym.Env):
 
         self.system = retro.get_romfile_system(rom_path)
 
-        # We can't have more than one emulator per process. Before creating an
+        # Each emulator holds its own copy of the core. Before creating an
         # emulator, ensure that unused ones are garbage-collected
         gc.collect()
         self.em = retro.RetroEmulator(rom_path)
@@ -131,9 +145,32 @@ class RetroEnv(gym.Env):
             )
         else:
             self.action_space = gym.spaces.MultiBinary(self.num_buttons * players)
+        # Actions are decoded to button masks by a table compiled natively
+        self.em.configure_actions(
+            self.data,
+            retro.Actions(use_restricted_actions).value,
+            players,
+        )
+
+        if self._obs_type == retro.Observations.RAM and render_mode is None:
+            # Nothing looks at the screen, so let cores skip rendering it
+            self.em.set_video_enabled(False)
+
+        if self._preprocess:
+            # Crop, rotation, grayscale, resize and max-pooling run natively
+            # after every emulator step
+            self.em.configure_observation(
+                crop=self.data.crop_info(),
+                rotate=True,
+                gray=grayscale,
+                size=resize,
+                max_pool=max_pool,
+            )
 
         if self._obs_type == retro.Observations.RAM:
             shape = self.get_ram().shape
+        elif self._preprocess:
+            shape = self.em.get_observation().shape
         else:
             img = [self.get_screen(p, apply_rotation=True) for p in range(players)]
             shape = img[0].shape
@@ -148,6 +185,7 @@ class RetroEnv(gym.Env):
         self.movie = None
         self.movie_id = 0
         self.movie_path = None
+        self.movie_keyframe_interval = 0
         if record is True:
             self.auto_record()
         elif record is not False:
@@ -160,72 +198,65 @@ class RetroEnv(gym.Env):
             self.ram = self.get_ram()
             return self.ram
         elif self._obs_type == retro.Observations.IMAGE:
-            self.img = self.get_screen(apply_rotation=True)
+            if self._preprocess:
+                self.img = self.em.get_observation()
+            else:
+                self.img = self.get_screen(apply_rotation=True)
             return self.img
         else:
             raise ValueError(f"Unrecognized observation type: {self._obs_type}")
 
-    def _rotation_steps(self):
-        try:
-            rotation = int(self.em.get_rotation())
-        except AttributeError:
-            return 0
-        return rotation % 4
-
-    def _apply_rotation(self, image):
-        steps = self._rotation_steps()
-        if steps == 0:
-            return image
-        if steps == 1:
-            return np.flipud(np.swapaxes(image, 0, 1))
-        if steps == 2:
-            return np.flipud(np.fliplr(image))
-        if steps == 3:
-            return np.fliplr(np.swapaxes(image, 0, 1))
-        return image
-
     def action_to_array(self, a):
-        actions = []
-        for p in range(self.players):
-            action = 0
-            if self.use_restricted_actions == retro.Actions.DISCRETE:
-                for combo in self.button_combos:
-                    current = a % len(combo)
-                    a //= len(combo)
-                    action |= combo[current]
-            elif self.use_restricted_actions == retro.Actions.MULTI_DISCRETE:
-                ap = a[self.num_buttons * p : self.num_buttons * (p + 1)]
-                for i in range(len(ap)):
-                    buttons = self.button_combos[i]
-                    action |= buttons[ap[i]]
-            else:
-                ap = a[self.num_buttons * p : self.num_buttons * (p + 1)]
-                for i in range(len(ap)):
-                    action |= int(ap[i]) << i
-                if self.use_restricted_actions == retro.Actions.FILTERED:
-                    action = self.data.filter_action(action)
-            ap = np.zeros([self.num_buttons], np.uint8)
-            for i in range(self.num_buttons):
-                ap[i] = (action >> i) & 1
-            actions.append(ap)
-        return actions
+        keys = np.arange(self.num_buttons)
+        return [
+            ((mask >> keys) & 1).astype(np.uint8)
+            for mask in self.em.get_action_masks(a)
+        ]
 
     def step(self, a):
         if self.img is None and self.ram is None:
             raise RuntimeError("Please call env.reset() before env.step()")
 
-        for p, ap in enumerate(self.action_to_array(a)):
-            if self.movie:
-                for i in range(self.num_buttons):
-                    self.movie.set_key(i, ap[i], p)
-            self.em.set_button_mask(ap, p)
-
+        self.em.set_action(a)
         if self.movie:
-            self.movie.step()
-        self.em.step()
-        self.data.update_ram()
-        ob = self._update_obs()
-        rew, done, info = self.compute_step()
+            actions = self.action_to_array(a)
+
+        if self.frameskip > 1 and not self.movie:
+            # Repeat the action natively, summing rewards and stopping on done
+            rewards, done, _, _ = self.em.step_repeat(
+                self.data,
+                self.frameskip,
+                self.players,
+            )
+            ob = self._update_obs()
+            rew = rewards if self.players > 1 and self.multi_rewards else rewards[0]
+            info = self.data.lookup_all()
+        else:
+            rew = None
+            for _ in range(self.frameskip):
+                if self.movie:
+                    if (
+                        self.movie_keyframe_interval
+                        and self.movie.frame
+                        and self.movie.frame % self.movie_keyframe_interval == 0
+                    ):
+                        self.movie.add_keyframe(self.em.get_state())
+                    for p, ap in enumerate(actions):
+                        for i in range(self.num_buttons):
+                            self.movie.set_key(i, ap[i], p)
+                    self.movie.step()
+                self.em.step()
+                self.data.update_ram()
+                frame_rew, done, info = self.compute_step()
+                if rew is None:
+                    rew = frame_rew
+                elif isinstance(rew, list):
+                    rew = [r + f for r, f in zip(rew, frame_rew)]
+                else:
+                    rew += frame_rew
+                if done:
+                    break
+            ob = self._update_obs()
 
         if self.render_mode == "human":
             self.render()
@@ -247,6 +278,7 @@ class RetroEnv(gym.Env):
                     self.movie_path,
                     "%s-%s-%06d.bk2" % (self.gamename, rel_statename, self.movie_id),
                 ),
+                self.movie_keyframe_interval,
             )
             self.movie_id += 1
         if self.movie:
@@ -263,7 +295,7 @@ class RetroEnv(gym.Env):
         mode = self.render_mode
 
         img = self.img
-        if img is None:
+        if img is None or self._preprocess:
             img = self.get_screen(apply_rotation=True)
         if mode == "rgb_array":
             return img
@@ -301,24 +333,12 @@ class RetroEnv(gym.Env):
             blocks.append(arr)
         return np.concatenate(blocks)
 
-    def get_screen(self, player=0, apply_rotation=False):
-        img = self.em.get_screen()
-        x, y, w, h = self.data.crop_info(player)
-        if not w or x + w > img.shape[1]:
-            w = img.shape[1]
-        else:
-            w += x
-        if not h or y + h > img.shape[0]:
-            h = img.shape[0]
-        else:
-            h += y
-        if x == 0 and y == 0 and w == img.shape[1] and h == img.shape[0]:
-            result = img
-        else:
-            result = img[y:h, x:w]
-        if apply_rotation:
-            result = self._apply_rotation(result)
-        return result
+    def get_screen(self, player=0, apply_rotation=False, out=None):
+        return self.em.get_screen(
+            out=out,
+            crop=self.data.crop_info(player),
+            rotate=apply_rotation,
+        )
 
     def load_state(self, statename, inttype=retro.data.Integrations.DEFAULT):
         if not statename.endswith(".state"):
@@ -340,7 +360,13 @@ class RetroEnv(gym.Env):
         done = self.data.is_done()
         return reward, done, self.data.lookup_all()
 
-    def record_movie(self, path):
+    def record_movie(self, path, keyframe_interval=0):
+        """
+        Record the following steps to a BK2 movie. With a keyframe_interval,
+        a savestate is stored every that many frames so Movie.seek can jump
+        into the recording without replaying it from the start
+        """
+        self.movie_keyframe_interval = keyframe_interval
         self.movie = retro.Movie(path, True, self.players)
         self.movie.configure(self.gamename, self.em)
         if self.initial_state:
@@ -353,7 +379,8 @@ class RetroEnv(gym.Env):
             self.movie.close()
             self.movie = None
 
-    def auto_record(self, path=None):
+    def auto_record(self, path=None, keyframe_interval=0):
         if not path:
             path = os.getcwd()
         self.movie_path = path
+        self.movie_keyframe_interval = keyframe_interval
@@ -0,0 +1,106 @@
+#include "gtest/gtest.h"
+
+#include "action-table.h"
+#include "data.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace Retro {
+
+class ActionTableTest : public Test {
+public:
+	virtual void SetUp() override {
+		data.setButtons({ "B", "A", "SELECT", "START", "UP", "DOWN", "LEFT", "RIGHT" });
+		scenario.setActions({
+			{ {}, { "UP" }, { "DOWN" } },
+			{ {}, { "LEFT" }, { "RIGHT" } },
+			{ {}, { "A" }, { "B" }, { "A", "B" } },
+		});
+	}
+
+	// The decoding RetroEnv used to do in Python, carrying the index across players
+	vector<uint16_t> reference(int64_t action, unsigned players) {
+		vector<uint16_t> masks;
+		for (unsigned p = 0; p < players; ++p) {
+			uint16_t mask = 0;
+			for (const auto& combo : scenario.validActions()) {
+				vector<int> choices(combo.second.begin(), combo.second.end());
+				mask |= choices[action % choices.size()];
+				action /= choices.size();
+			}
+			masks.emplace_back(mask);
+		}
+		return masks;
+	}
+
+	GameData data;
+	Scenario scenario{ data };
+};
+
+TEST_F(ActionTableTest, Discrete) {
+	ActionTable table;
+	ASSERT_TRUE(table.compile(scenario, ActionTable::Mode::DISCRETE, 8, 2));
+	EXPECT_EQ(table.width(), 1);
+	ASSERT_EQ(table.size(), 36 * 36);
+	for (int64_t action = 0; action < static_cast<int64_t>(table.size()); ++action) {
+		vector<uint16_t> masks(2);
+		ASSERT_TRUE(table.decode(action, masks.data()));
+		EXPECT_EQ(masks, reference(action, 2)) << "action " << action;
+	}
+	uint16_t masks[2];
+	EXPECT_FALSE(table.decode(static_cast<int64_t>(table.size()), masks));
+	EXPECT_FALSE(table.decode(-1, masks));
+}
+
+TEST_F(ActionTableTest, MultiDiscrete) {
+	ActionTable table;
+	ASSERT_TRUE(table.compile(scenario, ActionTable::Mode::MULTI_DISCRETE, 8, 2));
+	EXPECT_EQ(table.width(), 6);
+	EXPECT_EQ(table.choices(), vector<size_t>({ 4, 3, 3, 4, 3, 3 }));
+
+	// Combos are ordered by mask: A/B, UP/DOWN, LEFT/RIGHT
+	int64_t action[] = { 3, 1, 2, 0, 2, 0 };
+	uint16_t masks[2];
+	ASSERT_TRUE(table.decode(action, masks));
+	EXPECT_EQ(masks[0], 0x3 | 0x10 | 0x80);
+	EXPECT_EQ(masks[1], 0x20);
+
+	action[4] = 3;
+	EXPECT_FALSE(table.decode(action, masks));
+}
+
+TEST_F(ActionTableTest, Filtered) {
+	ActionTable table;
+	ASSERT_TRUE(table.compile(scenario, ActionTable::Mode::FILTERED, 8, 1));
+	EXPECT_EQ(table.width(), 8);
+	for (unsigned mask = 0; mask < 256; ++mask) {
+		int64_t action[8];
+		for (int key = 0; key < 8; ++key) {
+			action[key] = (mask >> key) & 1;
+		}
+		uint16_t filtered;
+		ASSERT_TRUE(table.decode(action, &filtered));
+		EXPECT_EQ(filtered, scenario.filterAction(mask)) << "mask " << mask;
+	}
+}
+
+TEST_F(ActionTableTest, All) {
+	ActionTable table;
+	ASSERT_TRUE(table.compile(scenario, ActionTable::Mode::ALL, 8, 2));
+	EXPECT_EQ(table.width(), 16);
+	int64_t action[16] = { 1, 0, 0, 1, 1, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1 };
+	uint16_t masks[2];
+	ASSERT_TRUE(table.decode(action, masks));
+	EXPECT_EQ(masks[0], 0x39);
+	EXPECT_EQ(masks[1], 0x82);
+}
+
+TEST_F(ActionTableTest, Invalid) {
+	ActionTable table;
+	EXPECT_FALSE(table.compile(scenario, ActionTable::Mode::ALL, 8, 0));
+	EXPECT_FALSE(table.compile(scenario, ActionTable::Mode::ALL, 8, MAX_PLAYERS + 1));
+	EXPECT_FALSE(table.compile(scenario, ActionTable::Mode::ALL, N_BUTTONS + 1, 1));
+	EXPECT_EQ(table.players(), 0);
+}
+}
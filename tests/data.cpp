@@ -2,7 +2,10 @@
 #include "gmock/gmock.h"
 
 #include "data.h"
+#include "script.h"
 
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
 using namespace std;
@@ -123,6 +126,95 @@ TEST(GameData, Delta) {
 	EXPECT_EQI(data.lookupDelta("foo"), 1);
 }
 
+TEST(GameData, DeltaSnapshots) {
+	GameData data;
+	uint8_t ram[16] = {};
+	uint8_t ram2[4] = {};
+	data.addressSpace().addBlock(0, sizeof(ram), ram);
+	data.addressSpace().addBlock(0x100, sizeof(ram2), ram2);
+	data.setVariable("foo", { "|u1", 2 });
+	data.setVariable("bar", { "<u2", 0x101 });
+	for (int frame = 1; frame < 10; ++frame) {
+		ram[2] = frame * 3;
+		ram2[1] = frame;
+		data.updateRam();
+		if (frame > 1) {
+			EXPECT_EQI(data.lookupDelta("foo"), 3);
+			EXPECT_EQI(data.lookupDelta("bar"), 1);
+		}
+	}
+
+	// Variables added later see correct deltas right away
+	data.setVariable("baz", { "|u1", 9 });
+	ram[9] = 5;
+	data.updateRam();
+	ram[9] = 7;
+	data.updateRam();
+	EXPECT_EQI(data.lookupDelta("baz"), 2);
+}
+
+TEST(GameData, InfoSchema) {
+	GameData data;
+	uint8_t ram[4] = { 1, 2, 3, 4 };
+	data.addressSpace().addBlock(0, sizeof(ram), ram);
+	data.setVariable("foo", { "|u1", 1 });
+	data.setVariable("bar", { "|u1", 2 });
+	data.setVariable("unmapped", { "|u1", 8 });
+	data.updateRam();
+	EXPECT_THAT(data.infoSchema(), ElementsAre("bar", "foo", "unmapped"));
+
+	int64_t values[3];
+	data.lookupInfo(values);
+	EXPECT_THAT(values, ElementsAre(3, 2, 0));
+
+	ram[1] = 7;
+	data.lookupInfo(values);
+	EXPECT_THAT(values, ElementsAre(3, 7, 0));
+
+	data.setValue("custom", 9);
+	data.setInfoSchema({ "custom", "foo", "missing" });
+	data.setVariable("baz", { "|u1", 0 });
+	EXPECT_THAT(data.infoSchema(), ElementsAre("custom", "foo", "missing"));
+	data.lookupInfo(values);
+	EXPECT_THAT(values, ElementsAre(9, 7, 0));
+}
+
+TEST(Scenario, ReloadScripts) {
+	const string script = "scenario-reload.lua";
+	{
+		ofstream out(script);
+		out << "calls = 0\n"
+			   "function reward()\n"
+			   "	calls = calls + 1\n"
+			   "	return calls\n"
+			   "end\n";
+	}
+
+	ScriptContext::reset();
+	GameData data;
+	Scenario scen(data);
+	istringstream manifest("{\"reward\": {\"script\": \"lua:reward\"}, \"scripts\": [\"" + script + "\"]}");
+	ASSERT_TRUE(scen.load(&manifest, "./scenario.json"));
+	auto context = ScriptContext::get("lua");
+	ASSERT_TRUE(context);
+	EXPECT_EQ(static_cast<double>(context->callFunction("reward")), 1);
+	EXPECT_EQ(static_cast<double>(context->callFunction("reward")), 2);
+
+	// Scripts stay resident, so reloading them neither reads the file nor replaces the context
+	remove(script.c_str());
+	scen.reloadScripts();
+	EXPECT_EQ(ScriptContext::get("lua"), context);
+	EXPECT_EQ(static_cast<double>(context->callFunction("reward")), 1);
+	// Rewards call the function bound when the scenario compiled
+	scen.update();
+	EXPECT_EQ(scen.currentReward(), 2);
+	scen.reloadScripts();
+	scen.update();
+	EXPECT_EQ(scen.currentReward(), 1);
+	context.reset();
+	ScriptContext::reset();
+}
+
 TEST(Scenario, Measurement) {
 	EXPECT_EQ(Scenario::measurement("", M::ABSOLUTE), M::ABSOLUTE);
 	EXPECT_EQ(Scenario::measurement("", M::DELTA), M::DELTA);
@@ -822,4 +914,49 @@ TEST(Scenario, LoadReward2P) {
 	EXPECT_FLOAT_EQ(scen.currentReward(1), 1);
 }
 
+TEST(Scenario, CompiledLookups) {
+	GameData data;
+	Scenario scen(data);
+
+	uint8_t ram[] = { 1, 5, 0, 0 };
+	data.addressSpace().addBlock(0, sizeof(ram), ram);
+	data.setVariable("foo", {"|u1", 0});
+	data.setVariable("bar", {"|u1", 1});
+	scen.setRewardVariable("foo", { M::DELTA, O::NOOP, 0, 1, 0 });
+	scen.setDoneVariable("bar", { M::ABSOLUTE, O::EQUAL, 7 });
+
+	data.updateRam();
+	scen.update();
+	ram[0] = 3;
+	data.updateRam();
+	scen.update();
+	EXPECT_FLOAT_EQ(scen.currentReward(), 2);
+	EXPECT_FALSE(scen.isDone());
+
+	// Redefining a variable recompiles its slot
+	data.setVariable("foo", {"|u1", 2});
+	ram[2] = 4;
+	data.updateRam();
+	scen.update();
+	EXPECT_FLOAT_EQ(scen.currentReward(), 4);
+
+	// So does moving the memory it lives in
+	uint8_t moved[] = { 3, 7, 4, 0 };
+	data.addressSpace().updateBlock(0, moved);
+	data.updateRam();
+	scen.update();
+	EXPECT_FLOAT_EQ(scen.currentReward(), 0);
+	EXPECT_TRUE(scen.isDone());
+
+	// Custom variables are still looked up by name
+	data.setValue("baz", 3);
+	scen.setRewardVariable("baz", { M::ABSOLUTE, O::NOOP, 0, 1, 0 });
+	data.updateRam();
+	scen.update();
+	EXPECT_FLOAT_EQ(scen.currentReward(), 3);
+	data.setValue("baz", 5);
+	scen.update();
+	EXPECT_FLOAT_EQ(scen.currentReward(), 5);
+}
+
 }
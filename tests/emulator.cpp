@@ -2,8 +2,11 @@
 #include "gmock/gmock.h"
 
 #include "coreinfo.h"
+#include "data.h"
 #include "emulator.h"
+#include "test-helpers.h"
 
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 
@@ -111,6 +114,129 @@ TEST_P(EmulatorTest, Output) {
 	EXPECT_THAT(e.getAudioData(), NotNull());
 }
 
+TEST_P(EmulatorTest, Audio) {
+	const auto& param = GetParam();
+	Emulator e;
+	ASSERT_TRUE(e.loadRom("roms/" + param.rom));
+	e.setAudioHistory(4);
+
+	vector<int16_t> frames;
+	for (int i = 0; i < 10; ++i) {
+		e.run();
+		int samples = e.getAudioSamples();
+		frames.insert(frames.end(), e.getAudioData(), e.getAudioData() + samples * 2);
+	}
+	ASSERT_FALSE(frames.empty());
+
+	// The history window ends with the samples of the last frames in order
+	size_t history = e.getAudioHistorySamples();
+	ASSERT_GT(history, 0);
+	ASSERT_GE(history, static_cast<size_t>(e.getAudioSamples()));
+	history = min(history, frames.size() / 2);
+	EXPECT_TRUE(equal(e.getAudioHistory(history), e.getAudioHistory(history) + history * 2, frames.end() - history * 2));
+
+	e.setAudioEnabled(false);
+	EXPECT_EQ(e.getAudioSamples(), 0);
+	EXPECT_EQ(e.getAudioHistorySamples(), 0);
+	e.run();
+	EXPECT_EQ(e.getAudioSamples(), 0);
+	EXPECT_THAT(e.getAudioData(), IsNull());
+
+	e.setAudioEnabled(true);
+	size_t total = 0;
+	for (int i = 0; i < 10; ++i) {
+		e.run();
+		total += e.getAudioSamples();
+	}
+	EXPECT_GT(total, 0);
+}
+
+TEST_P(EmulatorTest, VideoSkip) {
+	const auto& param = GetParam();
+	GameData data;
+	Emulator e;
+	ASSERT_TRUE(e.loadRom("roms/" + param.rom));
+	e.configureData(&data);
+	e.run();
+	vector<uint8_t> state(e.serializeSize());
+	ASSERT_TRUE(e.serialize(state.data(), state.size()));
+
+	auto play = [&](bool skip) {
+		EXPECT_TRUE(e.unserialize(state.data(), state.size()));
+		for (int i = 0; i < 60; ++i) {
+			e.setKey(0, 0, (i / 7) % 2);
+			e.setVideoEnabled(!skip || i % 4 == 3);
+			e.run();
+		}
+		e.setVideoEnabled(true);
+		e.run();
+		vector<uint8_t> bytes = ramBytes(data);
+		const uint8_t* image = static_cast<const uint8_t*>(e.getImageData());
+		bytes.insert(bytes.end(), image, image + e.getImageHeight() * e.getImagePitch());
+		return bytes;
+	};
+
+	vector<uint8_t> expected = play(false);
+	if (play(false) != expected) {
+		// PicoDrive doesn't replay from a savestate deterministically
+		return;
+	}
+	// Skipping frames must change neither emulation nor the next rendered frame
+	EXPECT_EQ(play(true), expected);
+}
+
+TEST_P(EmulatorTest, ResetMatchesLoad) {
+	const auto& param = GetParam();
+	if (param.system != "Atari2600") {
+		// Other systems keep RAM across a soft reset
+		return;
+	}
+	auto play = [](Emulator& e, GameData& data, int frames) {
+		for (int i = 0; i < frames; ++i) {
+			e.setKey(0, i % N_BUTTONS, (i / 3) % 2);
+			e.run();
+		}
+		vector<uint8_t> bytes = ramBytes(data);
+		const uint8_t* image = static_cast<const uint8_t*>(e.getImageData());
+		bytes.insert(bytes.end(), image, image + e.getImageHeight() * e.getImagePitch());
+		return bytes;
+	};
+
+	GameData freshData;
+	Emulator fresh;
+	ASSERT_TRUE(fresh.loadRom("roms/" + param.rom));
+	fresh.configureData(&freshData);
+	fresh.reset();
+	vector<uint8_t> resetRam = ramBytes(freshData);
+	vector<uint8_t> expected = play(fresh, freshData, 30);
+
+	GameData usedData;
+	Emulator used;
+	ASSERT_TRUE(used.loadRom("roms/" + param.rom));
+	used.configureData(&usedData);
+	for (int i = 0; i < 2; ++i) {
+		play(used, usedData, 50);
+		used.reset();
+		EXPECT_EQ(ramBytes(usedData), resetRam);
+		EXPECT_EQ(play(used, usedData, 30), expected);
+	}
+
+	// Loading a state behaves the same regardless of what ran before
+	vector<uint8_t> state(used.serializeSize());
+	ASSERT_TRUE(used.serialize(state.data(), state.size()));
+	expected = play(used, usedData, 30);
+	play(used, usedData, 20);
+	ASSERT_TRUE(used.unserialize(state.data(), state.size()));
+	EXPECT_EQ(play(used, usedData, 30), expected);
+
+	GameData loadedData;
+	Emulator loaded;
+	ASSERT_TRUE(loaded.loadRom("roms/" + param.rom));
+	loaded.configureData(&loadedData);
+	ASSERT_TRUE(loaded.unserialize(state.data(), state.size()));
+	EXPECT_EQ(play(loaded, loadedData, 30), expected);
+}
+
 TEST_P(EmulatorTest, States) {
 	const auto& param = GetParam();
 	Emulator e;
@@ -129,6 +255,31 @@ TEST_P(EmulatorTest, States) {
 	e.run();
 }
 
+TEST_P(EmulatorTest, Instances) {
+	const auto& param = GetParam();
+	GameData data;
+
+	Emulator f;
+	{
+		Emulator e;
+		ASSERT_TRUE(e.loadRom("roms/" + param.rom));
+		ASSERT_TRUE(f.loadRom("roms/" + param.rom));
+		EXPECT_EQ(e.core(), f.core());
+		f.configureData(&data);
+		f.run();
+		vector<uint8_t> before = ramBytes(data);
+		EXPECT_FALSE(before.empty());
+
+		for (int i = 0; i < 10; ++i) {
+			e.run();
+		}
+		EXPECT_NE(e.getImageData(), f.getImageData());
+		EXPECT_EQ(before, ramBytes(data));
+	}
+	f.run();
+	EXPECT_THAT(f.getImageData(), NotNull());
+}
+
 vector<EmulatorTestParam> s_systems{
 	{ "Nes", "Dr88-FamiconIntro.nes" },
 	{ "Snes", "Anthrox-SineDotDemo.sfc" },
@@ -0,0 +1,158 @@
+#include "gtest/gtest.h"
+
+#ifdef ENABLE_HW_RENDER
+
+#include "hwrender.h"
+
+#include <GL/gl.h>
+
+using namespace std;
+using namespace ::testing;
+
+namespace Retro {
+
+static const unsigned WIDTH = 8;
+static const unsigned HEIGHT = 4;
+
+class HWRenderTest : public Test {
+public:
+	virtual void SetUp() override {
+		retro_hw_render_callback cb{};
+		cb.context_type = RETRO_HW_CONTEXT_OPENGL;
+		cb.bottom_left_origin = true;
+		available = context.init(cb);
+	}
+
+	// Fills the frame and paints its bottom row in GL coordinates white
+	void draw(uint8_t r, uint8_t g, uint8_t b) {
+		glDisable(GL_SCISSOR_TEST);
+		glClearColor(r / 255.f, g / 255.f, b / 255.f, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(0, 0, WIDTH, 1);
+		glClearColor(1, 1, 1, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+	}
+
+	// Checks a frame drawn by draw(), which is flipped to a top-left origin
+	static void expectFrame(const void* pixels, uint8_t r, uint8_t g, uint8_t b) {
+		ASSERT_TRUE(pixels);
+		const uint8_t* rgba = static_cast<const uint8_t*>(pixels);
+		for (unsigned y = 0; y < HEIGHT; ++y) {
+			bool bottom = y == HEIGHT - 1;
+			const uint8_t* pixel = &rgba[(y * WIDTH + WIDTH / 2) * 4];
+			EXPECT_EQ(pixel[0], bottom ? 255 : r) << "row " << y;
+			EXPECT_EQ(pixel[1], bottom ? 255 : g) << "row " << y;
+			EXPECT_EQ(pixel[2], bottom ? 255 : b) << "row " << y;
+		}
+	}
+
+	// Fills the frame red and paints its bottom half in GL coordinates white
+	void drawHalves() {
+		glDisable(GL_SCISSOR_TEST);
+		glClearColor(1, 0, 0, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(0, 0, 64, HEIGHT / 2);
+		glClearColor(1, 1, 1, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+	}
+
+	HWRenderContext context;
+	bool available = false;
+};
+
+TEST_F(HWRenderTest, Readback) {
+	if (!available) {
+		// No headless GL on this machine
+		return;
+	}
+	draw(255, 0, 0);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 255, 0, 0);
+	draw(0, 255, 0);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 0, 255, 0);
+}
+
+TEST_F(HWRenderTest, AsyncReadback) {
+	if (!available) {
+		return;
+	}
+	context.setAsyncReadback(true);
+
+	// Nothing is queued yet, so the first frame is read back directly
+	draw(255, 0, 0);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 255, 0, 0);
+	draw(0, 255, 0);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 255, 0, 0);
+	draw(0, 0, 255);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 0, 255, 0);
+
+	// A skipped frame breaks the chain, so the queued frame is stale
+	context.skipReadback();
+	draw(255, 255, 0);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 255, 255, 0);
+	draw(0, 255, 255);
+	expectFrame(context.readbackFramebuffer(WIDTH, HEIGHT), 255, 255, 0);
+
+	// So does a change of size
+	draw(255, 0, 255);
+	const uint8_t* pixels = static_cast<const uint8_t*>(context.readbackFramebuffer(WIDTH, HEIGHT + 1));
+	ASSERT_TRUE(pixels);
+	EXPECT_EQ(pixels[0], 255);
+	EXPECT_EQ(pixels[1], 0);
+	EXPECT_EQ(pixels[2], 255);
+}
+
+TEST_F(HWRenderTest, ScaledReadback) {
+	if (!available) {
+		return;
+	}
+	context.setReadbackScale(WIDTH / 2, HEIGHT / 2, false);
+	drawHalves();
+	const uint8_t* pixels = static_cast<const uint8_t*>(context.readbackFramebuffer(WIDTH, HEIGHT));
+	ASSERT_TRUE(pixels);
+	ASSERT_EQ(context.getReadbackWidth(), WIDTH / 2);
+	ASSERT_EQ(context.getReadbackHeight(), HEIGHT / 2);
+	ASSERT_FALSE(context.isReadbackGray());
+	ASSERT_EQ(context.getReadbackPitch(), WIDTH / 2 * 4);
+	for (unsigned x = 0; x < WIDTH / 2; ++x) {
+		// The top row is red, the bottom row white
+		const uint8_t* top = &pixels[x * 4];
+		const uint8_t* bottom = &pixels[context.getReadbackPitch() + x * 4];
+		EXPECT_EQ(top[0], 255);
+		EXPECT_EQ(top[1], 0);
+		EXPECT_EQ(top[2], 0);
+		EXPECT_EQ(bottom[0], 255);
+		EXPECT_EQ(bottom[1], 255);
+		EXPECT_EQ(bottom[2], 255);
+	}
+
+	context.setReadbackScale(0, 0, false);
+	drawHalves();
+	ASSERT_TRUE(context.readbackFramebuffer(WIDTH, HEIGHT));
+	EXPECT_EQ(context.getReadbackWidth(), WIDTH);
+	EXPECT_EQ(context.getReadbackPitch(), WIDTH * 4);
+}
+
+TEST_F(HWRenderTest, ScaledGrayReadback) {
+	if (!available) {
+		return;
+	}
+	// Rows of 6 pixels are packed into 2 texels, so they are padded to 8 bytes
+	context.setReadbackScale(6, HEIGHT / 2, true);
+	drawHalves();
+	const uint8_t* pixels = static_cast<const uint8_t*>(context.readbackFramebuffer(12, HEIGHT));
+	ASSERT_TRUE(pixels);
+	ASSERT_TRUE(context.isReadbackGray());
+	ASSERT_EQ(context.getReadbackWidth(), 6);
+	ASSERT_EQ(context.getReadbackPitch(), 8);
+	for (unsigned x = 0; x < 6; ++x) {
+		EXPECT_NEAR(pixels[x], 76, 1) << "x " << x;
+		EXPECT_EQ(pixels[8 + x], 255) << "x " << x;
+	}
+}
+}
+
+#endif
@@ -0,0 +1,221 @@
+#include "gtest/gtest.h"
+
+#include "imageops.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace Retro {
+
+// 0x00RRGGBB pixels whose channels encode their position
+static vector<uint32_t> makeX888(size_t w, size_t h) {
+	vector<uint32_t> pixels(w * h);
+	for (size_t y = 0; y < h; ++y) {
+		for (size_t x = 0; x < w; ++x) {
+			pixels[y * w + x] = (y << 16) | (x << 8) | 0x80;
+		}
+	}
+	return pixels;
+}
+
+TEST(Image, CopyTail) {
+	// Widths that aren't a multiple of the vector width exercise the scalar tail
+	const size_t w = 19;
+	const size_t h = 3;
+	vector<uint32_t> pixels = makeX888(w, h);
+	vector<uint8_t> out(w * h * 3);
+	Image in(Image::Format::RGBX888, pixels.data(), w, h, w * 4);
+	Image dst(Image::Format::RGB888, out.data(), w, h, w);
+	in.copyTo(&dst);
+	for (size_t y = 0; y < h; ++y) {
+		for (size_t x = 0; x < w; ++x) {
+			const uint8_t* pixel = &out[(y * w + x) * 3];
+			EXPECT_EQ(pixel[0], y);
+			EXPECT_EQ(pixel[1], x);
+			EXPECT_EQ(pixel[2], 0x80);
+		}
+	}
+}
+
+TEST(Image, Crop) {
+	const size_t w = 40;
+	const size_t h = 10;
+	vector<uint32_t> pixels = makeX888(w, h);
+	vector<uint8_t> out(21 * 4 * 3);
+	Image in(Image::Format::RGBX888, pixels.data(), w, h, w * 4);
+	Image dst(Image::Format::RGB888, out.data(), 21, 4, 21);
+	in.crop(3, 5, 21, 4).copyTo(&dst);
+	for (size_t y = 0; y < 4; ++y) {
+		for (size_t x = 0; x < 21; ++x) {
+			const uint8_t* pixel = &out[(y * 21 + x) * 3];
+			EXPECT_EQ(pixel[0], y + 5);
+			EXPECT_EQ(pixel[1], x + 3);
+		}
+	}
+	EXPECT_THROW(in.crop(30, 0, 11, 1), invalid_argument);
+}
+
+TEST(Image, Rotate) {
+	const size_t w = 5;
+	const size_t h = 3;
+	vector<uint32_t> pixels = makeX888(w, h);
+	Image in(Image::Format::RGBX888, pixels.data(), w, h, w * 4);
+
+	vector<uint8_t> out(w * h * 3);
+	Image quarter(Image::Format::RGB888, out.data(), h, w, h);
+	in.rotateTo(&quarter, 1);
+	// The top right corner ends up at the top left
+	EXPECT_EQ(out[0], 0);
+	EXPECT_EQ(out[1], w - 1);
+	// The bottom left corner ends up at the bottom right
+	EXPECT_EQ(out[(w * h - 1) * 3], h - 1);
+	EXPECT_EQ(out[(w * h - 1) * 3 + 1], 0);
+
+	Image half(Image::Format::RGB888, out.data(), w, h, w);
+	in.rotateTo(&half, 2);
+	EXPECT_EQ(out[0], h - 1);
+	EXPECT_EQ(out[1], w - 1);
+
+	in.rotateTo(&quarter, 3);
+	// The bottom left corner ends up at the top left
+	EXPECT_EQ(out[0], h - 1);
+	EXPECT_EQ(out[1], 0);
+
+	EXPECT_THROW(in.rotateTo(&half, 1), invalid_argument);
+}
+
+TEST(Image, Rotate565) {
+	const uint16_t pixels[] = { 0xF800, 0x07E0, 0x001F, 0xFFFF };
+	uint8_t out[12];
+	Image in(Image::Format::RGB565, pixels, 2, 2, 4);
+	Image dst(Image::Format::RGB888, out, 2, 2, 2);
+	in.rotateTo(&dst, 2);
+	EXPECT_EQ(out[0], 0xF8);
+	EXPECT_EQ(out[1], 0xFC);
+	EXPECT_EQ(out[2], 0xF8);
+	EXPECT_EQ(out[11], 0);
+	EXPECT_EQ(out[9], 0xF8);
+}
+
+TEST(Image, Gray) {
+	// Padded rows, as read back from packed gray hardware frames
+	const uint8_t pixels[] = { 10, 20, 30, 0, 40, 50, 60, 0 };
+	Image in(Image::Format::G8, pixels, 3, 2, 4);
+	uint8_t out[18];
+	Image dst(Image::Format::RGB888, out, 3, 2, 3);
+	in.copyTo(&dst);
+	EXPECT_EQ(out[0], 10);
+	EXPECT_EQ(out[2], 10);
+	EXPECT_EQ(out[9], 40);
+	EXPECT_EQ(out[17], 60);
+
+	Image rotated(Image::Format::RGB888, out, 2, 3, 2);
+	in.rotateTo(&rotated, 1);
+	// The top right corner ends up at the top left
+	EXPECT_EQ(out[0], 30);
+	EXPECT_EQ(out[1], 30);
+
+	ImagePipeline pipeline;
+	ImagePipeline::Config config;
+	config.gray = true;
+	pipeline.configure(config);
+	uint8_t gray[6];
+	pipeline.process(in, gray);
+	EXPECT_EQ(vector<uint8_t>(gray, gray + 6), vector<uint8_t>({ 10, 20, 30, 40, 50, 60 }));
+}
+
+TEST(ImagePipeline, Passthrough) {
+	const size_t w = 19;
+	const size_t h = 7;
+	vector<uint32_t> pixels = makeX888(w, h);
+	Image in(Image::Format::RGBX888, pixels.data(), w, h, w * 4);
+	vector<uint8_t> expected(w * h * 3);
+	Image dst(Image::Format::RGB888, expected.data(), w, h, w);
+	in.copyTo(&dst);
+
+	ImagePipeline pipeline;
+	size_t ow, oh;
+	pipeline.outputSize(w, h, &ow, &oh);
+	EXPECT_EQ(ow, w);
+	EXPECT_EQ(oh, h);
+	vector<uint8_t> out(w * h * 3);
+	pipeline.process(in, out.data());
+	EXPECT_EQ(out, expected);
+
+	ImagePipeline::Config config;
+	config.rotation = 1;
+	pipeline.configure(config);
+	vector<uint8_t> rotated(w * h * 3);
+	Image rotatedDst(Image::Format::RGB888, rotated.data(), h, w, h);
+	in.rotateTo(&rotatedDst, 1);
+	pipeline.process(in, out.data());
+	EXPECT_EQ(out, rotated);
+}
+
+TEST(ImagePipeline, Resize) {
+	const size_t w = 8;
+	const size_t h = 4;
+	vector<uint32_t> pixels = makeX888(w, h);
+	Image in(Image::Format::RGBX888, pixels.data(), w, h, w * 4);
+
+	ImagePipeline pipeline;
+	ImagePipeline::Config config;
+	config.cropX = 2;
+	config.width = 3;
+	config.height = 2;
+	pipeline.configure(config);
+	size_t ow, oh;
+	pipeline.outputSize(w, h, &ow, &oh);
+	ASSERT_EQ(ow, 3);
+	ASSERT_EQ(oh, 2);
+
+	vector<uint8_t> out(ow * oh * 3);
+	pipeline.process(in, out.data());
+	// Columns 2-3, 4-5 and 6-7; rows 0-1 and 2-3
+	EXPECT_EQ(out[0], 1);
+	EXPECT_EQ(out[1], 3);
+	EXPECT_EQ(out[4], 5);
+	EXPECT_EQ(out[7], 7);
+	EXPECT_EQ(out[9], 3);
+	EXPECT_EQ(out[10], 3);
+	EXPECT_EQ(out[11], 0x80);
+
+	config.width = 9;
+	pipeline.configure(config);
+	EXPECT_THROW(pipeline.process(in, out.data()), invalid_argument);
+}
+
+TEST(ImagePipeline, GrayMaxPool) {
+	uint32_t frame[4] = { 0xFFFFFF, 0x000000, 0xFF0000, 0x0000FF };
+	Image in(Image::Format::RGBX888, frame, 2, 2, 8);
+
+	ImagePipeline pipeline;
+	ImagePipeline::Config config;
+	config.gray = true;
+	config.maxPool = true;
+	pipeline.configure(config);
+	EXPECT_EQ(pipeline.channels(), 1);
+
+	uint8_t out[4];
+	pipeline.process(in, out);
+	EXPECT_EQ(out[0], 255);
+	EXPECT_EQ(out[1], 0);
+	EXPECT_EQ(out[2], 76);
+	EXPECT_EQ(out[3], 28);
+
+	// Each output is the maximum of this frame and the one before it
+	frame[0] = 0;
+	frame[1] = 0x808080;
+	pipeline.process(in, out);
+	EXPECT_EQ(out[0], 255);
+	EXPECT_EQ(out[1], 128);
+	pipeline.process(in, out);
+	EXPECT_EQ(out[0], 0);
+
+	pipeline.reset();
+	frame[1] = 0;
+	pipeline.process(in, out);
+	EXPECT_EQ(out[1], 0);
+}
+}
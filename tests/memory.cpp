@@ -3,6 +3,7 @@
 
 #include "memory.h"
 
+#include <cstring>
 #include <vector>
 
 using namespace std;
@@ -205,6 +206,35 @@ TEST(DataTypeShift, 8) {
 #endif
 }
 
+TEST(DataTypeDecode, Generic) {
+	uint8_t mem[8];
+	uint32_t seed = 1;
+	for (const char* endian : { "<", ">", "=", "|" }) {
+		for (const char* repr : { "i", "u", "d", "n" }) {
+			for (int width = 1; width <= 8; ++width) {
+				string name = string(endian) + repr + to_string(width);
+				if (endian[0] == '|' && width > 1) {
+					continue;
+				}
+				DataType type(name);
+				for (int i = 0; i < 256; ++i) {
+					for (auto& b : mem) {
+						seed = seed * 1103515245 + 12345;
+						b = seed >> 16;
+					}
+					int64_t value = DataType::decodeGeneric(type, mem);
+					ASSERT_EQ(type.decode(mem), value) << name;
+					uint8_t fast[8]{};
+					uint8_t generic[8]{};
+					type.encode(fast, value);
+					DataType::encodeGeneric(type, generic, value);
+					ASSERT_EQ(memcmp(fast, generic, sizeof(fast)), 0) << name;
+				}
+			}
+		}
+	}
+}
+
 TEST(DataTypeDecode, x00) {
 	uint8_t mem[] { 0x00 };
 	EXPECT_EQ(DataType("|i1").decode(mem), 0);
@@ -1487,4 +1517,73 @@ TEST(DataTypeEncode, x01020304) {
 	EXPECT_THAT(mem, ElementsAre(3, 4, 1, 2));
 }
 
+TEST(AddressSpace, CopyRanges) {
+	uint8_t low[] = { 1, 2, 3, 4 };
+	uint8_t high[] = { 5, 6, 7, 8 };
+	AddressSpace live;
+	live.addBlock(0, sizeof(low), low);
+	live.addBlock(8, sizeof(high), high);
+
+	AddressSpace snapshot;
+	EXPECT_FALSE(snapshot.copyRanges(live, { { 0, 1 } }));
+	snapshot.clone(live);
+	const void* buffer = snapshot.block(0).offset(0);
+
+	low[1] = 20;
+	low[3] = 40;
+	high[0] = 50;
+	high[3] = 80;
+	EXPECT_TRUE(snapshot.copyRanges(live, { { 1, 1 }, { 3, 7 } }));
+	EXPECT_EQ(snapshot[0], 1);
+	EXPECT_EQ(snapshot[1], 20);
+	EXPECT_EQ(snapshot[3], 40);
+	EXPECT_EQ(snapshot[8], 50);
+	EXPECT_EQ(snapshot[11], 8);
+
+	// Cloning into a matching layout reuses the existing buffers
+	snapshot.clone(live);
+	EXPECT_EQ(snapshot.block(0).offset(0), buffer);
+	EXPECT_EQ(snapshot[11], 80);
+
+	AddressSpace other;
+	other.addBlock(0, 2, low);
+	EXPECT_FALSE(snapshot.copyRanges(other, { { 0, 1 } }));
+}
+
+TEST(AddressSpace, Find) {
+	uint8_t low[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	uint8_t inner[] = { 10, 11 };
+	uint8_t high[] = { 20, 21, 22, 23 };
+	AddressSpace mem;
+	mem.addBlock(0x100, sizeof(high), high);
+	mem.addBlock(0, sizeof(low), low);
+	mem.addBlock(2, sizeof(inner), inner);
+
+	size_t offset;
+	EXPECT_EQ(mem.find(0, &offset), &mem.block(0));
+	EXPECT_EQ(offset, 0);
+	// Overlapping blocks resolve to the one that starts first
+	EXPECT_EQ(mem.find(3, &offset), &mem.blocks().at(0));
+	EXPECT_EQ(offset, 3);
+	EXPECT_EQ(mem.find(0x103, &offset), &mem.blocks().at(0x100));
+	EXPECT_EQ(offset, 3);
+	EXPECT_EQ(mem.find(8, &offset), nullptr);
+	EXPECT_EQ(mem.find(0x104, &offset), nullptr);
+	EXPECT_FALSE(mem.hasBlock(0x80));
+	EXPECT_THROW(mem[0x80], out_of_range);
+	EXPECT_EQ(mem[3], 4);
+	EXPECT_EQ(mem[0x102], 22);
+	EXPECT_EQ(mem[Variable("<u2", 0x101)], 0x1615);
+
+	AddressSpace other;
+	other.swap(mem);
+	EXPECT_FALSE(mem.hasBlock(0));
+	EXPECT_EQ(other[0x102], 22);
+	mem = move(other);
+	EXPECT_FALSE(other.hasBlock(0));
+	EXPECT_EQ(mem[7], 8);
+	mem.reset();
+	EXPECT_FALSE(mem.hasBlock(7));
+}
+
 }
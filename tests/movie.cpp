@@ -0,0 +1,135 @@
+#include "gtest/gtest.h"
+
+#include "data.h"
+#include "movie-bk2.h"
+#include "test-helpers.h"
+
+#include <cstdio>
+
+using namespace std;
+using namespace ::testing;
+
+namespace Retro {
+
+class MovieTest : public CoreTest {
+};
+
+TEST_F(MovieTest, RoundTrip) {
+	const string path = "movie-roundtrip.bk2";
+	const unsigned players = 2;
+	// Enough frames that the input log is compressed in several chunks
+	const int frames = 20000;
+	vector<string> names = Retro::buttons("Nes");
+	size_t buttons = names.size();
+	auto pressed = [&names](int frame, unsigned player, size_t key) {
+		if (names[key].empty()) {
+			// Unnamed buttons aren't recorded
+			return false;
+		}
+		return ((frame + player * 7 + key) % 5) == 0 || (frame / 50 + key) % 3 == 0;
+	};
+
+	vector<uint8_t> state(3000);
+	for (size_t i = 0; i < state.size(); ++i) {
+		state[i] = i * 31;
+	}
+
+	remove(path.c_str());
+	{
+		MovieBK2 movie(path, true, players);
+		movie.setGameName("Test-Nes");
+		movie.loadKeymap("Nes");
+		movie.setState(state.data(), state.size());
+		for (int frame = 0; frame < frames; ++frame) {
+			for (unsigned p = 0; p < players; ++p) {
+				for (size_t key = 0; key < buttons; ++key) {
+					movie.setKey(key, pressed(frame, p, key), p);
+				}
+			}
+			ASSERT_TRUE(movie.step());
+		}
+		movie.close();
+	}
+
+	unique_ptr<Movie> movie = Movie::load(path);
+	ASSERT_TRUE(movie);
+	EXPECT_EQ(movie->getGameName(), "Test-Nes");
+	EXPECT_EQ(movie->players(), players);
+	vector<uint8_t> loaded;
+	ASSERT_TRUE(movie->getState(&loaded));
+	EXPECT_EQ(loaded, state);
+
+	for (int frame = 0; frame < frames; ++frame) {
+		ASSERT_TRUE(movie->step()) << "frame " << frame;
+		for (unsigned p = 0; p < players; ++p) {
+			for (size_t key = 0; key < buttons; ++key) {
+				ASSERT_EQ(movie->getKey(key, p), pressed(frame, p, key)) << "frame " << frame << " player " << p << " key " << key;
+			}
+		}
+	}
+	EXPECT_FALSE(movie->step());
+	movie.reset();
+	remove(path.c_str());
+}
+
+TEST_F(MovieTest, Seek) {
+	const string path = "movie-seek.bk2";
+	const size_t frames = 300;
+	const size_t interval = 100;
+	GameData data;
+	Emulator e;
+	ASSERT_TRUE(e.loadRom("roms/Dr88-FamiconIntro.nes"));
+	e.configureData(&data);
+	e.run();
+	auto state = [&e]() {
+		vector<uint8_t> bytes(e.serializeSize());
+		e.serialize(bytes.data(), bytes.size());
+		return bytes;
+	};
+
+	// RAM before each frame while recording
+	vector<vector<uint8_t>> expected;
+	remove(path.c_str());
+	{
+		MovieBK2 movie(path, true);
+		movie.loadKeymap("Nes");
+		vector<uint8_t> initial = state();
+		movie.setState(initial.data(), initial.size());
+		for (size_t frame = 0; frame < frames; ++frame) {
+			if (frame && frame % interval == 0) {
+				vector<uint8_t> keyframe = state();
+				movie.addKeyframe(keyframe.data(), keyframe.size());
+			}
+			expected.emplace_back(ramBytes(data));
+			for (int key = 0; key < N_BUTTONS; ++key) {
+				bool pressed = ((frame / 4 + key) % 6) == 0;
+				movie.setKey(key, pressed);
+				e.setKey(0, key, pressed);
+			}
+			ASSERT_TRUE(movie.step());
+			e.run();
+		}
+		EXPECT_EQ(movie.frameCount(), frames);
+		movie.close();
+	}
+	expected.emplace_back(ramBytes(data));
+
+	unique_ptr<Movie> movie = Movie::load(path);
+	ASSERT_TRUE(movie);
+	EXPECT_EQ(movie->frameCount(), frames);
+	for (size_t frame : { 250, 0, 100, 299, 300, 1, 199 }) {
+		ASSERT_TRUE(movie->seek(frame, e)) << "frame " << frame;
+		EXPECT_EQ(movie->frame(), frame);
+		EXPECT_EQ(ramBytes(data), expected[frame]) << "frame " << frame;
+	}
+
+	// Stepping after a seek continues from the seeked frame
+	ASSERT_TRUE(movie->seek(frames - 2, e));
+	EXPECT_TRUE(movie->step());
+	EXPECT_TRUE(movie->step());
+	EXPECT_FALSE(movie->step());
+	EXPECT_FALSE(movie->seek(frames + 1, e));
+	movie.reset();
+	remove(path.c_str());
+}
+}
@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "process-vector-emulator.h"
+#include "test-helpers.h"
+#include "vector-emulator.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace ::testing;
+
+namespace Retro {
+
+class ProcessVectorEmulatorTest : public CoreTest {
+};
+
+TEST_F(ProcessVectorEmulatorTest, Start) {
+	ProcessVectorEmulator vec(2, 3);
+	ASSERT_TRUE(vec.start("roms/Dr88-FamiconIntro.nes")) << vec.error();
+	EXPECT_EQ(vec.numEnvs(), 2);
+	EXPECT_EQ(vec.depth(), 3);
+	EXPECT_GT(vec.numButtons(), 0);
+	EXPECT_GT(vec.screenWidth(), 0);
+	EXPECT_GT(vec.screenHeight(), 0);
+	EXPECT_GT(vec.ramSize(), 0);
+
+	// Consecutive steps fill consecutive slots
+	vector<uint16_t> masks(vec.numEnvs() * MAX_PLAYERS);
+	size_t first = vec.reset();
+	EXPECT_EQ(vec.step(masks.data(), true), (first + 1) % vec.depth());
+	EXPECT_EQ(vec.step(masks.data(), true), (first + 2) % vec.depth());
+	vec.stop();
+
+	ProcessVectorEmulator missing(2);
+	EXPECT_FALSE(missing.start("roms/missing.nes"));
+	EXPECT_FALSE(missing.error().empty());
+}
+
+TEST_F(ProcessVectorEmulatorTest, MatchesVectorEmulator) {
+	const size_t envs = 3;
+	ProcessVectorEmulator processes(envs);
+	ASSERT_TRUE(processes.start("roms/Dr88-FamiconIntro.nes")) << processes.error();
+	VectorEmulator threads(envs, 1);
+	ASSERT_TRUE(threads.loadRom("roms/Dr88-FamiconIntro.nes"));
+	ASSERT_EQ(processes.screenWidth(), threads.screenWidth());
+	ASSERT_EQ(processes.screenHeight(), threads.screenHeight());
+	ASSERT_EQ(processes.numButtons(), threads.numButtons());
+
+	size_t buttons = threads.numButtons();
+	size_t frameSize = static_cast<size_t>(threads.screenWidth()) * threads.screenHeight() * 3;
+	vector<uint8_t> expected(envs * frameSize);
+
+	size_t slot = processes.reset();
+	threads.reset();
+	for (size_t i = 0; i < envs; ++i) {
+		threads.copyScreen(i, &expected[i * frameSize]);
+	}
+	EXPECT_EQ(memcmp(processes.frames(slot), expected.data(), expected.size()), 0);
+
+	for (size_t frame = 0; frame < 30; ++frame) {
+		vector<uint8_t> actions(envs * buttons);
+		vector<uint16_t> masks(envs * MAX_PLAYERS);
+		for (size_t i = 0; i < envs; ++i) {
+			for (size_t key = 0; key < buttons; ++key) {
+				bool pressed = ((frame + i + key) % 5) == 0;
+				actions[i * buttons + key] = pressed;
+				masks[i * MAX_PLAYERS] |= pressed << key;
+			}
+		}
+		vector<float> rewards(envs);
+		vector<uint8_t> dones(envs);
+		threads.step(actions.data(), 1, true, expected.data(), rewards.data(), reinterpret_cast<bool*>(dones.data()));
+		slot = processes.step(masks.data(), true);
+		ASSERT_EQ(memcmp(processes.frames(slot), expected.data(), expected.size()), 0) << "frame " << frame;
+		for (size_t i = 0; i < envs; ++i) {
+			EXPECT_EQ(processes.rewards(slot)[i], rewards[i]);
+			EXPECT_EQ(processes.dones(slot)[i], dones[i] != 0);
+		}
+	}
+
+	// Results from before stop() can still be read
+	processes.stop();
+	EXPECT_EQ(memcmp(processes.frames(slot), expected.data(), expected.size()), 0);
+	EXPECT_THROW(processes.reset(), runtime_error);
+}
+}
@@ -104,3 +104,163 @@ TEST(ScriptLua, SetCustomData) {
 	context->callFunction("test");
 	EXPECT_EQ(data.lookupValue("foo"), 1);
 }
+
+TEST(ScriptLua, Restart) {
+	GameData data;
+	uint8_t ram[] = { 1 };
+	data.addressSpace().addBlock(0, sizeof(ram), ram);
+	data.updateRam();
+	data.setVariable("foo", {"|u1", 0});
+
+	auto context = ScriptLua::create();
+	ASSERT_TRUE(context->init());
+	context->setData(&data);
+	ASSERT_TRUE(context->loadString(
+		"total = 0\n"
+		"local calls = 0\n"
+		"function step()\n"
+		"	calls = calls + 1\n"
+		"	total = total + data.foo\n"
+		"	if first == nil then\n"
+		"		first = calls\n"
+		"	end\n"
+		"	return total + calls\n"
+		"end\n"
+		"function firstCall()\n"
+		"	return first\n"
+		"end\n"));
+
+	auto run = [&context]() {
+		vector<double> results;
+		for (int i = 0; i < 3; ++i) {
+			results.push_back(static_cast<double>(context->callFunction("step")));
+		}
+		results.push_back(static_cast<double>(context->callFunction("firstCall")));
+		return results;
+	};
+	vector<double> expected = run();
+	EXPECT_THAT(expected, ElementsAre(2, 4, 6, 1));
+
+	ASSERT_TRUE(context->restart());
+	// Globals the functions created are gone until they run again
+	EXPECT_EQ(context->callFunction("firstCall").type(), Variant::Type::VOID);
+	EXPECT_EQ(run(), expected);
+	EXPECT_THAT(context->listFunctions(), UnorderedElementsAre("step", "firstCall"));
+}
+
+TEST(ScriptLua, RestartLibraries) {
+	GameData data;
+	auto context = ScriptLua::create();
+	ASSERT_TRUE(context->init());
+	context->setData(&data);
+	ASSERT_TRUE(context->loadString(
+		"string.tag = (string.tag or 0) + 1\n"
+		"local upper = string.upper\n"
+		"string.upper = function(s) return 'x' end\n"
+		"tostring = nil\n"
+		"setmetatable(_G, { __index = function() return 5 end })\n"
+		"local rolled = math.random(1000000)\n"
+		"function tag() return string.tag end\n"
+		"function upperChanged() return string.upper('a') ~= upper('a') end\n"
+		"function roll() return rolled end\n"
+		"function missing() return undefined end\n"));
+
+	auto run = [&context]() {
+		return make_tuple(static_cast<double>(context->callFunction("tag")),
+			static_cast<bool>(context->callFunction("upperChanged")),
+			static_cast<double>(context->callFunction("roll")),
+			static_cast<double>(context->callFunction("missing")));
+	};
+	auto expected = run();
+	EXPECT_EQ(get<0>(expected), 1);
+
+	// Library tables, replaced builtins, the globals' metatable and the
+	// random generator all start over as if the scripts were loaded fresh
+	ASSERT_TRUE(context->restart());
+	EXPECT_EQ(run(), expected);
+	ASSERT_TRUE(context->restart());
+	EXPECT_EQ(run(), expected);
+
+	auto fresh = ScriptLua::create();
+	ASSERT_TRUE(fresh->init());
+	fresh->setData(&data);
+	ASSERT_TRUE(fresh->loadString("local rolled = math.random(1000000)\nfunction roll() return rolled end\n"));
+	EXPECT_EQ(static_cast<double>(fresh->callFunction("roll")), get<2>(expected));
+}
+
+TEST(ScriptLua, BindFunction) {
+	auto context = ScriptLua::create();
+	ASSERT_TRUE(context->init());
+	size_t later = context->bindFunction("later");
+	EXPECT_THROW(context->callBound(later), runtime_error);
+
+	ASSERT_TRUE(context->loadString(
+		"function later()\n"
+		"	return 3\n"
+		"end\n"));
+	EXPECT_EQ(context->bindFunction("later"), later);
+	EXPECT_EQ(static_cast<double>(context->callBound(later)), 3);
+	ASSERT_TRUE(context->restart());
+	EXPECT_EQ(static_cast<double>(context->callBound(later)), 3);
+}
+
+TEST(ScriptLua, GetDataRemapped) {
+	GameData data;
+	uint8_t ram[] = { 1, 2 };
+	data.addressSpace().addBlock(0, sizeof(ram), ram);
+	data.updateRam();
+	data.setVariable("foo", {"|u1", 0});
+
+	auto context = ScriptLua::create();
+	ASSERT_TRUE(context->init());
+	context->setData(&data);
+	ASSERT_TRUE(context->loadString(
+		"function test()\n"
+		"	return data.foo\n"
+		"end\n"));
+
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("test")), 1);
+	data.setVariable("foo", {"|u1", 1});
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("test")), 2);
+	data.removeVariable("foo");
+	data.setValue("foo", Variant(int64_t(5)));
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("test")), 5);
+}
+
+#ifdef LUAJIT_VERSION
+TEST(ScriptLua, MemoryFFI) {
+	GameData data;
+	uint8_t ram[] = { 1, 2, 0x34, 0x12, 5 };
+	data.addressSpace().addBlock(0x100, sizeof(ram), ram);
+	data.updateRam();
+	data.setVariable("wide", {"<u2", 0x102});
+	data.setVariable("bcd", {"|d1", 0x104});
+
+	auto context = ScriptLua::create();
+	ASSERT_TRUE(context->init());
+	context->setData(&data);
+	ASSERT_TRUE(context->loadString(
+		"local ram, size = memory.pointer(0x100)\n"
+		"ram = ffi.cast('uint8_t*', ram)\n"
+		"local wide = ffi.cast(select(2, memory.variable('wide')), memory.variable('wide'))\n"
+		"function byte()\n"
+		"	return ram[1]\n"
+		"end\n"
+		"function mapped()\n"
+		"	return size\n"
+		"end\n"
+		"function readWide()\n"
+		"	return tonumber(wide[0])\n"
+		"end\n"
+		"function unsupported()\n"
+		"	return memory.variable('bcd') == nil and memory.pointer(0) == nil\n"
+		"end\n"));
+
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("byte")), 2);
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("mapped")), 5);
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("readWide")), 0x1234);
+	EXPECT_TRUE(static_cast<bool>(context->callFunction("unsupported")));
+	ram[1] = 7;
+	EXPECT_EQ(static_cast<int64_t>(context->callFunction("byte")), 7);
+}
+#endif
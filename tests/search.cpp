@@ -295,6 +295,16 @@ INSTANTIATE_SEARCH_TEST_CASE(MultMatch416,
 	make_shared<TypedSearchResult>(SearchResult{ 0, 4, 1, 0 }, DataType{"<u2"})
 )
 
+INSTANTIATE_SEARCH_TEST_CASE(MultMatch2NoLowByte,
+	{
+		{ 511, { 1, 0, 3, 0xFF, 0xDE } }
+	},
+	{
+		{ { 1, 2, 1, 0 }, {">u3", ">i3"} }
+	},
+	make_shared<TypedSearchResult>(SearchResult{ 1, 2, 1, 0 }, DataType{">u3"})
+)
+
 INSTANTIATE_SEARCH_TEST_CASE(2ExactMatch1,
 	{
 		{ 1, { 1, 99, 99, 99 } },
@@ -908,4 +918,111 @@ INSTANTIATE_DELTA_TEST_CASE(GreaterGreaterOffset,
 	}
 )
 
+TEST(Search, LargeBlocks) {
+	vector<uint8_t> low(70, 0x99);
+	vector<uint8_t> high(50, 0x99);
+	low[37] = 5;
+	high[20] = 0x34;
+	high[21] = 0x12;
+	AddressSpace mem;
+	mem.addBlock(0x100, low.size(), low.data());
+	mem.addBlock(0x1000, high.size(), high.data());
+
+	Search byte({ "|u1", "<u2", ">u2" });
+	byte.search(mem, 5);
+	EXPECT_THAT(byte.typedResults(), ElementsAre(TypedSearchResult{ { 0x125, 1, 1, 0 }, "|u1" }));
+
+	Search word({ "|u1", "<u2", ">u2" });
+	word.search(mem, 0x1234);
+	EXPECT_THAT(word.typedResults(), ElementsAre(TypedSearchResult{ { 0x1014, 1, 1, 0 }, "<u2" }));
+
+	// Matches are found in the unrolled part of a block and in its tail
+	low[3] = 7;
+	low[68] = 7;
+	Search tail({ "|u1" });
+	tail.search(mem, 7);
+	EXPECT_THAT(tail.results(), ElementsAre(SearchResult{ 0x103, 1, 1, 0 }, SearchResult{ 0x144, 1, 1, 0 }));
+}
+
+TEST(Search, DenseDelta) {
+	vector<uint8_t> ram(200, 0);
+	vector<uint8_t> old(ram);
+	AddressSpace mem;
+	AddressSpace oldMem;
+	mem.addBlock(0x100, ram.size(), ram.data());
+	oldMem.addBlock(0x100, old.size(), old.data());
+
+	Search search({ "|u1", "<u2" });
+	search.delta(mem, oldMem, Operation::EQUAL, 0);
+	EXPECT_EQ(search.numResults(), 200 + 199);
+	EXPECT_FALSE(search.hasUniqueResult());
+
+	ram[130] = 3;
+	ram[131] = 1;
+	search.delta(mem, oldMem, Operation::POSITIVE, 0);
+	EXPECT_EQ(search.numResults(), 5);
+	EXPECT_THAT(search.typedResults(), ElementsAre(
+		TypedSearchResult{ { 0x181, 1, 1, 0 }, "<u2" },
+		TypedSearchResult{ { 0x182, 1, 1, 0 }, "|u1" },
+		TypedSearchResult{ { 0x182, 1, 1, 0 }, "<u2" },
+		TypedSearchResult{ { 0x183, 1, 1, 0 }, "|u1" },
+		TypedSearchResult{ { 0x183, 1, 1, 0 }, "<u2" }));
+
+	search.remove({ TypedSearchResult{ { 0x181, 1, 1, 0 }, "<u2" }, TypedSearchResult{ { 0x182, 1, 1, 0 }, "<u2" } });
+	EXPECT_EQ(search.numResults(), 3);
+
+	// A value search narrows the bitmaps down to a list of results
+	search.search(mem, 3);
+	EXPECT_THAT(search.typedResults(), ElementsAre(TypedSearchResult{ { 0x182, 1, 1, 0 }, "|u1" }));
+	EXPECT_TRUE(search.hasUniqueResult());
+}
+
+TEST(Search, DenseUniqueMixedTypes) {
+	vector<uint8_t> ram{ 3, 2 };
+	vector<uint8_t> old{ 1, 2 };
+	AddressSpace mem;
+	AddressSpace oldMem;
+	mem.addBlock(0x100, ram.size(), ram.data());
+	oldMem.addBlock(0x100, old.size(), old.data());
+
+	// Candidates at the same address are one result, whatever their types
+	Search search({ "|u1", "<u2" });
+	search.delta(mem, oldMem, Operation::NOT_EQUAL, 0);
+	EXPECT_THAT(search.typedResults(), ElementsAre(
+		TypedSearchResult{ { 0x100, 1, 1, 0 }, "|u1" },
+		TypedSearchResult{ { 0x100, 1, 1, 0 }, "<u2" }));
+	EXPECT_TRUE(search.hasUniqueResult());
+	EXPECT_EQ(search.uniqueResult(), (TypedSearchResult{ { 0x100, 1, 1, 0 }, "|u1" }));
+}
+
+TEST(Search, ParallelDelta) {
+	vector<DataType> types{ "|u1", "|i1", "<u2", ">i2", "<i4", ">u4", "><u4", "<d2", ">n4" };
+	vector<uint8_t> ram(300000);
+	vector<uint8_t> old(ram.size());
+	uint32_t seed = 1;
+	for (size_t i = 0; i < ram.size(); ++i) {
+		seed = seed * 1103515245 + 12345;
+		old[i] = seed >> 16;
+		ram[i] = i % 7 ? old[i] : old[i] + (seed >> 28);
+	}
+	AddressSpace mem;
+	AddressSpace oldMem;
+	mem.addBlock(0x10000, ram.size(), ram.data());
+	oldMem.addBlock(0x10000, old.size(), old.data());
+
+	Search search(types);
+	search.delta(mem, oldMem, Operation::POSITIVE, 0);
+
+	vector<TypedSearchResult> expected;
+	for (size_t i = 0; i < ram.size(); ++i) {
+		for (const auto& type : types) {
+			if (i + type.width <= ram.size() && type.decode(&ram[i]) - type.decode(&old[i]) > 0) {
+				expected.emplace_back(SearchResult{ 0x10000 + i, 1, 1, 0 }, type);
+			}
+		}
+	}
+	ASSERT_EQ(search.numResults(), expected.size());
+	EXPECT_EQ(search.typedResults(), expected);
+}
+
 }
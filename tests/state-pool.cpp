@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "data.h"
+#include "emulator.h"
+#include "state-pool.h"
+#include "test-helpers.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace Retro {
+
+class StatePoolTest : public CoreTest, public WithParamInterface<string> {
+};
+
+TEST_P(StatePoolTest, SaveLoad) {
+	Emulator e;
+	GameData data;
+	ASSERT_TRUE(e.loadRom("roms/" + GetParam()));
+	e.configureData(&data);
+	e.run();
+
+	StatePool pool;
+	ASSERT_TRUE(pool.allocate(e, 3));
+	EXPECT_EQ(pool.numSlots(), 3);
+	EXPECT_EQ(pool.slotSize(), e.serializeSize());
+	EXPECT_EQ(pool.stateSize(0), 0);
+	EXPECT_FALSE(pool.load(e, 0));
+	EXPECT_FALSE(pool.save(e, 3));
+
+	const uint8_t* arena = pool.slot(0);
+	vector<vector<uint8_t>> rams;
+	for (size_t slot = 0; slot < pool.numSlots(); ++slot) {
+		for (int i = 0; i < 20; ++i) {
+			e.run();
+		}
+		ASSERT_TRUE(pool.save(e, slot));
+		EXPECT_GT(pool.stateSize(slot), 0);
+		rams.push_back(ramBytes(data));
+	}
+	EXPECT_EQ(pool.slot(0), arena);
+
+	// Restoring a slot and running reproduces the frames that followed it
+	ASSERT_TRUE(pool.load(e, 1));
+	for (int i = 0; i < 20; ++i) {
+		e.run();
+	}
+	EXPECT_EQ(ramBytes(data), rams[2]);
+	ASSERT_TRUE(pool.load(e, 0));
+	for (int i = 0; i < 20; ++i) {
+		e.run();
+	}
+	EXPECT_EQ(ramBytes(data), rams[1]);
+}
+
+INSTANTIATE_TEST_CASE_P(StatePool, StatePoolTest, Values("Dr88-FamiconIntro.nes", "automaton.a26"));
+}
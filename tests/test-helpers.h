@@ -0,0 +1,40 @@
+#pragma once
+
+#include "gtest/gtest.h"
+
+#include "coreinfo.h"
+#include "data.h"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Retro {
+
+// Loads the NES and Atari 2600 cores that most tests run ROMs on
+class CoreTest : public ::testing::Test {
+public:
+	virtual void SetUp() override {
+		for (const char* core : { "fceumm", "stella" }) {
+			std::ifstream in(std::string("../stable_retro/cores/") + core + ".json");
+			std::ostringstream out;
+			Retro::corePath("../stable_retro/cores");
+			out << in.rdbuf();
+			Retro::loadCoreInfo(out.str().c_str());
+		}
+	}
+};
+
+// Every mapped block of a game's memory, concatenated in address order
+inline std::vector<uint8_t> ramBytes(const GameData& data) {
+	std::vector<uint8_t> bytes;
+	for (const auto& block : data.addressSpace().blocks()) {
+		const uint8_t* start = static_cast<const uint8_t*>(block.second.offset(0));
+		bytes.insert(bytes.end(), start, start + block.second.size());
+	}
+	return bytes;
+}
+
+}
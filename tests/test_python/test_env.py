@@ -87,3 +87,296 @@ def test_env_data(generate_test_env):
     with pytest.raises(KeyError):
         val = env.data["foo"]
         assert val
+
+
+def test_info_array(generate_test_env):
+    import numpy as np
+
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(info=json_path, scenario=json_path)
+    env.reset()
+
+    schema = env.data.info_schema()
+    out = np.zeros(len(schema), np.int64)
+    assert env.data.lookup_array(out=out) is out
+    info = env.data.lookup_all()
+    for name, value in info.items():
+        assert out[schema.index(name)] == value
+
+    env.data.set_info_schema([env.system, "missing"])
+    assert env.data.info_schema() == [env.system, "missing"]
+    assert env.data.lookup_array().tolist() == [info[env.system], 0]
+
+    with pytest.raises(RuntimeError):
+        env.data.lookup_array(out=np.zeros(3, np.int32))
+
+
+def test_state_slots(generate_test_env):
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(info=json_path, scenario=json_path)
+    env.reset()
+
+    env.em.allocate_slots(2)
+    assert env.em.num_slots == 2
+    env.em.save_slot(0)
+    state = bytes(env.em.slot_view(0))
+    for _ in range(5):
+        env.em.step()
+    env.em.load_slot(0)
+    env.em.step()
+    screen = env.em.get_screen()
+    env.em.set_state(state)
+    env.em.step()
+    assert (env.em.get_screen() == screen).all()
+
+    with pytest.raises(RuntimeError):
+        env.em.load_slot(1)
+    with pytest.raises(IndexError):
+        env.em.save_slot(2)
+
+    view = env.em.slot_view(0)
+    assert bytes(view) == state
+    with pytest.raises(RuntimeError):
+        env.em.allocate_slots(4)
+    del view
+    env.em.allocate_slots(4)
+    assert env.em.num_slots == 4
+
+
+def test_audio_window(generate_test_env):
+    import numpy as np
+
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(info=json_path, scenario=json_path)
+    env.reset()
+
+    env.em.set_audio_history(4)
+    frames = []
+    for _ in range(4):
+        env.em.step()
+        frames.append(env.em.get_audio())
+    window = env.em.get_audio_window()
+    assert window.shape[1] == 2
+    recent = np.concatenate(frames)[-len(window) :]
+    assert (window[-len(recent) :] == recent).all()
+
+    assert not window.flags.writeable
+    with pytest.raises(RuntimeError):
+        env.em.set_audio_history(1)
+    with pytest.raises(RuntimeError):
+        env.em.set_audio_enabled(False)
+    del window
+    env.em.set_audio_history(1)
+
+    env.em.set_audio_enabled(False)
+    assert not env.em.audio_enabled
+    env.em.step()
+    assert env.em.get_audio().shape == (0, 2)
+    assert env.em.get_audio_window().shape == (0, 2)
+
+
+def test_video_skip(generate_test_env):
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(
+        info=json_path,
+        scenario=json_path,
+        obs_type=retro.Observations.RAM,
+        render_mode=None,
+    )
+    assert not env.em.video_enabled
+    env.reset()
+    env.step(env.action_space.sample())
+
+    env.em.set_video_enabled(True)
+    rewards, done, frames, stale = env.em.step_repeat(env.data, 4, skip_render=True)
+    assert frames == 4
+    assert stale == 0
+    assert env.em.video_enabled
+
+    # Only changes anything for hardware-rendered cores
+    env.em.set_async_readback(True)
+    env.em.set_readback_scale((32, 24), gray=True)
+    env.em.step()
+    env.em.set_readback_scale()
+
+
+def test_movie_seek(generate_test_env, tmp_path):
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(info=json_path, scenario=json_path)
+    env.initial_state = env.em.get_state()
+    env.reset()
+
+    path = str(tmp_path / "seek.bk2")
+    env.record_movie(path, keyframe_interval=10)
+    env.movie.step()
+    for _ in range(30):
+        env.step(env.action_space.sample())
+    env.stop_record()
+
+    movie = retro.Movie(path)
+    assert movie.num_frames == 31
+    assert movie.seek(25, env.em)
+    assert movie.frame == 25
+    assert not movie.seek(32, env.em)
+
+
+@pytest.mark.parametrize(
+    "actions",
+    [retro.Actions.DISCRETE, retro.Actions.MULTI_DISCRETE, retro.Actions.FILTERED],
+)
+def test_action_table(actions, generate_test_env):
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(
+        info=json_path,
+        scenario=json_path,
+        use_restricted_actions=actions,
+    )
+    env.reset()
+
+    for _ in range(5):
+        action = env.action_space.sample()
+        masks = env.em.get_action_masks(action)
+        assert len(masks) == 1
+        array = env.action_to_array(action)[0]
+        assert sum(int(b) << i for i, b in enumerate(array)) == masks[0]
+        env.step(action)
+
+    with pytest.raises(RuntimeError):
+        if actions == retro.Actions.DISCRETE:
+            env.em.set_action(env.action_space.n)
+        else:
+            env.em.set_action([0])
+
+
+def test_vector_emulator():
+    import numpy as np
+
+    rom_path = os.path.join(os.path.dirname(__file__), "../roms/Dr88-FamiconIntro.nes")
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+
+    vec = retro.VectorEmulator(rom_path, 3, 2)
+    vec.load(json_path, json_path)
+    assert vec.num_envs == 3
+
+    width, height = vec.get_resolution()
+    obs = vec.reset()
+    assert obs.shape == (3, height, width, 3)
+    assert obs.dtype == np.uint8
+
+    num_buttons = len(retro.get_system_info("Nes")["buttons"])
+    actions = np.zeros((3, num_buttons), np.uint8)
+    obs, rew, done = vec.step(actions)
+    assert obs.shape == (3, height, width, 3)
+    assert rew.shape == (3,)
+    assert done.shape == (3,)
+    assert not done.any()
+    assert isinstance(vec.lookup_all(0)["Nes"], int)
+
+    schema = vec.info_schema()
+    values = vec.lookup_array()
+    assert values.shape == (3, len(schema))
+    assert values.dtype == np.int64
+    assert values[0, schema.index("Nes")] == vec.lookup_all(0)["Nes"]
+
+    with pytest.raises(RuntimeError):
+        vec.step(np.zeros((2, num_buttons), np.uint8))
+
+    vec.configure_actions(retro.Actions.ALL.value)
+    obs, rew, done = vec.step_actions(np.zeros((3, num_buttons), np.int64))
+    assert obs.shape == (3, height, width, 3)
+    with pytest.raises(RuntimeError):
+        vec.step_actions(np.zeros((3, 1), np.int64))
+
+
+def test_process_vector_emulator():
+    import numpy as np
+
+    rom_path = os.path.join(os.path.dirname(__file__), "../roms/Dr88-FamiconIntro.nes")
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+
+    vec = retro.ProcessVectorEmulator(rom_path, 2, json_path, json_path)
+    assert vec.num_envs == 2
+    assert vec.depth == 2
+
+    width, height = vec.get_resolution()
+    obs = vec.reset()
+    assert obs.shape == (2, height, width, 3)
+
+    num_buttons = len(retro.get_system_info("Nes")["buttons"])
+    actions = np.zeros((2, num_buttons), np.uint8)
+    vec.step_async(actions)
+    obs, rew, done = vec.step_wait()
+    assert obs.shape == (2, height, width, 3)
+    assert rew.shape == (2,)
+    assert not done.any()
+    ram = vec.get_ram()
+    assert ram.shape[0] == 2
+    vec.close()
+
+    # Results from before close() are still readable
+    assert np.array_equal(ram, vec.get_ram())
+    assert obs.sum() >= 0
+    with pytest.raises(RuntimeError):
+        vec.reset()
+
+    with pytest.raises(RuntimeError):
+        retro.ProcessVectorEmulator(rom_path + ".missing", 2)
+
+
+def test_get_screen_out(generate_test_env):
+    import numpy as np
+
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(info=json_path, scenario=json_path)
+    env.reset()
+
+    img = env.em.get_screen()
+    out = np.zeros_like(img)
+    assert env.em.get_screen(out=out) is out
+    assert (out == img).all()
+
+    crop = env.em.get_screen(crop=(2, 3, 10, 5))
+    assert (crop == img[3:8, 2:12]).all()
+
+    env.em.set_screen_buffer(out)
+    env.em.step()
+    assert (out == env.em.get_screen()).all()
+    env.em.set_screen_buffer(None)
+
+    with pytest.raises(RuntimeError):
+        env.em.get_screen(out=np.zeros((1, 1, 3), np.uint8))
+
+
+def test_env_preprocess(generate_test_env):
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(
+        info=json_path,
+        scenario=json_path,
+        grayscale=True,
+        resize=(42, 40),
+        max_pool=True,
+    )
+
+    obs, _ = env.reset()
+    assert obs.shape == (40, 42, 1)
+    assert obs in env.observation_space
+    obs, _, _, _, _ = env.step(env.action_space.sample())
+    assert obs.shape == (40, 42, 1)
+
+
+def test_env_frameskip(generate_test_env):
+    json_path = os.path.join(os.path.dirname(__file__), "../dummy.json")
+    env = generate_test_env(info=json_path, scenario=json_path, frameskip=4)
+    env.reset()
+
+    obs, rew, terminated, _, info = env.step(env.action_space.sample())
+    assert obs in env.observation_space
+    assert isinstance(rew, float)
+    assert terminated is False
+    assert isinstance(info, dict)
+
+    rewards, done, frames, stale = env.em.step_repeat(env.data, 3)
+    assert len(rewards) == 1
+    assert done is False
+    assert frames == 3
+    assert stale == 0
@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "thread-pool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace Retro;
+using namespace ::testing;
+
+TEST(ThreadPool, RunsEveryTask) {
+	ThreadPool pool(4);
+	EXPECT_EQ(pool.size(), 4);
+	for (size_t tasks : { 0, 1, 3, 100 }) {
+		vector<atomic<int>> counts(tasks);
+		for (auto& count : counts) {
+			count = 0;
+		}
+		pool.run(tasks, [&counts](size_t i) {
+			++counts[i];
+		});
+		for (const auto& count : counts) {
+			EXPECT_EQ(count, 1);
+		}
+	}
+}
+
+TEST(ThreadPool, Serial) {
+	ThreadPool pool(1);
+	EXPECT_EQ(pool.size(), 1);
+	vector<size_t> order;
+	pool.run(5, [&order](size_t i) {
+		order.push_back(i);
+	});
+	EXPECT_THAT(order, ElementsAre(0, 1, 2, 3, 4));
+}
+
+TEST(ThreadPool, Exception) {
+	ThreadPool pool(3);
+	atomic<int> calls{ 0 };
+	EXPECT_THROW(pool.run(16, [&calls](size_t i) {
+		++calls;
+		if (i == 7) {
+			throw runtime_error("task failed");
+		}
+	}),
+		runtime_error);
+	EXPECT_EQ(calls, 16);
+
+	calls = 0;
+	pool.run(16, [&calls](size_t) {
+		++calls;
+	});
+	EXPECT_EQ(calls, 16);
+}
@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "test-helpers.h"
+#include "vector-emulator.h"
+
+using namespace std;
+using namespace ::testing;
+
+namespace Retro {
+
+class VectorEmulatorTest : public CoreTest {
+};
+
+static vector<uint8_t> actionsFor(size_t frame, size_t envs, size_t buttons) {
+	vector<uint8_t> actions(envs * buttons);
+	for (size_t i = 0; i < actions.size(); ++i) {
+		actions[i] = ((frame + i) % 5) == 0;
+	}
+	return actions;
+}
+
+TEST_F(VectorEmulatorTest, Load) {
+	VectorEmulator vec(3, 2);
+	ASSERT_TRUE(vec.loadRom("roms/Dr88-FamiconIntro.nes"));
+	EXPECT_EQ(vec.numEnvs(), 3);
+	EXPECT_EQ(vec.numThreads(), 2);
+	EXPECT_GT(vec.numButtons(), 0);
+	EXPECT_GT(vec.screenWidth(), 0);
+	EXPECT_GT(vec.screenHeight(), 0);
+	EXPECT_FALSE(vec.isScripted());
+
+	VectorEmulator missing(2);
+	EXPECT_FALSE(missing.loadRom("roms/missing.nes"));
+}
+
+TEST_F(VectorEmulatorTest, MatchesSerial) {
+	for (const char* rom : { "roms/Dr88-FamiconIntro.nes", "roms/automaton.a26" }) {
+		const size_t envs = 4;
+		VectorEmulator vec(envs, 3);
+		VectorEmulator serial(1, 1);
+		ASSERT_TRUE(vec.loadRom(rom));
+		ASSERT_TRUE(serial.loadRom(rom));
+		vec.reset();
+		serial.reset();
+
+		size_t buttons = vec.numButtons();
+		size_t frameSize = vec.screenWidth() * vec.screenHeight() * 3;
+		vector<uint8_t> observations(envs * frameSize);
+		vector<float> rewards(envs, 1);
+		bool dones[envs];
+		vector<uint8_t> expected(frameSize);
+
+		for (size_t frame = 0; frame < 30; ++frame) {
+			vector<uint8_t> actions = actionsFor(frame, envs, buttons);
+			vec.step(actions.data(), 1, false, observations.data(), rewards.data(), dones);
+			serial.step(actions.data(), 1, false, expected.data(), nullptr, nullptr);
+		}
+		EXPECT_TRUE(equal(expected.begin(), expected.end(), observations.begin()));
+		for (size_t i = 0; i < envs; ++i) {
+			EXPECT_EQ(rewards[i], 0);
+			EXPECT_FALSE(dones[i]);
+		}
+	}
+}
+
+TEST_F(VectorEmulatorTest, Reset) {
+	VectorEmulator vec(2, 2);
+	ASSERT_TRUE(vec.loadRom("roms/Dr88-FamiconIntro.nes"));
+	vector<uint8_t> state(vec.emulator(0).serializeSize());
+	ASSERT_TRUE(vec.emulator(0).serialize(state.data(), state.size()));
+	vec.setInitialState(state.data(), state.size());
+
+	vector<uint8_t> actions(2 * vec.numButtons(), 1);
+	for (int i = 0; i < 10; ++i) {
+		vec.step(actions.data(), 1, false, nullptr, nullptr, nullptr);
+	}
+	EXPECT_EQ(vec.scenario(1).frame(), 10);
+	vec.reset(1);
+	EXPECT_EQ(vec.scenario(0).frame(), 10);
+	EXPECT_EQ(vec.scenario(1).frame(), 1);
+	for (int key = 0; key < N_BUTTONS; ++key) {
+		EXPECT_FALSE(vec.emulator(1).getKey(0, key));
+	}
+}
+
+TEST_F(VectorEmulatorTest, StepActions) {
+	const size_t envs = 3;
+	VectorEmulator vec(envs, 2);
+	VectorEmulator expected(envs, 2);
+	ASSERT_TRUE(vec.loadRom("roms/Dr88-FamiconIntro.nes"));
+	ASSERT_TRUE(expected.loadRom("roms/Dr88-FamiconIntro.nes"));
+	EXPECT_THROW(vec.step(static_cast<const int64_t*>(nullptr), nullptr, nullptr, nullptr), logic_error);
+	ASSERT_TRUE(vec.configureActions(ActionTable::Mode::ALL, 1));
+	vec.reset();
+	expected.reset();
+
+	size_t buttons = vec.numButtons();
+	ASSERT_EQ(vec.actionTable().width(), buttons);
+	size_t frameSize = vec.screenWidth() * vec.screenHeight() * 3;
+	vector<uint8_t> observations(envs * frameSize);
+	vector<uint8_t> expectedObservations(envs * frameSize);
+	for (size_t frame = 0; frame < 30; ++frame) {
+		vector<uint8_t> actions = actionsFor(frame, envs, buttons);
+		vector<int64_t> values(actions.begin(), actions.end());
+		vec.step(values.data(), observations.data(), nullptr, nullptr);
+		expected.step(actions.data(), 1, false, expectedObservations.data(), nullptr, nullptr);
+		for (size_t key = 0; key < buttons; ++key) {
+			EXPECT_EQ(vec.emulator(1).getKey(0, key), actions[buttons + key] != 0);
+		}
+	}
+	EXPECT_EQ(observations, expectedObservations);
+}
+
+TEST_F(VectorEmulatorTest, PlayerRewards) {
+	const size_t envs = 3;
+	const unsigned players = 2;
+	VectorEmulator vec(envs, 2);
+	ASSERT_TRUE(vec.loadRom("roms/Dr88-FamiconIntro.nes"));
+	vec.reset();
+
+	// Every player of every env gets a reward, not just player 0
+	vector<uint8_t> actions(envs * players * vec.numButtons());
+	vector<float> rewards(envs * players, -1);
+	vec.step(actions.data(), players, false, nullptr, rewards.data(), nullptr);
+	for (size_t i = 0; i < envs; ++i) {
+		for (unsigned player = 0; player < players; ++player) {
+			EXPECT_EQ(rewards[i * players + player], vec.scenario(i).currentReward(player));
+		}
+	}
+}
+}